@@ -18,12 +18,22 @@
 
 #include <iostream>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
 #include <thread>
 #include "renderer/renderer.h"
-#include "math/CommonMath.h"
-#include "math/vec2.h"
-#include "color/color.h"
+#include "renderer/bufferarena.h"
+#include "renderer/pixelcopy.h"
+#include "renderer/progressiverenderer.h"
+#include "renderer/tilecache.h"
+#include "kernels/samplekernels.h"
+#include "kernels/bloomgraph.h"
+#include "shader/shadercache.h"
+#include "time/profiler.h"
 
 //-------------------------------------------------------------------------------
 // global variables
@@ -38,6 +48,29 @@ SPBasicSuite * sSPBasic = NULL;
 Data * gData = NULL;
 Parameters * gParams = NULL;
 
+// DoFilter renders and writes back tiles of at most this size; DoPrepare
+// sizes maxSpace for the same
+const int32 StreamTileSize = 256;
+
+// the dialog's preview, alive between CreateProxyBuffer and DeleteProxyBuffer:
+// the shader it renders and, for shaders that read the document, the
+// document scaled down to the proxy
+Renderer * gPreviewRenderer = NULL;
+ProgressiveRenderer * gProgressiveRenderer = NULL;
+TileCache * gPreviewInput = NULL;
+int16 gPreviewShader = shaderPattern;
+
+// DoFilter's renderer and the bloom graph, kept for the life of the process
+// so a batch of filter runs reuses the workers and the pixel buffer. The
+// renderer is deliberately never deleted: joining its workers while the host
+// unloads the plug-in could deadlock.
+Renderer * gFilterRenderer = NULL;
+PassGraph gBloomGraph;
+
+// shaders SHADERFILTER_SHADER has loaded, compiled once per process and,
+// with SHADERFILTER_SHADER_CACHE=<directory>, once per machine
+ShaderCache gShaderCache;
+
 //-------------------------------------------------------------------------------
 // local routines
 //-------------------------------------------------------------------------------
@@ -60,23 +93,11 @@ void CreateParametersHandle(void);
 void InitParameters(void);
 void CreateDataHandle(void);
 void InitData(void);
-void CopyRenderedImageToPhotoshop(float* srcPixels, int width, int height, int bytesPerPixel);
-
-void kernel(const unsigned int& x,
-	const unsigned int& y,
-	const unsigned int& width,
-	const unsigned int& height,
-	Color& outputColor)
-{
-	static float aspectRatio = (float)width / height;
-	Vec2 uv = Vec2(float(x) / width, float(y) / height) * 2.0f - 1.0f;
-	uv.X() *= aspectRatio;
-
-	float t = float(pow(abs(1.0f / (((uv.X() * 300.0) + sin(uv.Y() * 5.0f)*50.0f))), 0.75f));
-	t = clamp01(t);
-	outputColor.SetValues(t * 2.0f, t * 4.0f, t * 8.0f, 1.0f);
-	Color::Clamp(outputColor, 0.0f, 1.0f);
-}
+const ShaderProgram* LoadShaderProgram(const char* path, std::string& error);
+bool SetFilterKernel(Renderer& renderer, const ShaderProgram* program, bool preview, int32& inputRadius);
+bool FetchInput(const Renderer::Tile& rect, PixelLayout& pixels);
+PixelCopy::Coverage RequestMask(const VRect& rect, MaskLayout& mask);
+void CopyRenderedImageToPhotoshop(Renderer& renderer, const VRect& rect, bool blend);
 
 //-------------------------------------------------------------------------------
 //
@@ -244,23 +265,34 @@ void DoPrepare(void)
 	// give as much memory back to Photoshop as you can
 	// we only need a tile per plane plus the maskData
 	// inTileHeight and inTileWidth are invalid at this
-	// point. Assume the tile size is 256 max.
+	// point. DoFilter streams tiles of StreamTileSize.
 	VRect filterRect = GetFilterRect();
 	int32 tileHeight = filterRect.bottom - filterRect.top;
 	int32 tileWidth = filterRect.right - filterRect.left;
-	if (tileHeight > 256)
-		tileHeight = 256;
-	if (tileWidth > 256)
-		tileWidth = 256;
+	if (tileHeight > StreamTileSize)
+		tileHeight = StreamTileSize;
+	if (tileWidth > StreamTileSize)
+		tileWidth = StreamTileSize;
 
 	int32 tileSize = tileHeight * tileWidth;
 	int32 planes = gFilterRecord->planes;
-	if (gFilterRecord->maskData != NULL)
+	if (gFilterRecord->haveMask)
 		planes++;
 	// duplicate because we have two copies, inData and outData
 	planes *= 2;
 
 	int32 totalSize = tileSize * planes;
+
+	// the host offers less memory than the kept renderer and the buffer
+	// pool hold on top of this run's tiles when it is short: give them back
+	size_t keptSize = BufferArena::GetPooledBytes() + (gFilterRenderer != NULL ? gFilterRenderer->GetMemoryUsage() : 0);
+	if ((size_t)gFilterRecord->maxSpace < (size_t)totalSize + keptSize)
+	{
+		if (gFilterRenderer != NULL)
+			gFilterRenderer->ReleaseMemory();
+		BufferArena::Trim();
+	}
+
 	// this is worst case and can be dropped considerably
 	if (gFilterRecord->maxSpace > totalSize)
 		gFilterRecord->maxSpace = totalSize;
@@ -289,6 +321,9 @@ void DoStart(void)
 	// we know we have enough information to run without next time
 	gData->queryForParameters = false;
 
+	// the preview has served its purpose, free its threads for the real render
+	DeleteProxyBuffer();
+
 	// the main processing routine
 	DoFilter();
 }
@@ -336,6 +371,31 @@ void DoFinish(void)
 //-------------------------------------------------------------------------------
 void DoFilter(void)
 {
+	// SHADERFILTER_SHADER=<file> runs a shader program instead of the
+	// chosen shader
+	const char* shaderPath = getenv("SHADERFILTER_SHADER");
+	const ShaderProgram* program = NULL;
+	if (shaderPath != NULL)
+	{
+		std::string error;
+		program = LoadShaderProgram(shaderPath, error);
+		if (program == NULL)
+		{
+			Logger logIt("ShaderFilter");
+			logIt.Write(error.c_str(), true);
+			*gResult = filterBadParameters;
+			return;
+		}
+	}
+
+	// SHADERFILTER_TRACE=<file.json> dumps a Chrome trace of this run
+	const char* tracePath = getenv("SHADERFILTER_TRACE");
+	if (tracePath != NULL)
+	{
+		Profiler::Reset();
+		Profiler::SetEnabled(true);
+	}
+
 	// Fixed numbers are 16.16 values 
 	// the first 16 bits represent the whole number
 	// the last 16 bits represent the fraction
@@ -343,45 +403,539 @@ void DoFilter(void)
 	gFilterRecord->maskRate = (int32)1 << 16;
 
 	VRect filterRect = GetFilterRect();
-	VRect inRect = GetInRect();
+	int bytesPerPixel = gFilterRecord->planes;
+
+	{
+		PROFILE_ZONE("DoFilter");
+
+		// the kernel sees document coordinates over an image ending at the
+		// filter rect's bottom right, as it always has, but only the filter
+		// rect is rendered: streamed a tile at a time, so only one tile of
+		// floats is ever held, matching what DoPrepare told the host
+		Renderer::Tile bounds;
+		bounds.left = filterRect.left;
+		bounds.top = filterRect.top;
+		bounds.right = filterRect.right;
+		bounds.bottom = filterRect.bottom;
+		// SHADERFILTER_THREADS=<n> sizes the worker pool, when the renderer
+		// is first created; SHADERFILTER_DETERMINISTIC=1 makes the output
+		// bit-identical across runs, e.g. to check it against references
+		if (gFilterRenderer == NULL)
+		{
+			const char* threads = getenv("SHADERFILTER_THREADS");
+			gFilterRenderer = new Renderer(kernelPacket<FastMath::Precise>, filterRect.right, filterRect.bottom, bytesPerPixel,
+				threads != NULL ? atoi(threads) : 0);
+		}
+		Renderer& renderer = *gFilterRenderer;
+		const char* deterministic = getenv("SHADERFILTER_DETERMINISTIC");
+		renderer.SetDeterministic(deterministic != NULL && strcmp(deterministic, "0") != 0);
+		renderer.SetImageSize(filterRect.right, filterRect.bottom);
+		renderer.SetBytesPerPixel(bytesPerPixel);
+		renderer.SetBounds(bounds);
+
+		int32 inputRadius = 0;
+		bool sampleInput = SetFilterKernel(renderer, program, false, inputRadius);
+
+		// filters read the document through a cache of input tiles big
+		// enough for a stream tile's footprint plus a row of them across
+		// the filter rect, so every input tile is fetched about once
+		VPoint imageSize;
+		if (gFilterRecord->bigDocumentData != NULL)
+		{
+			imageSize = gFilterRecord->bigDocumentData->imageSize32;
+		}
+		else
+		{
+			imageSize.h = gFilterRecord->imageSize.h;
+			imageSize.v = gFilterRecord->imageSize.v;
+		}
+		int32 inputColumns = (filterRect.right - filterRect.left + inputRadius * 2) / TileCache::TileSize + 2;
+		int32 inputRows = (StreamTileSize + inputRadius * 2) / TileCache::TileSize + 2;
+		TileCache input(FetchInput, imageSize.h, imageSize.v, bytesPerPixel, gFilterRecord->depth, inputColumns * inputRows);
+		renderer.SetSource(sampleInput ? &input : NULL);
+
+		renderer.SetOutputDepth(gFilterRecord->depth, gParams->dither != 0);
+		if (renderer.GetSupersampling() != gParams->supersampling)
+			renderer.SetSupersampling(gParams->supersampling);
+
+		// the host may only be called from this thread, so the renderer
+		// polls it from here while its workers run; progress counts
+		// renderer tiles over the whole filter rect
+		int32 tilesTotal = Renderer::CountTiles(bounds);
+		bool masked = gFilterRecord->haveMask && !gParams->ignoreSelection;
+		int32 tilesBefore = 0;
+		renderer.SetProgressCallback([&](int tilesDone, int tileCount)
+		{
+			if (gFilterRecord->abortProc())
+			{
+				*gResult = userCanceledErr;
+				return false;
+			}
+			gFilterRecord->progressProc(tilesBefore + tilesDone, tilesTotal);
+			return true;
+		});
+
+		for (int32 top = filterRect.top; top < filterRect.bottom && *gResult == noErr; top += StreamTileSize)
+		{
+			for (int32 left = filterRect.left; left < filterRect.right && *gResult == noErr; left += StreamTileSize)
+			{
+				VRect tileRect;
+				tileRect.left = left;
+				tileRect.top = top;
+				tileRect.right = std::min(left + StreamTileSize, filterRect.right);
+				tileRect.bottom = std::min(top + StreamTileSize, filterRect.bottom);
+
+				Renderer::Tile region;
+				region.left = tileRect.left;
+				region.top = tileRect.top;
+				region.right = tileRect.right;
+				region.bottom = tileRect.bottom;
+				if (sampleInput)
+				{
+					Renderer::Tile footprint;
+					footprint.left = region.left - inputRadius;
+					footprint.top = region.top - inputRadius;
+					footprint.right = region.right + inputRadius;
+					footprint.bottom = region.bottom + inputRadius;
+					if (!input.Prepare(footprint))
+					{
+						if (*gResult == noErr)
+							*gResult = filterBadParameters;
+						break;
+					}
+				}
+
+				// with a selection, fetch the tile's mask first: unselected
+				// tiles are skipped and partly selected ones only render
+				// their selected pixels and are blended into the document
+				PixelCopy::Coverage coverage = PixelCopy::FullySelected;
+				MaskLayout mask;
+				if (masked)
+				{
+					coverage = RequestMask(tileRect, mask);
+					if (*gResult != noErr)
+						break;
+				}
+
+				if (coverage != PixelCopy::Unselected)
+				{
+					if (!renderer.Render(region, coverage == PixelCopy::PartlySelected ? &mask : NULL))
+						break;
+					CopyRenderedImageToPhotoshop(renderer, tileRect, coverage == PixelCopy::PartlySelected);
+				}
+				tilesBefore += Renderer::CountTiles(region);
+			}
+		}
+
+		// the renderer outlives this call; drop what points into it
+		renderer.SetSource(NULL);
+		renderer.SetProgressCallback(Renderer::ProgressFunc());
+	}
+
+	if (tracePath != NULL)
+	{
+		Profiler::SetEnabled(false);
+		Profiler::WriteChromeTrace(tracePath);
+	}
+}
+
+//-------------------------------------------------------------------------------
+//
+// LoadShaderProgram
+//
+// Reads the shader source at path and returns it compiled, from
+// gShaderCache when it has been compiled before.
+//
+//-------------------------------------------------------------------------------
+const ShaderProgram* LoadShaderProgram(const char* path, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = std::string("cannot open ") + path;
+		return NULL;
+	}
+	std::stringstream source;
+	source << file.rdbuf();
+
+	const char* cacheDirectory = getenv("SHADERFILTER_SHADER_CACHE");
+	gShaderCache.SetDirectory(cacheDirectory != NULL ? cacheDirectory : "");
+	return gShaderCache.Get(source.str(), error);
+}
+
+//-------------------------------------------------------------------------------
+//
+// SetFilterKernel
+//
+// Points renderer at program, when SHADERFILTER_SHADER loaded one, or else
+// at the built-in shader gParams->shader picks; the preview renders the
+// pattern with the Fast approximations. Returns whether the kernel reads
+// the input and sets inputRadius to how far from a pixel it reads.
+//
+//-------------------------------------------------------------------------------
+bool SetFilterKernel(Renderer& renderer, const ShaderProgram* program, bool preview, int32& inputRadius)
+{
+	inputRadius = 0;
+	if (program != NULL)
+	{
+		renderer.SetKernel(*program);
+		return program->UsesSource();
+	}
 
-	inRect.top = filterRect.top;
-	inRect.left = filterRect.left;
-	inRect.bottom = filterRect.bottom;
-	inRect.right = filterRect.right;
+	if (gParams->shader == shaderBloom)
+	{
+		if (gBloomGraph.GetPassCount() == 0)
+			BuildBloomGraph(gBloomGraph);
+		renderer.SetKernel(gBloomGraph);
+		inputRadius = gBloomGraph.GetRadius();
+		return true;
+	}
 
+	if (gParams->shader == shaderSoftFocus)
+	{
+		renderer.SetKernel(kernelSoftFocus);
+		inputRadius = SoftFocusRadius;
+		return true;
+	}
+
+	if (preview)
+		renderer.SetKernel(kernelPacket<FastMath::Fast>);
+	else
+		renderer.SetKernel(kernelPacket<FastMath::Precise>);
+	return false;
+}
+
+//-------------------------------------------------------------------------------
+//
+// FetchInput
+//
+// The TileCache's FetchFunc: asks the host for all planes of rect of the
+// input and describes inData.
+//
+//-------------------------------------------------------------------------------
+bool FetchInput(const Renderer::Tile& rect, PixelLayout& pixels)
+{
+	VRect zeroRect = { 0, 0, 0, 0 };
+	VRect inRect;
+	inRect.left = rect.left;
+	inRect.top = rect.top;
+	inRect.right = rect.right;
+	inRect.bottom = rect.bottom;
+
+	gFilterRecord->inLoPlane = 0;
+	gFilterRecord->inHiPlane = gFilterRecord->planes - 1;
 	SetInRect(inRect);
+	SetOutRect(zeroRect);
+	SetMaskRect(zeroRect);
 
-	// duplicate what's in the inData with the outData
-	SetOutRect(inRect);
+	{
+		PROFILE_ZONE("AdvanceState");
+		*gResult = gFilterRecord->advanceState();
+	}
+	if (*gResult != noErr || gFilterRecord->inData == NULL)
+		return false;
 
-	int bytesPerPixel = gFilterRecord->planes;
-	Renderer renderer(kernel, inRect.right, inRect.bottom, bytesPerPixel);
-	renderer.Render();
-	float *pixels = renderer.GetPixels();
+	pixels.data = gFilterRecord->inData;
+	pixels.rowBytes = gFilterRecord->inRowBytes;
+	pixels.columnBytes = gFilterRecord->inColumnBytes;
+	pixels.planeBytes = gFilterRecord->inPlaneBytes;
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+//
+// RequestMask
+//
+// Asks the host for just the selection mask of rect and reports how much of
+// rect is selected. mask stays valid until the next advanceState.
+//
+//-------------------------------------------------------------------------------
+PixelCopy::Coverage RequestMask(const VRect& rect, MaskLayout& mask)
+{
+	VRect zeroRect = { 0, 0, 0, 0 };
+	SetInRect(zeroRect);
+	SetOutRect(zeroRect);
+	SetMaskRect(rect);
+
+	{
+		PROFILE_ZONE("AdvanceState");
+		*gResult = gFilterRecord->advanceState();
+	}
+	if (*gResult != noErr || gFilterRecord->maskData == NULL)
+		return PixelCopy::FullySelected;
 
-	CopyRenderedImageToPhotoshop(pixels, inRect.right, inRect.bottom, bytesPerPixel);
+	mask.data = static_cast<const unsigned char*>(gFilterRecord->maskData);
+	mask.rowBytes = gFilterRecord->maskRowBytes;
+	return PixelCopy::GetCoverage(mask, rect.right - rect.left, rect.bottom - rect.top);
 }
 
-void CopyRenderedImageToPhotoshop(float* srcPixels, int width, int height, int bytesPerPixel)
+//-------------------------------------------------------------------------------
+//
+// CopyRenderedImageToPhotoshop
+//
+// Writes the pixels the renderer just rendered for rect, already at the
+// document depth, to the host. All planes are requested in one advanceState
+// and copied in parallel bands of rows using whatever layout the host
+// describes in outRowBytes, outColumnBytes and outPlaneBytes. With blend the
+// mask is requested too and the pixels are mixed into the original ones
+// outData starts out with.
+//
+//-------------------------------------------------------------------------------
+void CopyRenderedImageToPhotoshop(Renderer& renderer, const VRect& rect, bool blend)
 {
-	for (int16 plane = 0; plane < gFilterRecord->planes; plane++)
+	VRect zeroRect = { 0, 0, 0, 0 };
+	gFilterRecord->outLoPlane = gFilterRecord->inLoPlane = 0;
+	gFilterRecord->outHiPlane = gFilterRecord->inHiPlane = gFilterRecord->planes - 1;
+	SetInRect(rect);
+	SetOutRect(rect);
+	SetMaskRect(blend ? rect : zeroRect);
+
+	// update the gFilterRecord with our latest request
 	{
-		// we want one plane at a time, small memory foot print is good
-		gFilterRecord->outLoPlane = gFilterRecord->inLoPlane = plane;
-		gFilterRecord->outHiPlane = gFilterRecord->inHiPlane = plane;
-	
-		// update the gFilterRecord with our latest request
+		PROFILE_ZONE("AdvanceState");
 		*gResult = gFilterRecord->advanceState();
-		if (*gResult != noErr) return;
+	}
+	if (*gResult != noErr) return;
+
+	PROFILE_ZONE("CopyOut");
+	PixelLayout destination;
+	destination.data = gFilterRecord->outData;
+	destination.rowBytes = gFilterRecord->outRowBytes;
+	destination.columnBytes = gFilterRecord->outColumnBytes;
+	destination.planeBytes = gFilterRecord->outPlaneBytes;
+
+	PixelLayout source = renderer.GetPixelLayout();
+	MaskLayout mask;
+	mask.data = static_cast<const unsigned char*>(gFilterRecord->maskData);
+	mask.rowBytes = gFilterRecord->maskRowBytes;
+	blend = blend && mask.data != NULL;
+
+	const int bandHeight = 32;
+	int32 width = rect.right - rect.left;
+	int32 height = rect.bottom - rect.top;
+	int bytesPerSample = gFilterRecord->depth / 8;
+	renderer.GetWorkerPool().Run((height + bandHeight - 1) / bandHeight, [&](int band, int)
+	{
+		int top = band * bandHeight;
+		int bottom = std::min(top + bandHeight, (int)height);
+		if (blend)
+			PixelCopy::BlendRows(source, destination, mask, width, gFilterRecord->planes, bytesPerSample, top, bottom);
+		else
+			PixelCopy::CopyRows(source, destination, width, gFilterRecord->planes, bytesPerSample, top, bottom);
+	});
+}
+
+//-------------------------------------------------------------------------------
+//
+// SetupFilterRecordForProxy
+//
+// Fits the filter rect into the preview area the dialog stored in
+// gData->proxyRect and sizes the proxy to match. The preview is rendered
+// rather than filtered, so there is no input to request.
+//
+//-------------------------------------------------------------------------------
+void SetupFilterRecordForProxy(void)
+{
+	VRect filterRect = GetFilterRect();
+	float filterWidth = (float)(filterRect.right - filterRect.left);
+	float filterHeight = (float)(filterRect.bottom - filterRect.top);
+	float areaWidth = (float)(gData->proxyRect.right - gData->proxyRect.left);
+	float areaHeight = (float)(gData->proxyRect.bottom - gData->proxyRect.top);
+
+	gData->proxyWidth = 0;
+	gData->proxyHeight = 0;
+	gData->proxyPlaneSize = 0;
+	if (areaWidth <= 0 || areaHeight <= 0 || filterWidth <= 0 || filterHeight <= 0)
+		return;
+
+	gData->scaleFactor = std::max(1.0f, std::max(filterWidth / areaWidth, filterHeight / areaHeight));
+	gData->proxyWidth = std::max((int32)(filterWidth / gData->scaleFactor), (int32)1);
+	gData->proxyHeight = std::max((int32)(filterHeight / gData->scaleFactor), (int32)1);
+	gData->proxyPlaneSize = gData->proxyWidth * gData->proxyHeight;
+}
+
+//-------------------------------------------------------------------------------
+//
+// CreateProxyBuffer
+//
+// Allocates the 8-bit interleaved proxy and starts rendering the shader
+// gParams->shader picks into it progressively, coarsest first. Shaders that
+// read the document get it scaled down to the proxy, fetched here because
+// only this thread may call the host; they sample it in pixels, so they
+// skip the coarse passes.
+//
+//-------------------------------------------------------------------------------
+void CreateProxyBuffer(void)
+{
+	DeleteProxyBuffer();
+	SetupFilterRecordForProxy();
+	if (gData->proxyPlaneSize == 0)
+		return;
+
+	int32 planes = gFilterRecord->planes;
+	int32 size = gData->proxyPlaneSize * planes;
+	*gResult = gFilterRecord->bufferProcs->allocateProc(size, &gData->proxyBufferID);
+	if (*gResult != noErr)
+	{
+		gData->proxyBufferID = NULL;
+		return;
+	}
+	gData->proxyBuffer = gFilterRecord->bufferProcs->lockProc(gData->proxyBufferID, true);
+	memset(gData->proxyBuffer, 0, size);
+
+	// the preview shows the filter rect where the final render puts it, in
+	// an image scaled down to the proxy
+	VRect filterRect = GetFilterRect();
+	Renderer::Tile bounds;
+	bounds.left = (int)(filterRect.left / gData->scaleFactor);
+	bounds.top = (int)(filterRect.top / gData->scaleFactor);
+	bounds.right = bounds.left + gData->proxyWidth;
+	bounds.bottom = bounds.top + gData->proxyHeight;
+	int imageWidth = std::max(bounds.right, (int)(filterRect.right / gData->scaleFactor));
+	int imageHeight = std::max(bounds.bottom, (int)(filterRect.bottom / gData->scaleFactor));
+
+	const char* shaderPath = getenv("SHADERFILTER_SHADER");
+	const ShaderProgram* program = NULL;
+	if (shaderPath != NULL)
+	{
+		std::string error;
+		program = LoadShaderProgram(shaderPath, error);
+		if (program == NULL)
+			return;
+	}
+
+	gPreviewRenderer = new Renderer(kernelPacket<FastMath::Fast>, imageWidth, imageHeight, planes);
+	gPreviewRenderer->SetBounds(bounds);
+	gPreviewShader = gParams->shader;
 
-		int pixelIndex = 0;
-		for (int i = plane; i < width * height * bytesPerPixel; i += bytesPerPixel)
+	int32 inputRadius = 0;
+	int coarsestBlockSize = 1 << (ProgressiveRenderer::PassCount - 1);
+	if (SetFilterKernel(*gPreviewRenderer, program, true, inputRadius))
+	{
+		VPoint imageSize;
+		if (gFilterRecord->bigDocumentData != NULL)
+		{
+			imageSize = gFilterRecord->bigDocumentData->imageSize32;
+		}
+		else
 		{
-			float *fPixel = (float*)gFilterRecord->outData;
-			fPixel[pixelIndex] = srcPixels[i];
-			++pixelIndex;
+			imageSize.h = gFilterRecord->imageSize.h;
+			imageSize.v = gFilterRecord->imageSize.v;
 		}
+
+		Renderer::Tile footprint;
+		footprint.left = bounds.left - inputRadius;
+		footprint.top = bounds.top - inputRadius;
+		footprint.right = bounds.right + inputRadius;
+		footprint.bottom = bounds.bottom + inputRadius;
+
+		// the host scales the input down by inputRate, a 16.16 value
+		gFilterRecord->inputRate = (int32)(gData->scaleFactor * 65536.0f);
+		gPreviewInput = new TileCache(FetchInput, std::max((int)(imageSize.h / gData->scaleFactor), 1),
+			std::max((int)(imageSize.v / gData->scaleFactor), 1), planes, gFilterRecord->depth, Renderer::CountTiles(footprint));
+		bool fetched = gPreviewInput->Prepare(footprint);
+		gFilterRecord->inputRate = (int32)1 << 16;
+		if (!fetched)
+		{
+			DeleteProxyBuffer();
+			return;
+		}
+
+		gPreviewRenderer->SetSource(gPreviewInput);
+		coarsestBlockSize = 1;
+	}
+
+	gProgressiveRenderer = new ProgressiveRenderer(*gPreviewRenderer, planes, coarsestBlockSize);
+	ResetProxyBuffer();
+}
+
+//-------------------------------------------------------------------------------
+//
+// ResetProxyBuffer
+//
+// Call whenever the parameters change: abandons the preview in flight and
+// starts again from the coarsest pass, with a new renderer when the shader
+// changed.
+//
+//-------------------------------------------------------------------------------
+void ResetProxyBuffer(void)
+{
+	if (gProgressiveRenderer == NULL)
+		return;
+
+	if (gParams->shader != gPreviewShader)
+		CreateProxyBuffer();
+	else
+		gProgressiveRenderer->Restart();
+}
+
+//-------------------------------------------------------------------------------
+//
+// UpdateProxyBuffer
+//
+// Copies the latest finished preview pass into the proxy. Returns true when
+// the proxy changed and the dialog should redraw it with DisplayProxyBuffer.
+//
+//-------------------------------------------------------------------------------
+Boolean UpdateProxyBuffer(void)
+{
+	if (gProgressiveRenderer == NULL || gData->proxyBuffer == NULL)
+		return false;
+
+	int32 rowBytes = gData->proxyWidth * gFilterRecord->planes;
+	return gProgressiveRenderer->CopyLatest((unsigned char*)gData->proxyBuffer, rowBytes) != 0;
+}
+
+//-------------------------------------------------------------------------------
+//
+// DisplayProxyBuffer
+//
+// Draws the proxy at dstRow, dstCol of the dialog's platform context.
+//
+//-------------------------------------------------------------------------------
+OSErr DisplayProxyBuffer(void* platformContext, int32 dstRow, int32 dstCol)
+{
+	if (gData->proxyBuffer == NULL)
+		return noErr;
+
+	PSPixelMap pixels;
+	memset(&pixels, 0, sizeof(pixels));
+	pixels.version = 1;
+	pixels.bounds.top = 0;
+	pixels.bounds.left = 0;
+	pixels.bounds.bottom = gData->proxyHeight;
+	pixels.bounds.right = gData->proxyWidth;
+	pixels.imageMode = DisplayPixelsMode(gFilterRecord->imageMode);
+	pixels.rowBytes = gData->proxyWidth * gFilterRecord->planes;
+	pixels.colBytes = gFilterRecord->planes;
+	pixels.planeBytes = 1;
+	pixels.baseAddr = gData->proxyBuffer;
+
+	return gFilterRecord->displayPixels(&pixels, &pixels.bounds, dstRow, dstCol, platformContext);
+}
+
+//-------------------------------------------------------------------------------
+//
+// DeleteProxyBuffer
+//
+// Stops the preview and frees the proxy.
+//
+//-------------------------------------------------------------------------------
+void DeleteProxyBuffer(void)
+{
+	delete gProgressiveRenderer;
+	gProgressiveRenderer = NULL;
+	delete gPreviewRenderer;
+	gPreviewRenderer = NULL;
+	delete gPreviewInput;
+	gPreviewInput = NULL;
+
+	if (gData->proxyBufferID != NULL)
+	{
+		gFilterRecord->bufferProcs->unlockProc(gData->proxyBufferID);
+		gFilterRecord->bufferProcs->freeProc(gData->proxyBufferID);
+		gData->proxyBufferID = NULL;
+		gData->proxyBuffer = NULL;
 	}
 }
 
@@ -411,6 +965,9 @@ void InitParameters(void)
 	gParams->disposition = 1;
 	gParams->ignoreSelection = false;
 	gParams->percent = 50;
+	gParams->dither = false;
+	gParams->shader = shaderPattern;
+	gParams->supersampling = 1;
 }
 
 //-------------------------------------------------------------------------------
@@ -17,11 +17,22 @@
 #include "PIFilter.h"
 #include "PIUtilities.h"
 
+// the built-in shaders Parameters::shader picks from
+enum
+{
+	shaderPattern = 0,		// generates the sample pattern
+	shaderSoftFocus = 1,	// filters the document with a soft glow
+	shaderBloom = 2			// blurs the bright parts of the document over it
+};
+
 typedef struct Parameters
 {
 	int16 percent;
 	int16 disposition;
 	Boolean ignoreSelection;
+	Boolean dither;			// ordered dithering for 8 and 16-bit output
+	int16 shader;
+	int16 supersampling;	// samples per axis at edges of the pattern; 1 is off
 } Parameters, *ParametersPtr;
 
 typedef struct Data
@@ -56,9 +67,14 @@ void SetColor(FilterColor& destination,
 void CreateDissolveBuffer(const int32 width, const int32 height);
 void UpdateDissolveBuffer(const int32 width, const int32 height);
 void DeleteDissolveBuffer(void);
+// The preview's interface to the platform dialog, which is not part of
+// this tree: create the proxy when the dialog opens, reset it when a
+// parameter changes, update and display it from the dialog's idle loop and
+// delete it when the dialog closes. DoStart deletes a proxy left behind.
 void CreateProxyBuffer(void);
 extern "C" void ResetProxyBuffer(void);
-extern "C" void UpdateProxyBuffer(void);
+extern "C" Boolean UpdateProxyBuffer(void);
+OSErr DisplayProxyBuffer(void* platformContext, int32 dstRow, int32 dstCol);
 void DeleteProxyBuffer(void);
 int32 DisplayPixelsMode(int16 mode);
 
@@ -0,0 +1,139 @@
+#ifndef __COLORX8__
+#define __COLORX8__
+#include "color.h"
+#include "math/floatx8.h"
+#include <stddef.h>
+
+// Eight Colors in structure-of-arrays form, one Floatx8 per channel.
+class Colorx8
+{
+public:
+
+	enum { Width = Floatx8::Width };
+
+	Colorx8()
+	{
+	}
+
+	Colorx8(const Floatx8& t)
+		: m_R(t)
+		, m_G(t)
+		, m_B(t)
+		, m_A(t)
+	{
+	}
+
+	Colorx8(const Floatx8& rVal, const Floatx8& gVal, const Floatx8& bVal)
+		: m_R(rVal)
+		, m_G(gVal)
+		, m_B(bVal)
+		, m_A(1.0f)
+	{
+	}
+
+	Colorx8(const Floatx8& rVal, const Floatx8& gVal, const Floatx8& bVal, const Floatx8& aVal)
+		: m_R(rVal)
+		, m_G(gVal)
+		, m_B(bVal)
+		, m_A(aVal)
+	{
+	}
+
+	void SetValues(const Floatx8& rVal, const Floatx8& gVal, const Floatx8& bVal, const Floatx8& aVal)
+	{
+		m_R = rVal;
+		m_G = gVal;
+		m_B = bVal;
+		m_A = aVal;
+	}
+
+	void SetValues(const Floatx8& t)
+	{
+		m_R = m_G = m_B = m_A = t;
+	}
+
+	inline Floatx8& R() { return m_R; }
+	inline Floatx8& G() { return m_G; }
+	inline Floatx8& B() { return m_B; }
+	inline Floatx8& A() { return m_A; }
+
+	// Copies one lane back out as a scalar Color.
+	Color GetLane(int lane) const
+	{
+		return Color(m_R[lane], m_G[lane], m_B[lane], m_A[lane]);
+	}
+
+	// Writes the first count lanes as interleaved pixels: lane i goes to
+	// output + i*stride, with channels (at most 4) floats per pixel.
+	void Store(float* output, int stride, int channels, int count = Width) const
+	{
+		FLOATX8_ALIGN(32) float lanes[4][Width];
+		m_R.Store(lanes[Color::r]);
+		m_G.Store(lanes[Color::g]);
+		m_B.Store(lanes[Color::b]);
+		m_A.Store(lanes[Color::a]);
+
+		if (channels > 4)
+			channels = 4;
+
+		for (int i = 0; i < count; ++i)
+		{
+			for (int c = 0; c < channels; ++c)
+				output[c] = lanes[c][i];
+			output += stride;
+		}
+	}
+
+	// Writes the first count lanes into separate planes: lane i of channel c
+	// goes to output[c * planeStride + i]. Full packets store whole vectors.
+	void StorePlanar(float* output, ptrdiff_t planeStride, int channels, int count = Width) const
+	{
+		const Floatx8* planes[4] = { &m_R, &m_G, &m_B, &m_A };
+
+		if (channels > 4)
+			channels = 4;
+
+		for (int c = 0; c < channels; ++c)
+		{
+			float* plane = output + c * planeStride;
+			if (count == Width)
+			{
+				planes[c]->Store(plane);
+				continue;
+			}
+
+			FLOATX8_ALIGN(32) float lanes[Width];
+			planes[c]->Store(lanes);
+			for (int i = 0; i < count; ++i)
+				plane[i] = lanes[i];
+		}
+	}
+
+	static void Clamp(Colorx8& color, float minValue, float maxValue)
+	{
+		Floatx8 lo(minValue);
+		Floatx8 hi(maxValue);
+
+		color.m_R = Min(Max(color.m_R, lo), hi);
+		color.m_G = Min(Max(color.m_G, lo), hi);
+		color.m_B = Min(Max(color.m_B, lo), hi);
+		color.m_A = Min(Max(color.m_A, lo), hi);
+	}
+
+	static Colorx8 Lerp(const Colorx8& lhs, const Colorx8& rhs, const Floatx8& t)
+	{
+		Floatx8 OneMinusT = Floatx8(1.0f) - t;
+		return Colorx8(OneMinusT * lhs.m_R + t * rhs.m_R,
+					   OneMinusT * lhs.m_G + t * rhs.m_G,
+					   OneMinusT * lhs.m_B + t * rhs.m_B,
+					   OneMinusT * lhs.m_A + t * rhs.m_A);
+	}
+
+private:
+	Floatx8 m_R;
+	Floatx8 m_G;
+	Floatx8 m_B;
+	Floatx8 m_A;
+};
+
+#endif
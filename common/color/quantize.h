@@ -0,0 +1,53 @@
+#ifndef __QUANTIZE__
+#define __QUANTIZE__
+#include "math/floatx8.h"
+
+// Float to integer sample conversion for the host's 8 and 16-bit modes.
+// Photoshop's 16-bit range is 0-32768, not 0-65535.
+namespace Quantize
+{
+	const float MaxValue8 = 255.0f;
+	const float MaxValue16 = 32768.0f;
+
+	// 8x8 Bayer matrix; ordered dithering adds (value + 0.5) / 64 before
+	// truncating instead of rounding with 0.5.
+	const unsigned char BayerMatrix[8][8] =
+	{
+		{  0, 32,  8, 40,  2, 34, 10, 42 },
+		{ 48, 16, 56, 24, 50, 18, 58, 26 },
+		{ 12, 44,  4, 36, 14, 46,  6, 38 },
+		{ 60, 28, 52, 20, 62, 30, 54, 22 },
+		{  3, 35, 11, 43,  1, 33,  9, 41 },
+		{ 51, 19, 59, 27, 49, 17, 57, 25 },
+		{ 15, 47,  7, 39, 13, 45,  5, 37 },
+		{ 63, 31, 55, 23, 61, 29, 53, 21 },
+	};
+
+	inline float DitherOffset(int x, int y)
+	{
+		return (BayerMatrix[y & 7][x & 7] + 0.5f) / 64.0f;
+	}
+
+	inline void StoreLanes(const Floatx8& value, unsigned char* destination) { value.StoreUInt8(destination); }
+	inline void StoreLanes(const Floatx8& value, unsigned short* destination) { value.StoreUInt16(destination); }
+
+	// destination[i] = min(max(source[i], 0) * maxValue + offsets[i], maxValue),
+	// truncated. offsets holds 0.5 for plain rounding or a dither offset per
+	// sample.
+	template <class T>
+	inline void Store(const float* source, const float* offsets, float maxValue, T* destination, int count)
+	{
+		Floatx8 scale(maxValue);
+		Floatx8 zero(0.0f);
+		int i = 0;
+		for (; i + Floatx8::Width <= count; i += Floatx8::Width)
+			StoreLanes(Min(Max(Floatx8::Load(source + i), zero) * scale + Floatx8::Load(offsets + i), scale), destination + i);
+		for (; i < count; ++i)
+		{
+			float value = (source[i] > 0.0f ? source[i] : 0.0f) * maxValue + offsets[i];
+			destination[i] = (T)(value < maxValue ? value : maxValue);
+		}
+	}
+}
+
+#endif
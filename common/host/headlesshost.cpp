@@ -0,0 +1,463 @@
+#include "headlesshost.h"
+#include <algorithm>
+#include <math.h>
+#include <memory.h>
+
+HeadlessHost* HeadlessHost::s_Active = 0;
+
+namespace
+{
+	// Backing store for a Handle; the Handle itself points at data.
+	struct HandleBlock
+	{
+		Ptr data;
+		int32 size;
+	};
+
+	inline HandleBlock* GetBlock(Handle h)
+	{
+		return reinterpret_cast<HandleBlock*>(h);
+	}
+
+	inline VRect MakeVRect(int top, int left, int bottom, int right)
+	{
+		VRect rect;
+		rect.top = top;
+		rect.left = left;
+		rect.bottom = bottom;
+		rect.right = right;
+		return rect;
+	}
+
+	inline bool IsEmpty(const VRect& rect)
+	{
+		return rect.right <= rect.left || rect.bottom <= rect.top;
+	}
+
+	// Stable value in [0, 1) for sample (x, y, plane) under seed.
+	inline float Noise(unsigned int seed, int x, int y, int plane)
+	{
+		unsigned int hash = seed * 2654435761u ^ (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)plane * 83492791u;
+		hash ^= hash >> 13;
+		hash *= 0x5bd1e995u;
+		hash ^= hash >> 15;
+		return (hash >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+HeadlessHost::HeadlessHost(int width, int height, int planes, int depth)
+	: m_Width(width)
+	, m_Height(height)
+	, m_Planes(planes)
+	, m_Depth(depth)
+	, m_PluginData(0)
+{
+	m_Document.assign((size_t)width * height * planes * GetBytesPerSample(), 0);
+	InitFilterRecord();
+}
+
+HeadlessHost::~HeadlessHost()
+{
+	if (m_FilterRecord.parameters != NULL)
+		DisposeHandle(m_FilterRecord.parameters);
+	if (m_PluginData != 0)
+		DisposeHandle((Handle)m_PluginData);
+}
+
+void HeadlessHost::FillPattern(unsigned int seed)
+{
+	int bytesPerSample = GetBytesPerSample();
+	for (int y = 0; y < m_Height; ++y)
+	{
+		for (int x = 0; x < m_Width; ++x)
+		{
+			for (int plane = 0; plane < m_Planes; ++plane)
+			{
+				// each plane runs its gradient at a different angle
+				float u = (float)x / m_Width * (plane + 1) + (float)y / m_Height;
+				float gradient = u - (int)u;
+				float value = 0.8f * gradient + 0.2f * Noise(seed, x, y, plane);
+
+				unsigned char* sample = &m_Document[(((size_t)y * m_Width + x) * m_Planes + plane) * bytesPerSample];
+				if (m_Depth == 8)
+					*sample = (unsigned char)(value * 255.0f + 0.5f);
+				else if (m_Depth == 16)
+				{
+					unsigned short value16 = (unsigned short)(value * 32768.0f + 0.5f);
+					memcpy(sample, &value16, sizeof(value16));
+				}
+				else
+					memcpy(sample, &value, sizeof(value));
+			}
+		}
+	}
+}
+
+void HeadlessHost::SetMask(unsigned int seed)
+{
+	// centre within an eighth of the image of the middle, radii a third of
+	// the sides and an edge ramp 16 pixels wide
+	float centreX = m_Width * (0.375f + 0.25f * Noise(seed, 0, 0, 0));
+	float centreY = m_Height * (0.375f + 0.25f * Noise(seed, 1, 0, 0));
+	float radiusX = std::max(m_Width / 3.0f, 1.0f);
+	float radiusY = std::max(m_Height / 3.0f, 1.0f);
+	float feather = std::min(radiusX, radiusY) / 16.0f;
+
+	m_Mask.resize((size_t)m_Width * m_Height);
+	for (int y = 0; y < m_Height; ++y)
+	{
+		for (int x = 0; x < m_Width; ++x)
+		{
+			float dx = (x + 0.5f - centreX) / radiusX;
+			float dy = (y + 0.5f - centreY) / radiusY;
+			float inside = (1.0f - sqrtf(dx * dx + dy * dy)) * feather + 0.5f;
+			inside = std::min(std::max(inside, 0.0f), 1.0f);
+			m_Mask[(size_t)y * m_Width + x] = (unsigned char)(inside * 255.0f + 0.5f);
+		}
+	}
+
+	m_FilterRecord.haveMask = true;
+}
+
+void HeadlessHost::InitFilterRecord()
+{
+	memset(&m_FilterRecord, 0, sizeof(m_FilterRecord));
+	memset(&m_BigDocument, 0, sizeof(m_BigDocument));
+	memset(&m_HandleProcs, 0, sizeof(m_HandleProcs));
+
+	m_HandleProcs.handleProcsVersion = kCurrentHandleProcsVersion;
+	m_HandleProcs.numHandleProcs = kCurrentHandleProcsCount;
+	m_HandleProcs.newProc = NewHandle;
+	m_HandleProcs.disposeProc = DisposeHandle;
+	m_HandleProcs.getSizeProc = GetHandleSize;
+	m_HandleProcs.setSizeProc = SetHandleSize;
+	m_HandleProcs.lockProc = LockHandle;
+	m_HandleProcs.unlockProc = UnlockHandle;
+	m_HandleProcs.recoverSpaceProc = RecoverSpace;
+	m_HandleProcs.disposeRegularHandleProc = DisposeHandle;
+
+	VRect bounds = MakeVRect(0, 0, m_Height, m_Width);
+	m_BigDocument.imageSize32.h = m_Width;
+	m_BigDocument.imageSize32.v = m_Height;
+	m_BigDocument.wholeSize32 = m_BigDocument.imageSize32;
+	m_BigDocument.filterRect32 = bounds;
+
+	FilterRecord& record = m_FilterRecord;
+	record.abortProc = TestAbort;
+	record.progressProc = UpdateProgress;
+	record.advanceState = AdvanceStateProc;
+	record.colorServices = ColorServices;
+	record.handleProcs = &m_HandleProcs;
+	record.bigDocumentData = &m_BigDocument;
+
+	// the 16-bit fields saturate; plug-ins that set PluginUsing32BitCoordinates
+	// read the 32-bit ones from bigDocumentData instead
+	int16 width16 = (int16)std::min(m_Width, 32767);
+	int16 height16 = (int16)std::min(m_Height, 32767);
+	record.imageSize.h = width16;
+	record.imageSize.v = height16;
+	record.wholeSize = record.imageSize;
+	record.filterRect.left = 0;
+	record.filterRect.top = 0;
+	record.filterRect.right = width16;
+	record.filterRect.bottom = height16;
+
+	record.planes = (int16)m_Planes;
+	record.depth = m_Depth;
+	record.imageHRes = record.imageVRes = 72 << 16;
+	record.maxSpace = 1 << 30;
+
+	bool gray = m_Planes < 3;
+	switch (m_Depth)
+	{
+		case 16:
+			record.imageMode = gray ? plugInModeGray16 : plugInModeRGB48;
+			break;
+		case 32:
+			record.imageMode = gray ? plugInModeGray32 : plugInModeRGB96;
+			break;
+		default:
+			record.imageMode = gray ? plugInModeGrayScale : plugInModeRGBColor;
+			break;
+	}
+
+	for (int i = 0; i < 4; ++i)
+	{
+		record.backColor[i] = 255;
+		record.foreColor[i] = 0;
+	}
+}
+
+int16 HeadlessHost::Run(PluginEntry entry)
+{
+	s_Active = this;
+
+	const int16 selectors[] = { filterSelectorParameters, filterSelectorPrepare, filterSelectorStart };
+	int16 result = noErr;
+	for (size_t i = 0; i < sizeof(selectors) / sizeof(selectors[0]) && result == noErr; ++i)
+		result = CallPlugin(entry, selectors[i]);
+
+	// plug-ins that do not use advanceState leave a rect behind and expect
+	// continue calls until all of them are empty
+	while (result == noErr)
+	{
+		WriteBackOutput();
+
+		const FilterRecord& record = m_FilterRecord;
+		bool pending = !IsEmpty(GetRequestedRect(record.inRect, m_BigDocument.inRect32)) ||
+			!IsEmpty(GetRequestedRect(record.outRect, m_BigDocument.outRect32)) ||
+			!IsEmpty(GetRequestedRect(record.maskRect, m_BigDocument.maskRect32));
+		if (!pending)
+			break;
+
+		result = AdvanceState();
+		if (result == noErr)
+			result = CallPlugin(entry, filterSelectorContinue);
+	}
+
+	if (result == noErr)
+		result = CallPlugin(entry, filterSelectorFinish);
+
+	m_InBuffer.bytes.clear();
+	m_OutBuffer.bytes.clear();
+	m_MaskBuffer.bytes.clear();
+	s_Active = 0;
+	return result;
+}
+
+int16 HeadlessHost::CallPlugin(PluginEntry entry, int16 selector)
+{
+	int16 result = noErr;
+	entry(selector, &m_FilterRecord, &m_PluginData, &result);
+	return result;
+}
+
+void HeadlessHost::CopyToFloat(std::vector<float>& pixels) const
+{
+	size_t count = (size_t)m_Width * m_Height * m_Planes;
+	pixels.resize(count);
+
+	switch (m_Depth)
+	{
+		case 8:
+			for (size_t i = 0; i < count; ++i)
+				pixels[i] = m_Document[i] * (1.0f / 255.0f);
+			break;
+		case 16:
+		{
+			const unsigned short* samples = reinterpret_cast<const unsigned short*>(&m_Document[0]);
+			for (size_t i = 0; i < count; ++i)
+				pixels[i] = samples[i] * (1.0f / 32768.0f);
+			break;
+		}
+		default:
+			memcpy(&pixels[0], &m_Document[0], count * sizeof(float));
+			break;
+	}
+}
+
+OSErr HeadlessHost::AdvanceState()
+{
+	FilterRecord& record = m_FilterRecord;
+	VRect inRect = GetRequestedRect(record.inRect, m_BigDocument.inRect32);
+	VRect outRect = GetRequestedRect(record.outRect, m_BigDocument.outRect32);
+	VRect maskRect = GetRequestedRect(record.maskRect, m_BigDocument.maskRect32);
+
+	if (!IsValidRequest(inRect, record.inLoPlane, record.inHiPlane) ||
+		!IsValidRequest(outRect, record.outLoPlane, record.outHiPlane) ||
+		!IsValidRequest(maskRect, 0, 0))
+		return filterBadParameters;
+
+	WriteBackOutput();
+
+	// the out buffer starts with the current document pixels, like the host
+	FillBuffer(m_InBuffer, inRect, record.inLoPlane, record.inHiPlane);
+	FillBuffer(m_OutBuffer, outRect, record.outLoPlane, record.outHiPlane);
+	FillMaskBuffer(maskRect);
+
+	int bytesPerSample = GetBytesPerSample();
+	int inColumnBytes = (m_InBuffer.hiPlane - m_InBuffer.loPlane + 1) * bytesPerSample;
+	int outColumnBytes = (m_OutBuffer.hiPlane - m_OutBuffer.loPlane + 1) * bytesPerSample;
+
+	record.inData = m_InBuffer.bytes.empty() ? NULL : &m_InBuffer.bytes[0];
+	record.inRowBytes = (inRect.right - inRect.left) * inColumnBytes;
+	record.inColumnBytes = inColumnBytes;
+	record.inPlaneBytes = bytesPerSample;
+	record.outData = m_OutBuffer.bytes.empty() ? NULL : &m_OutBuffer.bytes[0];
+	record.outRowBytes = (outRect.right - outRect.left) * outColumnBytes;
+	record.outColumnBytes = outColumnBytes;
+	record.outPlaneBytes = bytesPerSample;
+	record.maskData = m_MaskBuffer.bytes.empty() ? NULL : &m_MaskBuffer.bytes[0];
+	record.maskRowBytes = maskRect.right - maskRect.left;
+
+	return noErr;
+}
+
+VRect HeadlessHost::GetRequestedRect(const Rect& rect16, const VRect& rect32) const
+{
+	if (m_BigDocument.PluginUsing32BitCoordinates)
+		return rect32;
+
+	return MakeVRect(rect16.top, rect16.left, rect16.bottom, rect16.right);
+}
+
+bool HeadlessHost::IsValidRequest(const VRect& rect, int loPlane, int hiPlane) const
+{
+	if (IsEmpty(rect))
+		return true;
+
+	return rect.left >= 0 && rect.top >= 0 && rect.right <= m_Width && rect.bottom <= m_Height &&
+		loPlane >= 0 && loPlane <= hiPlane && hiPlane < m_Planes;
+}
+
+void HeadlessHost::FillBuffer(PlaneBuffer& buffer, const VRect& rect, int loPlane, int hiPlane)
+{
+	buffer.rect = rect;
+	buffer.loPlane = loPlane;
+	buffer.hiPlane = hiPlane;
+
+	if (IsEmpty(rect))
+	{
+		buffer.bytes.clear();
+		return;
+	}
+
+	int bytesPerSample = GetBytesPerSample();
+	int planeBytes = (hiPlane - loPlane + 1) * bytesPerSample;
+	int documentPixelBytes = m_Planes * bytesPerSample;
+	int width = rect.right - rect.left;
+	buffer.bytes.resize((size_t)width * (rect.bottom - rect.top) * planeBytes);
+
+	unsigned char* destination = &buffer.bytes[0];
+	for (int y = rect.top; y < rect.bottom; ++y)
+	{
+		const unsigned char* source = &m_Document[(((size_t)y * m_Width + rect.left) * m_Planes + loPlane) * bytesPerSample];
+		for (int x = 0; x < width; ++x)
+		{
+			memcpy(destination, source, planeBytes);
+			destination += planeBytes;
+			source += documentPixelBytes;
+		}
+	}
+}
+
+void HeadlessHost::FillMaskBuffer(const VRect& rect)
+{
+	m_MaskBuffer.rect = rect;
+	m_MaskBuffer.loPlane = m_MaskBuffer.hiPlane = 0;
+
+	// without a selection the host hands out no mask at all
+	if (IsEmpty(rect) || m_Mask.empty())
+	{
+		m_MaskBuffer.bytes.clear();
+		return;
+	}
+
+	int width = rect.right - rect.left;
+	m_MaskBuffer.bytes.resize((size_t)width * (rect.bottom - rect.top));
+	for (int y = rect.top; y < rect.bottom; ++y)
+		memcpy(&m_MaskBuffer.bytes[(size_t)(y - rect.top) * width], &m_Mask[(size_t)y * m_Width + rect.left], width);
+}
+
+void HeadlessHost::WriteBack(const PlaneBuffer& buffer)
+{
+	if (buffer.bytes.empty())
+		return;
+
+	const VRect& rect = buffer.rect;
+	int bytesPerSample = GetBytesPerSample();
+	int planeBytes = (buffer.hiPlane - buffer.loPlane + 1) * bytesPerSample;
+	int documentPixelBytes = m_Planes * bytesPerSample;
+	int width = rect.right - rect.left;
+
+	const unsigned char* source = &buffer.bytes[0];
+	for (int y = rect.top; y < rect.bottom; ++y)
+	{
+		unsigned char* destination = &m_Document[(((size_t)y * m_Width + rect.left) * m_Planes + buffer.loPlane) * bytesPerSample];
+		for (int x = 0; x < width; ++x)
+		{
+			memcpy(destination, source, planeBytes);
+			source += planeBytes;
+			destination += documentPixelBytes;
+		}
+	}
+}
+
+void HeadlessHost::WriteBackOutput()
+{
+	WriteBack(m_OutBuffer);
+	m_OutBuffer.bytes.clear();
+	m_FilterRecord.outData = NULL;
+}
+
+MACPASCAL OSErr HeadlessHost::AdvanceStateProc()
+{
+	return s_Active ? s_Active->AdvanceState() : (OSErr)paramErr;
+}
+
+MACPASCAL Boolean HeadlessHost::TestAbort()
+{
+	return false;
+}
+
+MACPASCAL void HeadlessHost::UpdateProgress(int32, int32)
+{
+}
+
+MACPASCAL OSErr HeadlessHost::ColorServices(ColorServicesInfo*)
+{
+	// no color management here; plug-ins keep their RGB values
+	return paramErr;
+}
+
+MACPASCAL Handle HeadlessHost::NewHandle(int32 size)
+{
+	HandleBlock* block = new HandleBlock;
+	block->data = new char[std::max(size, (int32)1)];
+	block->size = size;
+	memset(block->data, 0, std::max(size, (int32)1));
+	return reinterpret_cast<Handle>(block);
+}
+
+MACPASCAL void HeadlessHost::DisposeHandle(Handle h)
+{
+	if (h == NULL)
+		return;
+
+	HandleBlock* block = GetBlock(h);
+	delete[] block->data;
+	delete block;
+}
+
+MACPASCAL int32 HeadlessHost::GetHandleSize(Handle h)
+{
+	return h ? GetBlock(h)->size : 0;
+}
+
+MACPASCAL OSErr HeadlessHost::SetHandleSize(Handle h, int32 newSize)
+{
+	if (h == NULL || newSize < 0)
+		return paramErr;
+
+	HandleBlock* block = GetBlock(h);
+	char* data = new char[std::max(newSize, (int32)1)];
+	memset(data, 0, std::max(newSize, (int32)1));
+	memcpy(data, block->data, std::min(newSize, block->size));
+	delete[] block->data;
+	block->data = data;
+	block->size = newSize;
+	return noErr;
+}
+
+MACPASCAL Ptr HeadlessHost::LockHandle(Handle h, Boolean)
+{
+	return h ? GetBlock(h)->data : NULL;
+}
+
+MACPASCAL void HeadlessHost::UnlockHandle(Handle)
+{
+}
+
+MACPASCAL void HeadlessHost::RecoverSpace(int32)
+{
+}
@@ -0,0 +1,105 @@
+#ifndef __HEADLESSHOST__
+#define __HEADLESSHOST__
+#include "PIFilter.h"
+#include <vector>
+
+// Stand-in for Photoshop that drives a filter without a UI. It owns an
+// in-memory document, hands the plug-in a FilterRecord with working
+// advanceState and handleProcs, and writes outData back into the document the
+// way the host does: on the next advanceState call and after start/continue.
+class HeadlessHost
+{
+public:
+
+	typedef MACPASCAL void(*PluginEntry)(const int16 selector,
+		FilterRecordPtr filterRecord,
+		intptr_t* data,
+		int16* result);
+
+	// depth is 8, 16 or 32 bits per sample. The document starts out black
+	// with nothing selected.
+	HeadlessHost(int width, int height, int planes, int depth);
+	~HeadlessHost();
+
+	// Fills the document with a gradient per plane plus noise hashed from
+	// seed, so filters that read their input see the same image every run.
+	void FillPattern(unsigned int seed);
+
+	// Selects a feathered ellipse placed by seed. Tiles inside it, outside it
+	// and across its edge take the fully, un- and partly selected paths.
+	void SetMask(unsigned int seed);
+
+	// Runs parameters, prepare, start (plus any continue calls) and finish.
+	// Returns the first non-zero result, or noErr.
+	int16 Run(PluginEntry entry);
+
+	// Copies the document out as interleaved floats; 8-bit samples are scaled
+	// by 1/255 and 16-bit samples by 1/32768.
+	void CopyToFloat(std::vector<float>& pixels) const;
+
+	inline FilterRecord* GetFilterRecord() { return &m_FilterRecord; }
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+	inline int GetPlanes() const { return m_Planes; }
+	inline int GetDepth() const { return m_Depth; }
+
+private:
+
+	// The buffer behind inData or outData and where it came from.
+	struct PlaneBuffer
+	{
+		std::vector<unsigned char> bytes;
+		VRect rect;
+		int loPlane;
+		int hiPlane;
+	};
+
+	HeadlessHost(const HeadlessHost&);
+	HeadlessHost& operator =(const HeadlessHost&);
+
+	void InitFilterRecord();
+	int16 CallPlugin(PluginEntry entry, int16 selector);
+
+	OSErr AdvanceState();
+	VRect GetRequestedRect(const Rect& rect16, const VRect& rect32) const;
+	bool IsValidRequest(const VRect& rect, int loPlane, int hiPlane) const;
+	void FillBuffer(PlaneBuffer& buffer, const VRect& rect, int loPlane, int hiPlane);
+	void FillMaskBuffer(const VRect& rect);
+	void WriteBack(const PlaneBuffer& buffer);
+	void WriteBackOutput();
+
+	inline int GetBytesPerSample() const { return m_Depth / 8; }
+
+	static MACPASCAL OSErr AdvanceStateProc();
+	static MACPASCAL Boolean TestAbort();
+	static MACPASCAL void UpdateProgress(int32 done, int32 total);
+	static MACPASCAL OSErr ColorServices(ColorServicesInfo* info);
+
+	static MACPASCAL Handle NewHandle(int32 size);
+	static MACPASCAL void DisposeHandle(Handle h);
+	static MACPASCAL int32 GetHandleSize(Handle h);
+	static MACPASCAL OSErr SetHandleSize(Handle h, int32 newSize);
+	static MACPASCAL Ptr LockHandle(Handle h, Boolean moveHigh);
+	static MACPASCAL void UnlockHandle(Handle h);
+	static MACPASCAL void RecoverSpace(int32 size);
+
+	// the callbacks carry no context, so the host running a plug-in is global
+	static HeadlessHost* s_Active;
+
+	int m_Width;
+	int m_Height;
+	int m_Planes;
+	int m_Depth;
+	std::vector<unsigned char> m_Document;
+	std::vector<unsigned char> m_Mask;
+	PlaneBuffer m_InBuffer;
+	PlaneBuffer m_OutBuffer;
+	PlaneBuffer m_MaskBuffer;
+
+	FilterRecord m_FilterRecord;
+	BigDocumentStruct m_BigDocument;
+	HandleProcs m_HandleProcs;
+	intptr_t m_PluginData;
+};
+
+#endif
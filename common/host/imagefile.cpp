@@ -0,0 +1,332 @@
+#include "imagefile.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Little-endian byte sink that PNG and EXR are assembled in.
+	class ByteWriter
+	{
+	public:
+
+		void U8(unsigned int value) { m_Bytes.push_back((unsigned char)value); }
+		void U16(unsigned int value) { U8(value); U8(value >> 8); }
+		void U32(unsigned int value) { U16(value); U16(value >> 16); }
+		void U64(unsigned long long value) { U32((unsigned int)value); U32((unsigned int)(value >> 32)); }
+		void U32BigEndian(unsigned int value) { U8(value >> 24); U8(value >> 16); U8(value >> 8); U8(value); }
+		void F32(float value) { unsigned int bits; memcpy(&bits, &value, sizeof(bits)); U32(bits); }
+		void String(const char* text) { Bytes(text, strlen(text) + 1); }
+		void Bytes(const void* data, size_t size)
+		{
+			const unsigned char* bytes = (const unsigned char*)data;
+			m_Bytes.insert(m_Bytes.end(), bytes, bytes + size);
+		}
+
+		inline size_t Size() const { return m_Bytes.size(); }
+		inline unsigned char* At(size_t offset) { return &m_Bytes[offset]; }
+		inline const std::vector<unsigned char>& GetBytes() const { return m_Bytes; }
+
+	private:
+		std::vector<unsigned char> m_Bytes;
+	};
+
+	bool WriteFile(const char* path, const void* data, size_t size)
+	{
+		FILE* file = fopen(path, "wb");
+		if (file == NULL)
+			return false;
+
+		bool ok = fwrite(data, 1, size, file) == size;
+		return fclose(file) == 0 && ok;
+	}
+
+	unsigned int Crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+	{
+		static unsigned int table[256];
+		static bool tableReady = false;
+		if (!tableReady)
+		{
+			for (unsigned int n = 0; n < 256; ++n)
+			{
+				unsigned int c = n;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			tableReady = true;
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	unsigned int Adler32(const unsigned char* data, size_t size)
+	{
+		unsigned int a = 1;
+		unsigned int b = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void WritePNGChunk(ByteWriter& png, const char* type, const ByteWriter& data)
+	{
+		png.U32BigEndian((unsigned int)data.Size());
+		size_t start = png.Size();
+		png.Bytes(type, 4);
+		if (data.Size() > 0)
+			png.Bytes(&data.GetBytes()[0], data.Size());
+		png.U32BigEndian(Crc32(png.At(start), png.Size() - start));
+	}
+
+	inline unsigned char ToByte(float value)
+	{
+		if (!(value > 0.0f))
+			return 0;
+		if (value >= 1.0f)
+			return 255;
+		return (unsigned char)(value * 255.0f + 0.5f);
+	}
+}
+
+bool ImageFile::WritePFM(const char* path, const float* pixels, int width, int height, int channels)
+{
+	int outChannels = channels >= 3 ? 3 : 1;
+
+	char header[64];
+	int headerSize = sprintf(header, "%s\n%d %d\n-1.0\n", outChannels == 3 ? "PF" : "Pf", width, height);
+
+	// little-endian scale, rows stored bottom to top
+	ByteWriter pfm;
+	pfm.Bytes(header, headerSize);
+	for (int y = height - 1; y >= 0; --y)
+	{
+		const float* row = pixels + (size_t)y * width * channels;
+		for (int x = 0; x < width; ++x)
+			for (int c = 0; c < outChannels; ++c)
+				pfm.F32(row[x * channels + c]);
+	}
+
+	return WriteFile(path, &pfm.GetBytes()[0], pfm.Size());
+}
+
+bool ImageFile::ReadPFM(const char* path, std::vector<float>& pixels, int& width, int& height, int& channels)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	// the header's three fields end in single whitespace characters
+	char type[3] = { 0 };
+	float scale = 0.0f;
+	bool ok = fscanf(file, "%2s %d %d %f", type, &width, &height, &scale) == 4 && fgetc(file) != EOF &&
+		(strcmp(type, "PF") == 0 || strcmp(type, "Pf") == 0) && width > 0 && height > 0 && scale != 0.0f;
+	channels = type[1] == 'F' ? 3 : 1;
+
+	// a negative scale means little-endian samples; rows are stored bottom
+	// to top
+	std::vector<unsigned char> bytes;
+	if (ok)
+	{
+		size_t rowSize = (size_t)width * channels * 4;
+		bytes.resize(rowSize * height);
+		ok = fread(&bytes[0], 1, bytes.size(), file) == bytes.size();
+		pixels.resize((size_t)width * height * channels);
+		for (int y = 0; ok && y < height; ++y)
+		{
+			const unsigned char* source = &bytes[(size_t)(height - 1 - y) * rowSize];
+			for (size_t i = 0; i < (size_t)width * channels; ++i, source += 4)
+			{
+				unsigned int bits = scale < 0.0f ?
+					source[0] | source[1] << 8 | source[2] << 16 | (unsigned int)source[3] << 24 :
+					source[3] | source[2] << 8 | source[1] << 16 | (unsigned int)source[0] << 24;
+				memcpy(&pixels[(size_t)y * width * channels + i], &bits, sizeof(bits));
+			}
+		}
+	}
+
+	fclose(file);
+	return ok;
+}
+
+bool ImageFile::WritePNG(const char* path, const float* pixels, int width, int height, int channels)
+{
+	static const unsigned char colorTypes[] = { 0, 4, 2, 6 };
+	if (channels < 1 || channels > 4)
+		return false;
+
+	ByteWriter header;
+	header.U32BigEndian(width);
+	header.U32BigEndian(height);
+	header.U8(8);
+	header.U8(colorTypes[channels - 1]);
+	header.U8(0);
+	header.U8(0);
+	header.U8(0);
+
+	// filter type 0 in front of every row
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)height * (width * channels + 1));
+	for (int y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		const float* row = pixels + (size_t)y * width * channels;
+		for (int i = 0; i < width * channels; ++i)
+			raw.push_back(ToByte(row[i]));
+	}
+
+	// zlib stream of stored (uncompressed) deflate blocks
+	ByteWriter zlib;
+	zlib.U8(0x78);
+	zlib.U8(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t blockSize = raw.size() - offset;
+		if (blockSize > 65535)
+			blockSize = 65535;
+		bool last = offset + blockSize == raw.size();
+
+		zlib.U8(last ? 1 : 0);
+		zlib.U16((unsigned int)blockSize);
+		zlib.U16((unsigned int)~blockSize & 0xFFFF);
+		if (blockSize > 0)
+			zlib.Bytes(&raw[offset], blockSize);
+		offset += blockSize;
+	} while (offset < raw.size());
+	zlib.U32BigEndian(Adler32(raw.empty() ? NULL : &raw[0], raw.size()));
+
+	static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	ByteWriter png;
+	png.Bytes(signature, sizeof(signature));
+	WritePNGChunk(png, "IHDR", header);
+	WritePNGChunk(png, "IDAT", zlib);
+	WritePNGChunk(png, "IEND", ByteWriter());
+
+	return WriteFile(path, &png.GetBytes()[0], png.Size());
+}
+
+bool ImageFile::WriteEXR(const char* path, const float* pixels, int width, int height, int channels)
+{
+	static const char* channelNames[4][4] =
+	{
+		{ "Y" },
+		{ "Y", "A" },
+		{ "R", "G", "B" },
+		{ "R", "G", "B", "A" },
+	};
+	if (channels < 1 || channels > 4)
+		return false;
+
+	// EXR stores channels sorted by name
+	std::vector<int> order;
+	for (int c = 0; c < channels; ++c)
+		order.push_back(c);
+	for (size_t i = 1; i < order.size(); ++i)
+		for (size_t j = i; j > 0 && strcmp(channelNames[channels - 1][order[j]], channelNames[channels - 1][order[j - 1]]) < 0; --j)
+			std::swap(order[j], order[j - 1]);
+
+	ByteWriter exr;
+	exr.U32(20000630);
+	exr.U32(2);
+
+	exr.String("channels");
+	exr.String("chlist");
+	exr.U32(channels * 18 + 1);
+	for (int i = 0; i < channels; ++i)
+	{
+		exr.String(channelNames[channels - 1][order[i]]);
+		exr.U32(2);		// FLOAT
+		exr.U32(0);		// pLinear and reserved
+		exr.U32(1);		// xSampling
+		exr.U32(1);		// ySampling
+	}
+	exr.U8(0);
+
+	exr.String("compression");
+	exr.String("compression");
+	exr.U32(1);
+	exr.U8(0);		// NO_COMPRESSION
+
+	const char* windows[] = { "dataWindow", "displayWindow" };
+	for (int i = 0; i < 2; ++i)
+	{
+		exr.String(windows[i]);
+		exr.String("box2i");
+		exr.U32(16);
+		exr.U32(0);
+		exr.U32(0);
+		exr.U32(width - 1);
+		exr.U32(height - 1);
+	}
+
+	exr.String("lineOrder");
+	exr.String("lineOrder");
+	exr.U32(1);
+	exr.U8(0);		// INCREASING_Y
+
+	exr.String("pixelAspectRatio");
+	exr.String("float");
+	exr.U32(4);
+	exr.F32(1.0f);
+
+	exr.String("screenWindowCenter");
+	exr.String("v2f");
+	exr.U32(8);
+	exr.F32(0.0f);
+	exr.F32(0.0f);
+
+	exr.String("screenWindowWidth");
+	exr.String("float");
+	exr.U32(4);
+	exr.F32(1.0f);
+	exr.U8(0);
+
+	// one scanline per block without compression
+	unsigned int lineBytes = width * channels * sizeof(float);
+	unsigned long long blockOffset = exr.Size() + (unsigned long long)height * 8;
+	for (int y = 0; y < height; ++y)
+	{
+		exr.U64(blockOffset);
+		blockOffset += 8 + lineBytes;
+	}
+
+	for (int y = 0; y < height; ++y)
+	{
+		exr.U32(y);
+		exr.U32(lineBytes);
+		const float* row = pixels + (size_t)y * width * channels;
+		for (int i = 0; i < channels; ++i)
+			for (int x = 0; x < width; ++x)
+				exr.F32(row[x * channels + order[i]]);
+	}
+
+	return WriteFile(path, &exr.GetBytes()[0], exr.Size());
+}
+
+bool ImageFile::Write(const char* path, const float* pixels, int width, int height, int channels)
+{
+	std::string extension(path);
+	size_t dot = extension.rfind('.');
+	extension = dot == std::string::npos ? "" : extension.substr(dot + 1);
+	for (size_t i = 0; i < extension.size(); ++i)
+		extension[i] = (char)tolower(extension[i]);
+
+	if (extension == "png")
+		return WritePNG(path, pixels, width, height, channels);
+	if (extension == "exr")
+		return WriteEXR(path, pixels, width, height, channels);
+	if (extension == "pfm")
+		return WritePFM(path, pixels, width, height, channels);
+
+	return false;
+}
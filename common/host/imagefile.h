@@ -0,0 +1,22 @@
+#ifndef __IMAGEFILE__
+#define __IMAGEFILE__
+#include <vector>
+
+// Writers for interleaved float images with 1 to 4 channels. PFM and EXR keep
+// the full float range; PNG clamps to [0, 1] and stores 8 bits per channel.
+// PFM has no alpha, so a fourth channel is dropped there.
+namespace ImageFile
+{
+	bool WritePFM(const char* path, const float* pixels, int width, int height, int channels);
+	bool WritePNG(const char* path, const float* pixels, int width, int height, int channels);
+	bool WriteEXR(const char* path, const float* pixels, int width, int height, int channels);
+
+	// Picks the writer from the file extension (.pfm, .png or .exr).
+	bool Write(const char* path, const float* pixels, int width, int height, int channels);
+
+	// Reads a PFM file, e.g. a reference image, into interleaved rows from
+	// top to bottom; channels receives 3 or 1.
+	bool ReadPFM(const char* path, std::vector<float>& pixels, int& width, int& height, int& channels);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __BLOOMGRAPH__
+#define __BLOOMGRAPH__
+#include <stdlib.h>
+#include <algorithm>
+#include "renderer/passgraph.h"
+
+// A bloom built as a PassGraph: the bright parts of the input are blurred
+// with a separable tent filter and added back on top of it.
+//
+//	source -> threshold -> blur x -> blur y -> composite (+ source)
+
+const int BloomRadius = 6;
+const float BloomThreshold = 0.6f;
+
+inline void bloomThreshold(const PassGraph::Row& row, const float* const* inputs, float* output)
+{
+	const float* input = inputs[0];
+	for (int i = 0; i < row.count * PassGraph::Channels; i += PassGraph::Channels)
+	{
+		for (int c = 0; c < 3; ++c)
+			output[i + c] = std::max(input[i + c] - BloomThreshold, 0.0f) * (1.0f / (1.0f - BloomThreshold));
+		output[i + 3] = 0.0f;
+	}
+}
+
+// Tent weights (r + 1 - |d|) / (r + 1)^2 sum to 1.
+template <int dx, int dy>
+inline void bloomBlur(const PassGraph::Row& row, const PassGraph::View* inputs, float* output)
+{
+	const float norm = 1.0f / ((BloomRadius + 1) * (BloomRadius + 1));
+	for (int i = 0; i < row.count; ++i)
+	{
+		float sum[PassGraph::Channels] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int d = -BloomRadius; d <= BloomRadius; ++d)
+		{
+			const float* tap = inputs[0].At(row.x0 + i + d * dx, row.y + d * dy);
+			float weight = (BloomRadius + 1 - std::abs(d)) * norm;
+			for (int c = 0; c < PassGraph::Channels; ++c)
+				sum[c] += tap[c] * weight;
+		}
+		for (int c = 0; c < PassGraph::Channels; ++c)
+			output[i * PassGraph::Channels + c] = sum[c];
+	}
+}
+
+inline void bloomComposite(const PassGraph::Row& row, const float* const* inputs, float* output)
+{
+	const float* source = inputs[0];
+	const float* glow = inputs[1];
+	for (int i = 0; i < row.count * PassGraph::Channels; i += PassGraph::Channels)
+	{
+		for (int c = 0; c < 3; ++c)
+			output[i + c] = std::min(source[i + c] + glow[i + c], 1.0f);
+		output[i + 3] = source[i + 3];
+	}
+}
+
+inline void BuildBloomGraph(PassGraph& graph)
+{
+	int source = graph.AddSource();
+	int bright = graph.AddPoint(bloomThreshold, { source });
+	int blurX = graph.AddStencil(bloomBlur<1, 0>, BloomRadius, { bright });
+	int blurY = graph.AddStencil(bloomBlur<0, 1>, BloomRadius, { blurX });
+	graph.AddPoint(bloomComposite, { source, blurY });
+	graph.Compile();
+}
+
+#endif
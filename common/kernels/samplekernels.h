@@ -0,0 +1,115 @@
+#ifndef __SAMPLEKERNELS__
+#define __SAMPLEKERNELS__
+#include <math.h>
+#include <algorithm>
+#include "renderer/renderer.h"
+#include "renderer/tilecache.h"
+#include "math/CommonMath.h"
+#include "math/vec2.h"
+#include "math/vec2x8.h"
+#include "math/fastmath.h"
+#include "color/color.h"
+#include "color/colorx8.h"
+
+// The filter's sample shader in each of the Renderer's kernel signatures.
+
+inline float kernelIntensity(const unsigned int& x,
+	const unsigned int& y,
+	const unsigned int& width,
+	const unsigned int& height,
+	const float& aspectRatio)
+{
+	Vec2 uv = Vec2(float(x) / width, float(y) / height) * 2.0f - 1.0f;
+	uv.X() *= aspectRatio;
+
+	float t = float(pow(abs(1.0f / (((uv.X() * 300.0) + sin(uv.Y() * 5.0f)*50.0f))), 0.75f));
+	return clamp01(t);
+}
+
+inline void kernel(const unsigned int& x,
+	const unsigned int& y,
+	const unsigned int& width,
+	const unsigned int& height,
+	Color& outputColor)
+{
+	float aspectRatio = (float)width / height;
+	float t = kernelIntensity(x, y, width, height, aspectRatio);
+	outputColor.SetValues(t * 2.0f, t * 4.0f, t * 8.0f, 1.0f);
+	Color::Clamp(outputColor, 0.0f, 1.0f);
+}
+
+// Span version of kernel; writes straight into the render target.
+inline void kernelSpan(const Renderer::Span& span)
+{
+	float aspectRatio = (float)span.width / span.height;
+	int channels = std::min(span.channels, 4);
+	float* output = span.output;
+
+	for (unsigned int x = span.x0; x < span.x1; ++x)
+	{
+		float t = kernelIntensity(x, span.y, span.width, span.height, aspectRatio);
+		float values[4] = { clamp01(t * 2.0f), clamp01(t * 4.0f), clamp01(t * 8.0f), 1.0f };
+
+		for (int c = 0; c < channels; ++c)
+			output[c * span.planeStride] = values[c];
+		output += span.stride;
+	}
+}
+
+// Packet version of kernel; evaluates eight pixels per call with the
+// FastMath approximations instead of double precision libm.
+template <FastMath::Accuracy accuracy>
+inline void kernelPacket(const Floatx8& x,
+	const Floatx8& y,
+	const unsigned int& width,
+	const unsigned int& height,
+	Colorx8& outputColor)
+{
+	Floatx8 aspectRatio = (float)width / height;
+	Vec2x8 uv = Vec2x8(x / Floatx8((float)width), y / Floatx8((float)height)) * 2.0f - 1.0f;
+	uv.X() *= aspectRatio;
+
+	Floatx8 denominator = (uv.X() * 300.0f) + FastMath::Sin<accuracy>(uv.Y() * 5.0f) * 50.0f;
+	Floatx8 t = FastMath::Pow<accuracy>(Abs(Floatx8(1.0f) / denominator), Floatx8(0.75f));
+	t = Clamp(t, 0.0f, 1.0f);
+
+	outputColor.SetValues(t * 2.0f, t * 4.0f, t * 8.0f, 1.0f);
+	Colorx8::Clamp(outputColor, 0.0f, 1.0f);
+}
+
+// Furthest any pixel kernelSoftFocus reads lies from the pixel it shades.
+const int SoftFocusRadius = 4;
+
+// Filters the input: mixes each pixel with the average of eight bilinear
+// taps on a circle around it, a cheap glow. (x, y) is a pixel of source and
+// the taps' UVs are normalized by the source's size, not the rendered
+// image's: the two differ when the filter rect ends short of the document.
+inline void kernelSoftFocus(const unsigned int& x,
+	const unsigned int& y,
+	const unsigned int&,
+	const unsigned int&,
+	const TileCache& source,
+	Color& outputColor)
+{
+	const float radius = 3.0f;
+	float u = (x + 0.5f) / source.GetWidth();
+	float v = (y + 0.5f) / source.GetHeight();
+	float du = radius / source.GetWidth();
+	float dv = radius / source.GetHeight();
+
+	float blur[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 8; ++i)
+	{
+		float angle = i * (2.0f * 3.14159265f / 8.0f);
+		Color tap = source.SampleBilinear(u + cosf(angle) * du, v + sinf(angle) * dv);
+		for (int c = 0; c < 4; ++c)
+			blur[c] += tap.GetValues()[c] * (1.0f / 8.0f);
+	}
+
+	Color center = source.Sample(x, y);
+	Color glow = Color::Lerp(center, Color(blur[0], blur[1], blur[2], blur[3]), 0.6f);
+	outputColor.SetValues(glow.GetValues()[0], glow.GetValues()[1], glow.GetValues()[2], glow.GetValues()[3]);
+	Color::Clamp(outputColor, 0.0f, 1.0f);
+}
+
+#endif
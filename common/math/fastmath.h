@@ -0,0 +1,340 @@
+#ifndef __FASTMATH__
+#define __FASTMATH__
+#include <memory.h>
+#include <math.h>
+#include "floatx8.h"
+
+// Single precision Sin, Cos, Exp, Log, Pow and Atan2 for float and Floatx8.
+// Every function takes an accuracy tier as its template argument:
+//
+//   Exact    libm's float functions, lane by lane for Floatx8.
+//   Precise  polynomial approximations: Log within 1 ulp, Exp within
+//            1.5 ulp, Atan2 within 3 ulp, Sin and Cos within 1.2e-7
+//            absolute for |x| < 8192, and Pow within 2.5 ulp while the
+//            result is a normal float; y * log(x) is carried in extra
+//            precision.
+//   Fast     low order polynomials, error below 1e-4: relative for Exp
+//            and Pow, absolute for Log, Sin, Cos and Atan2.
+//
+// linux/fastmath_accuracy measures every tier against these bounds.
+//
+// Denormal inputs to Log and Pow are treated as zero. Exp flushes results
+// below FLT_MIN to zero and saturates just below FLT_MAX instead of
+// returning infinity. Pow is only defined for x >= 0; use Pow(Abs(x), y)
+// the way the kernels do.
+
+namespace FastMath
+{
+	enum Accuracy
+	{
+		Exact,
+		Precise,
+		Fast
+	};
+
+	namespace detail
+	{
+		// Scalar versions of the Floatx8 helpers, so that each function
+		// below is written once for both types.
+		inline float Select(bool mask, float ifTrue, float ifFalse) { return mask ? ifTrue : ifFalse; }
+		inline float Min(float lhs, float rhs) { return lhs < rhs ? lhs : rhs; }
+		inline float Max(float lhs, float rhs) { return lhs > rhs ? lhs : rhs; }
+		inline float Abs(float value) { return fabsf(value); }
+
+		inline unsigned int Bits(float value) { unsigned int u; memcpy(&u, &value, sizeof(u)); return u; }
+		inline float FromBits(unsigned int bits) { float t; memcpy(&t, &bits, sizeof(t)); return t; }
+		inline float Pow2i(float n) { return FromBits((unsigned int)((int)n + 127) << 23); }
+		inline float BiasedExponent(float value) { return (float)(Bits(value) >> 23); }
+		inline float MaskBits(float value, unsigned int mask) { return FromBits(Bits(value) & mask); }
+		inline float SetBits(float value, unsigned int bits) { return FromBits(Bits(value) | bits); }
+		inline float XorBits(float lhs, float rhs) { return FromBits(Bits(lhs) ^ Bits(rhs)); }
+
+		inline Floatx8 MaskBits(const Floatx8& value, unsigned int mask) { return value & Floatx8::FromBits(mask); }
+		inline Floatx8 SetBits(const Floatx8& value, unsigned int bits) { return value | Floatx8::FromBits(bits); }
+		inline Floatx8 XorBits(const Floatx8& lhs, const Floatx8& rhs) { return lhs ^ rhs; }
+
+		inline float Lanewise(float x, float(*func)(float)) { return func(x); }
+		inline float Lanewise(float x, float y, float(*func)(float, float)) { return func(x, y); }
+
+		inline Floatx8 Lanewise(const Floatx8& x, float(*func)(float))
+		{
+			FLOATX8_ALIGN(32) float lanes[Floatx8::Width];
+			x.Store(lanes);
+			for (int i = 0; i < Floatx8::Width; ++i)
+				lanes[i] = func(lanes[i]);
+			return Floatx8::Load(lanes);
+		}
+
+		inline Floatx8 Lanewise(const Floatx8& x, const Floatx8& y, float(*func)(float, float))
+		{
+			FLOATX8_ALIGN(32) float xLanes[Floatx8::Width];
+			FLOATX8_ALIGN(32) float yLanes[Floatx8::Width];
+			x.Store(xLanes);
+			y.Store(yLanes);
+			for (int i = 0; i < Floatx8::Width; ++i)
+				xLanes[i] = func(xLanes[i], yLanes[i]);
+			return Floatx8::Load(xLanes);
+		}
+
+		// Round to nearest for |x| < 2^22; relies on the default rounding mode.
+		template <class T> inline T Round(const T& x)
+		{
+			const T magic(12582912.0f);
+			return (x + magic) - magic;
+		}
+
+		template <class T> inline T Floor(const T& x)
+		{
+			T rounded = Round(x);
+			return rounded - Select(rounded > x, T(1.0f), T(0.0f));
+		}
+
+		// sin(x) when quadrantOffset is 0, cos(x) when it is 1.
+		template <Accuracy accuracy, class T> inline T SinCos(const T& x, float quadrantOffset)
+		{
+			// x = j*pi/2 + r with |r| <= pi/4; pi/2 is split in three so
+			// j*pi/2 stays exact for the first two parts
+			T j = Round(x * T(0.636619772f));
+			T r = x - j * T(1.5703125f);
+			r = r - j * T(4.837512969970703125e-4f);
+			r = r - j * T(7.54978995489188216e-8f);
+			T z = r * r;
+
+			T sinR;
+			T cosR;
+			if (accuracy == Fast)
+			{
+				sinR = r + r * z * (T(-0.166628331f) + z * T(0.00815297927f));
+				cosR = T(1.0f) + z * (T(-0.499776271f) + z * T(0.0404888675f));
+			}
+			else
+			{
+				sinR = r + r * z * (T(-1.6666654611e-1f) + z * (T(8.3321608736e-3f) + z * T(-1.9515295891e-4f)));
+				cosR = T(1.0f) - T(0.5f) * z + z * z * (T(4.166664568298827e-2f) + z * (T(-1.388731625493765e-3f) + z * T(2.443315711809948e-5f)));
+			}
+
+			// quadrant 0..3 picks between +-sin(r) and +-cos(r)
+			T quadrant = j + T(quadrantOffset);
+			quadrant = quadrant - T(4.0f) * Floor(quadrant * T(0.25f));
+			T half = quadrant * T(0.5f);
+			T odd = half - Floor(half);
+
+			T result = Select(odd > T(0.25f), cosR, sinR);
+			return Select(quadrant > T(1.5f), -result, result);
+		}
+
+		// e^(value + low), low a correction far below value's last bit that
+		// Pow passes in.
+		template <Accuracy accuracy, class T> inline T ExpApprox(const T& value, const T& low)
+		{
+			// e^x = 2^n * e^r with |r| <= ln(2)/2; ln(2) is split in two
+			T x = Min(Max(value, T(-87.3f)), T(88.7f));
+			T n = Round(x * T(1.44269504089f));
+			T r = x - n * T(0.693359375f);
+			r = r - n * T(-2.12194440e-4f);
+			r = r + low;
+
+			// 1 is added last, so only the final sum rounds at its scale
+			T p;
+			if (accuracy == Fast)
+			{
+				p = T(1.0f) + r + r * r * (T(0.500051127f) + r * (T(0.167535198f) + r * T(0.0412780991f)));
+			}
+			else
+			{
+				p = T(1.0f) + (r + r * r * (T(5.0000001201e-1f) + r * (T(1.6666665459e-1f) + r * (T(4.1665795894e-2f) +
+					r * (T(8.3334519073e-3f) + r * (T(1.3981999507e-3f) + r * T(1.9875691500e-4f)))))));
+			}
+
+			// n can reach 128, one past the largest exponent Pow2i can build
+			T nHalf = Floor(n * T(0.5f));
+			T result = p * Pow2i(nHalf) * Pow2i(n - nHalf);
+			return Select(value < T(-87.3f), T(0.0f), result);
+		}
+
+		// x = 2^e * (1 + m) with sqrt(1/2) <= 1 + m < sqrt(2), for normal x > 0.
+		template <class T> inline void LogReduce(const T& x, T& e, T& m)
+		{
+			e = BiasedExponent(x) - T(126.0f);
+			m = SetBits(MaskBits(x, 0x007FFFFFu), 0x3F000000u);
+			auto small = m < T(0.707106781f);
+			e = e - Select(small, T(1.0f), T(0.0f));
+			m = m + Select(small, m, T(0.0f)) - T(1.0f);
+		}
+
+		// log(x) - m - e*0.693359375 for the e and m LogReduce gives.
+		template <Accuracy accuracy, class T> inline T LogTail(const T& e, const T& m)
+		{
+			T z = m * m;
+			T y;
+			if (accuracy == Fast)
+			{
+				y = z * (T(-0.49933257f) + m * (T(0.335874959f) + m * (T(-0.272255749f) + m * T(0.179666724f))));
+				y = y + e * T(-2.12194440e-4f);
+			}
+			else
+			{
+				T p = T(7.0376836292e-2f);
+				p = p * m + T(-1.1514610310e-1f);
+				p = p * m + T(1.1676998740e-1f);
+				p = p * m + T(-1.2420140846e-1f);
+				p = p * m + T(1.4249322787e-1f);
+				p = p * m + T(-1.6668057665e-1f);
+				p = p * m + T(2.0000714765e-1f);
+				p = p * m + T(-2.4999993993e-1f);
+				p = p * m + T(3.3333331174e-1f);
+				y = m * z * p;
+				y = y + e * T(-2.12194440e-4f);
+				y = y - T(0.5f) * z;
+			}
+			return y;
+		}
+
+		template <Accuracy accuracy, class T> inline T LogApprox(const T& x)
+		{
+			// log(x) = e*ln(2) + log(1 + m)
+			T e;
+			T m;
+			LogReduce(x, e, m);
+			T result = m + LogTail<accuracy>(e, m) + e * T(0.693359375f);
+
+			const T infinity = FromBits(0x7F800000u);
+			const T nan = FromBits(0x7FC00000u);
+			result = Select(x == infinity, infinity, result);
+			result = Select(x < T(1.17549435e-38f), -infinity, result);
+			result = Select(x < T(0.0f), nan, result);
+			return Select(x == x, result, nan);
+		}
+
+		// sum + error == a + b exactly. No products, so contracting to FMA
+		// cannot break it.
+		template <class T> inline void TwoSum(const T& a, const T& b, T& sum, T& error)
+		{
+			sum = a + b;
+			T b2 = sum - a;
+			error = (a - (sum - b2)) + (b - b2);
+		}
+
+		template <Accuracy accuracy, class T> inline T PowApprox(const T& x, const T& y)
+		{
+			T result;
+			if (accuracy == Fast)
+			{
+				result = ExpApprox<accuracy>(y * LogApprox<accuracy>(x), T(0.0f));
+			}
+			else
+			{
+				// Rounding y * log(x) to a float costs |y * log(x)| * 2^-24
+				// relative error in the result, so it is carried as high + low.
+				// log(x) first, as e*ln(2)'s exact leading part plus m,
+				// renormalized:
+				auto normal = (x >= T(1.17549435e-38f)) & (x < FromBits(0x7F800000u));
+				T e;
+				T m;
+				LogReduce(Select(normal, x, T(1.0f)), e, m);
+				T head;
+				T headError;
+				TwoSum(e * T(0.693359375f), m, head, headError);
+				T logHigh;
+				T logLow;
+				TwoSum(head, headError + LogTail<accuracy>(e, m), logHigh, logLow);
+
+				// then y * log(x): halves of 12 significant bits multiply
+				// exactly, the cross terms are far smaller
+				T yHead = MaskBits(y, 0xFFFFF000u);
+				T logHead = MaskBits(logHigh, 0xFFFFF000u);
+				T high;
+				T low;
+				TwoSum(yHead * logHead, yHead * ((logHigh - logHead) + logLow) + (y - yHead) * logHigh, high, low);
+
+				// 0, denormals, infinity, NaN and negative x as log(x) would
+				// give them: -inf, -inf, inf, NaN, NaN
+				const T infinity = FromBits(0x7F800000u);
+				T special = Select(x == infinity, infinity, -infinity);
+				const T nan = FromBits(0x7FC00000u);
+				special = Select(x < T(0.0f), nan, special);
+				special = Select(x == x, special, nan);
+				high = Select(normal, high, y * special);
+				low = Select(normal, low, T(0.0f));
+				result = ExpApprox<accuracy>(high, low);
+			}
+			// 0^0 would otherwise come out as exp(0 * -inf) = NaN
+			return Select(y == T(0.0f), T(1.0f), result);
+		}
+
+		template <Accuracy accuracy, class T> inline T Atan2Approx(const T& y, const T& x)
+		{
+			// atan of t = min/max(|x|, |y|) in [0, 1], then unfold by octant
+			T absX = Abs(x);
+			T absY = Abs(y);
+			auto swap = absY > absX;
+			T numerator = Select(swap, absX, absY);
+			T denominator = Select(swap, absY, absX);
+			T t = Select(denominator == T(0.0f), T(0.0f), numerator / denominator);
+
+			// atan(t) = pi/4 + atan((t - 1)/(t + 1)) moves t below tan(pi/8)
+			auto upper = t > T(0.414213562f);
+			t = Select(upper, (t - T(1.0f)) / (t + T(1.0f)), t);
+			T z = t * t;
+
+			T angle;
+			if (accuracy == Fast)
+				angle = t + t * z * (T(-0.331567848f) + z * T(0.168563853f));
+			else
+				angle = t + t * z * (((T(8.05374449538e-2f) * z - T(1.38776856032e-1f)) * z + T(1.99777106478e-1f)) * z - T(3.33329491539e-1f));
+			// pi/4, pi/2 and pi as a float plus that float's error, so the
+			// constants add no rounding error of their own
+			angle = (angle + Select(upper, T(-2.18556949e-8f), T(0.0f))) + Select(upper, T(0.785398185f), T(0.0f));
+
+			angle = Select(swap, T(1.57079637f) - (angle - T(-4.37113900e-8f)), angle);
+			angle = Select(x < T(0.0f), T(3.14159274f) - (angle - T(-8.74227766e-8f)), angle);
+			return XorBits(angle, MaskBits(y, 0x80000000u));
+		}
+	}
+
+	template <Accuracy accuracy, class T> inline T Sin(const T& x)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(x, ::sinf);
+		return detail::SinCos<accuracy>(x, 0.0f);
+	}
+
+	template <Accuracy accuracy, class T> inline T Cos(const T& x)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(x, ::cosf);
+		return detail::SinCos<accuracy>(x, 1.0f);
+	}
+
+	template <Accuracy accuracy, class T> inline T Exp(const T& x)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(x, ::expf);
+		return detail::ExpApprox<accuracy>(x, T(0.0f));
+	}
+
+	template <Accuracy accuracy, class T> inline T Log(const T& x)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(x, ::logf);
+		return detail::LogApprox<accuracy>(x);
+	}
+
+	// x^y for x >= 0.
+	template <Accuracy accuracy, class T> inline T Pow(const T& x, const T& y)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(x, y, ::powf);
+
+		return detail::PowApprox<accuracy>(x, y);
+	}
+
+	template <Accuracy accuracy, class T> inline T Atan2(const T& y, const T& x)
+	{
+		if (accuracy == Exact)
+			return detail::Lanewise(y, x, ::atan2f);
+		return detail::Atan2Approx<accuracy>(y, x);
+	}
+}
+
+#endif
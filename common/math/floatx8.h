@@ -0,0 +1,365 @@
+#ifndef __FLOATX8__
+#define __FLOATX8__
+#include <memory.h>
+#include <math.h>
+
+// Eight float lanes evaluated together. Uses AVX2 when the compiler targets it,
+// otherwise two SSE2 or NEON registers, otherwise plain arrays. Comparisons
+// return lane masks (all bits set or clear) that feed Select, & and |.
+
+#if defined(__AVX2__)
+	#define FLOATX8_AVX2 1
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define FLOATX8_SSE2 1
+	#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#define FLOATX8_NEON 1
+	#include <arm_neon.h>
+#else
+	#define FLOATX8_SCALAR 1
+#endif
+
+#if defined(_MSC_VER)
+	#define FLOATX8_INLINE __forceinline
+	#define FLOATX8_ALIGN(n) __declspec(align(n))
+#else
+	#define FLOATX8_INLINE inline __attribute__((always_inline))
+	#define FLOATX8_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+namespace simd4
+{
+	// Four-lane building block used to make up a Floatx8 when AVX2 is not
+	// available.
+#if defined(FLOATX8_SSE2)
+	typedef __m128 f4;
+
+	FLOATX8_INLINE f4 set1(float t) { return _mm_set1_ps(t); }
+	FLOATX8_INLINE f4 load(const float* p) { return _mm_loadu_ps(p); }
+	FLOATX8_INLINE void store(float* p, f4 a) { _mm_storeu_ps(p, a); }
+	FLOATX8_INLINE f4 add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+	FLOATX8_INLINE f4 sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+	FLOATX8_INLINE f4 mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+	FLOATX8_INLINE f4 div(f4 a, f4 b) { return _mm_div_ps(a, b); }
+	FLOATX8_INLINE f4 min(f4 a, f4 b) { return _mm_min_ps(a, b); }
+	FLOATX8_INLINE f4 max(f4 a, f4 b) { return _mm_max_ps(a, b); }
+	FLOATX8_INLINE f4 sqrt(f4 a) { return _mm_sqrt_ps(a); }
+	FLOATX8_INLINE f4 bitAnd(f4 a, f4 b) { return _mm_and_ps(a, b); }
+	FLOATX8_INLINE f4 bitOr(f4 a, f4 b) { return _mm_or_ps(a, b); }
+	FLOATX8_INLINE f4 bitXor(f4 a, f4 b) { return _mm_xor_ps(a, b); }
+	FLOATX8_INLINE f4 bitAndNot(f4 a, f4 b) { return _mm_andnot_ps(a, b); }
+	FLOATX8_INLINE f4 cmpLt(f4 a, f4 b) { return _mm_cmplt_ps(a, b); }
+	FLOATX8_INLINE f4 cmpLe(f4 a, f4 b) { return _mm_cmple_ps(a, b); }
+	FLOATX8_INLINE f4 cmpEq(f4 a, f4 b) { return _mm_cmpeq_ps(a, b); }
+	FLOATX8_INLINE int moveMask(f4 a) { return _mm_movemask_ps(a); }
+	FLOATX8_INLINE f4 pow2i(f4 n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+	FLOATX8_INLINE f4 biasedExponent(f4 a) { return _mm_cvtepi32_ps(_mm_srli_epi32(_mm_castps_si128(a), 23)); }
+	FLOATX8_INLINE void storeU16(unsigned short* p, f4 lo, f4 hi)
+	{
+		// SSE2 only has a signed 32 to 16 bit pack, so shift into its range and back
+		__m128i bias = _mm_set1_epi32(32768);
+		__m128i words = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(lo), bias), _mm_sub_epi32(_mm_cvttps_epi32(hi), bias));
+		_mm_storeu_si128((__m128i*)p, _mm_xor_si128(words, _mm_set1_epi16((short)0x8000)));
+	}
+	FLOATX8_INLINE void storeU8(unsigned char* p, f4 lo, f4 hi)
+	{
+		__m128i words = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+		_mm_storel_epi64((__m128i*)p, _mm_packus_epi16(words, words));
+	}
+#elif defined(FLOATX8_NEON)
+	typedef float32x4_t f4;
+
+	FLOATX8_INLINE f4 set1(float t) { return vdupq_n_f32(t); }
+	FLOATX8_INLINE f4 load(const float* p) { return vld1q_f32(p); }
+	FLOATX8_INLINE void store(float* p, f4 a) { vst1q_f32(p, a); }
+	FLOATX8_INLINE f4 add(f4 a, f4 b) { return vaddq_f32(a, b); }
+	FLOATX8_INLINE f4 sub(f4 a, f4 b) { return vsubq_f32(a, b); }
+	FLOATX8_INLINE f4 mul(f4 a, f4 b) { return vmulq_f32(a, b); }
+	FLOATX8_INLINE f4 div(f4 a, f4 b) { return vdivq_f32(a, b); }
+	FLOATX8_INLINE f4 min(f4 a, f4 b) { return vminq_f32(a, b); }
+	FLOATX8_INLINE f4 max(f4 a, f4 b) { return vmaxq_f32(a, b); }
+	FLOATX8_INLINE f4 sqrt(f4 a) { return vsqrtq_f32(a); }
+	FLOATX8_INLINE f4 bitAnd(f4 a, f4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+	FLOATX8_INLINE f4 bitOr(f4 a, f4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+	FLOATX8_INLINE f4 bitXor(f4 a, f4 b) { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+	FLOATX8_INLINE f4 bitAndNot(f4 a, f4 b) { return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(b), vreinterpretq_u32_f32(a))); }
+	FLOATX8_INLINE f4 cmpLt(f4 a, f4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+	FLOATX8_INLINE f4 cmpLe(f4 a, f4 b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+	FLOATX8_INLINE f4 cmpEq(f4 a, f4 b) { return vreinterpretq_f32_u32(vceqq_f32(a, b)); }
+	FLOATX8_INLINE int moveMask(f4 a)
+	{
+		uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(a), 31);
+		return (int)(vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) |
+			(vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3));
+	}
+	FLOATX8_INLINE f4 pow2i(f4 n) { return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtnq_s32_f32(n), vdupq_n_s32(127)), 23)); }
+	FLOATX8_INLINE f4 biasedExponent(f4 a) { return vcvtq_f32_u32(vshrq_n_u32(vreinterpretq_u32_f32(a), 23)); }
+	FLOATX8_INLINE uint16x8_t toU16(f4 lo, f4 hi) { return vcombine_u16(vmovn_u32(vcvtq_u32_f32(lo)), vmovn_u32(vcvtq_u32_f32(hi))); }
+	FLOATX8_INLINE void storeU16(unsigned short* p, f4 lo, f4 hi) { vst1q_u16(p, toU16(lo, hi)); }
+	FLOATX8_INLINE void storeU8(unsigned char* p, f4 lo, f4 hi) { vst1_u8(p, vmovn_u16(toU16(lo, hi))); }
+#elif defined(FLOATX8_SCALAR)
+	struct f4 { float v[4]; };
+
+	FLOATX8_INLINE unsigned int bits(float t) { unsigned int u; memcpy(&u, &t, sizeof(u)); return u; }
+	FLOATX8_INLINE float fromBits(unsigned int u) { float t; memcpy(&t, &u, sizeof(t)); return t; }
+	FLOATX8_INLINE float mask(bool b) { return fromBits(b ? 0xFFFFFFFFu : 0u); }
+
+	FLOATX8_INLINE f4 set1(float t) { f4 r = { { t, t, t, t } }; return r; }
+	FLOATX8_INLINE f4 load(const float* p) { f4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	FLOATX8_INLINE void store(float* p, f4 a) { memcpy(p, a.v, sizeof(a.v)); }
+	#define SIMD4_LANEWISE(name, expr) \
+		FLOATX8_INLINE f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r; }
+	SIMD4_LANEWISE(add, a.v[i] + b.v[i])
+	SIMD4_LANEWISE(sub, a.v[i] - b.v[i])
+	SIMD4_LANEWISE(mul, a.v[i] * b.v[i])
+	SIMD4_LANEWISE(div, a.v[i] / b.v[i])
+	SIMD4_LANEWISE(min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+	SIMD4_LANEWISE(max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+	SIMD4_LANEWISE(bitAnd, fromBits(bits(a.v[i]) & bits(b.v[i])))
+	SIMD4_LANEWISE(bitOr, fromBits(bits(a.v[i]) | bits(b.v[i])))
+	SIMD4_LANEWISE(bitXor, fromBits(bits(a.v[i]) ^ bits(b.v[i])))
+	SIMD4_LANEWISE(bitAndNot, fromBits(~bits(a.v[i]) & bits(b.v[i])))
+	SIMD4_LANEWISE(cmpLt, mask(a.v[i] < b.v[i]))
+	SIMD4_LANEWISE(cmpLe, mask(a.v[i] <= b.v[i]))
+	SIMD4_LANEWISE(cmpEq, mask(a.v[i] == b.v[i]))
+	#undef SIMD4_LANEWISE
+	FLOATX8_INLINE f4 sqrt(f4 a) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = ::sqrtf(a.v[i]); return r; }
+	FLOATX8_INLINE int moveMask(f4 a)
+	{
+		int result = 0;
+		for (int i = 0; i < 4; ++i)
+			result |= (int)(bits(a.v[i]) >> 31) << i;
+		return result;
+	}
+	FLOATX8_INLINE f4 pow2i(f4 n) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = fromBits((unsigned int)((int)n.v[i] + 127) << 23); return r; }
+	FLOATX8_INLINE f4 biasedExponent(f4 a) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = (float)(bits(a.v[i]) >> 23); return r; }
+	FLOATX8_INLINE void storeU16(unsigned short* p, f4 lo, f4 hi)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			p[i] = (unsigned short)lo.v[i];
+			p[i + 4] = (unsigned short)hi.v[i];
+		}
+	}
+	FLOATX8_INLINE void storeU8(unsigned char* p, f4 lo, f4 hi)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			p[i] = (unsigned char)lo.v[i];
+			p[i + 4] = (unsigned char)hi.v[i];
+		}
+	}
+#endif
+}
+
+class Floatx8
+{
+public:
+
+	enum { Width = 8 };
+
+	FLOATX8_INLINE Floatx8()
+	{
+		*this = Floatx8(0.0f);
+	}
+
+	FLOATX8_INLINE Floatx8(float t)
+	{
+#if defined(FLOATX8_AVX2)
+		m_V = _mm256_set1_ps(t);
+#else
+		m_Lo = m_Hi = simd4::set1(t);
+#endif
+	}
+
+	FLOATX8_INLINE Floatx8(float a0, float a1, float a2, float a3, float a4, float a5, float a6, float a7)
+	{
+		FLOATX8_ALIGN(32) float values[8] = { a0, a1, a2, a3, a4, a5, a6, a7 };
+		*this = Load(values);
+	}
+
+	// Loads eight consecutive floats; p need not be aligned.
+	static FLOATX8_INLINE Floatx8 Load(const float* p)
+	{
+#if defined(FLOATX8_AVX2)
+		return Floatx8(_mm256_loadu_ps(p));
+#else
+		return Floatx8(simd4::load(p), simd4::load(p + 4));
+#endif
+	}
+
+	FLOATX8_INLINE void Store(float* p) const
+	{
+#if defined(FLOATX8_AVX2)
+		_mm256_storeu_ps(p, m_V);
+#else
+		simd4::store(p, m_Lo);
+		simd4::store(p + 4, m_Hi);
+#endif
+	}
+
+	// Converts to integers and stores eight consecutive samples. Lanes must
+	// already lie in the target range; fractions are truncated.
+	FLOATX8_INLINE void StoreUInt16(unsigned short* p) const
+	{
+#if defined(FLOATX8_AVX2)
+		__m256i i = _mm256_cvttps_epi32(m_V);
+		_mm_storeu_si128((__m128i*)p, _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1)));
+#else
+		simd4::storeU16(p, m_Lo, m_Hi);
+#endif
+	}
+
+	FLOATX8_INLINE void StoreUInt8(unsigned char* p) const
+	{
+#if defined(FLOATX8_AVX2)
+		__m256i i = _mm256_cvttps_epi32(m_V);
+		__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+		_mm_storel_epi64((__m128i*)p, _mm_packus_epi16(words, words));
+#else
+		simd4::storeU8(p, m_Lo, m_Hi);
+#endif
+	}
+
+	// start, start + 1, ..., start + 7
+	static FLOATX8_INLINE Floatx8 Ramp(float start)
+	{
+		return Floatx8(start) + Floatx8(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	}
+
+	FLOATX8_INLINE float operator [](int lane) const
+	{
+		FLOATX8_ALIGN(32) float values[8];
+		Store(values);
+		return values[lane];
+	}
+
+#if defined(FLOATX8_AVX2)
+	#define FLOATX8_BINARY(op, avx, half) \
+		FLOATX8_INLINE friend Floatx8 op(const Floatx8& lhs, const Floatx8& rhs) { return Floatx8(avx(lhs.m_V, rhs.m_V)); }
+#else
+	#define FLOATX8_BINARY(op, avx, half) \
+		FLOATX8_INLINE friend Floatx8 op(const Floatx8& lhs, const Floatx8& rhs) { return Floatx8(half(lhs.m_Lo, rhs.m_Lo), half(lhs.m_Hi, rhs.m_Hi)); }
+#endif
+
+	FLOATX8_BINARY(operator +, _mm256_add_ps, simd4::add)
+	FLOATX8_BINARY(operator -, _mm256_sub_ps, simd4::sub)
+	FLOATX8_BINARY(operator *, _mm256_mul_ps, simd4::mul)
+	FLOATX8_BINARY(operator /, _mm256_div_ps, simd4::div)
+	FLOATX8_BINARY(operator &, _mm256_and_ps, simd4::bitAnd)
+	FLOATX8_BINARY(operator |, _mm256_or_ps, simd4::bitOr)
+	FLOATX8_BINARY(operator ^, _mm256_xor_ps, simd4::bitXor)
+	FLOATX8_BINARY(Min, _mm256_min_ps, simd4::min)
+	FLOATX8_BINARY(Max, _mm256_max_ps, simd4::max)
+	// ~lhs & rhs
+	FLOATX8_BINARY(AndNot, _mm256_andnot_ps, simd4::bitAndNot)
+#if defined(FLOATX8_AVX2)
+	FLOATX8_INLINE friend Floatx8 operator <(const Floatx8& lhs, const Floatx8& rhs) { return Floatx8(_mm256_cmp_ps(lhs.m_V, rhs.m_V, _CMP_LT_OQ)); }
+	FLOATX8_INLINE friend Floatx8 operator <=(const Floatx8& lhs, const Floatx8& rhs) { return Floatx8(_mm256_cmp_ps(lhs.m_V, rhs.m_V, _CMP_LE_OQ)); }
+	FLOATX8_INLINE friend Floatx8 operator ==(const Floatx8& lhs, const Floatx8& rhs) { return Floatx8(_mm256_cmp_ps(lhs.m_V, rhs.m_V, _CMP_EQ_OQ)); }
+#else
+	FLOATX8_BINARY(operator <, , simd4::cmpLt)
+	FLOATX8_BINARY(operator <=, , simd4::cmpLe)
+	FLOATX8_BINARY(operator ==, , simd4::cmpEq)
+#endif
+	#undef FLOATX8_BINARY
+
+	FLOATX8_INLINE friend Floatx8 operator >(const Floatx8& lhs, const Floatx8& rhs) { return rhs < lhs; }
+	FLOATX8_INLINE friend Floatx8 operator >=(const Floatx8& lhs, const Floatx8& rhs) { return rhs <= lhs; }
+
+	FLOATX8_INLINE Floatx8 operator -() const { return Floatx8(-0.0f) ^ *this; }
+
+	FLOATX8_INLINE Floatx8& operator +=(const Floatx8& rhs) { return *this = *this + rhs; }
+	FLOATX8_INLINE Floatx8& operator -=(const Floatx8& rhs) { return *this = *this - rhs; }
+	FLOATX8_INLINE Floatx8& operator *=(const Floatx8& rhs) { return *this = *this * rhs; }
+	FLOATX8_INLINE Floatx8& operator /=(const Floatx8& rhs) { return *this = *this / rhs; }
+
+	FLOATX8_INLINE friend Floatx8 Sqrt(const Floatx8& value)
+	{
+#if defined(FLOATX8_AVX2)
+		return Floatx8(_mm256_sqrt_ps(value.m_V));
+#else
+		return Floatx8(simd4::sqrt(value.m_Lo), simd4::sqrt(value.m_Hi));
+#endif
+	}
+
+	FLOATX8_INLINE friend Floatx8 Abs(const Floatx8& value) { return AndNot(Floatx8(-0.0f), value); }
+
+	FLOATX8_INLINE friend Floatx8 Clamp(const Floatx8& value, const Floatx8& minValue, const Floatx8& maxValue)
+	{
+		return Min(Max(value, minValue), maxValue);
+	}
+
+	// Picks ifTrue where mask is set and ifFalse elsewhere.
+	FLOATX8_INLINE friend Floatx8 Select(const Floatx8& mask, const Floatx8& ifTrue, const Floatx8& ifFalse)
+	{
+#if defined(FLOATX8_AVX2)
+		return Floatx8(_mm256_blendv_ps(ifFalse.m_V, ifTrue.m_V, mask.m_V));
+#else
+		return (mask & ifTrue) | AndNot(mask, ifFalse);
+#endif
+	}
+
+	// One bit per lane, taken from the lane's sign bit.
+	FLOATX8_INLINE friend int MoveMask(const Floatx8& mask)
+	{
+#if defined(FLOATX8_AVX2)
+		return _mm256_movemask_ps(mask.m_V);
+#else
+		return simd4::moveMask(mask.m_Lo) | (simd4::moveMask(mask.m_Hi) << 4);
+#endif
+	}
+
+	// 2^n for integral n in [-126, 127].
+	FLOATX8_INLINE friend Floatx8 Pow2i(const Floatx8& n)
+	{
+#if defined(FLOATX8_AVX2)
+		__m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n.m_V), _mm256_set1_epi32(127));
+		return Floatx8(_mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+#else
+		return Floatx8(simd4::pow2i(n.m_Lo), simd4::pow2i(n.m_Hi));
+#endif
+	}
+
+	// The raw exponent field of each lane, 0-255 for non-negative values.
+	FLOATX8_INLINE friend Floatx8 BiasedExponent(const Floatx8& value)
+	{
+#if defined(FLOATX8_AVX2)
+		return Floatx8(_mm256_cvtepi32_ps(_mm256_srli_epi32(_mm256_castps_si256(value.m_V), 23)));
+#else
+		return Floatx8(simd4::biasedExponent(value.m_Lo), simd4::biasedExponent(value.m_Hi));
+#endif
+	}
+
+	// Broadcasts a float given by its IEEE-754 bit pattern.
+	static FLOATX8_INLINE Floatx8 FromBits(unsigned int bits)
+	{
+		float t;
+		memcpy(&t, &bits, sizeof(t));
+		return Floatx8(t);
+	}
+
+	FLOATX8_INLINE friend bool Any(const Floatx8& mask) { return MoveMask(mask) != 0; }
+	FLOATX8_INLINE friend bool All(const Floatx8& mask) { return MoveMask(mask) == 0xFF; }
+
+#if defined(FLOATX8_AVX2)
+	explicit FLOATX8_INLINE Floatx8(__m256 v) : m_V(v) {}
+	FLOATX8_INLINE __m256 Native() const { return m_V; }
+#else
+	FLOATX8_INLINE Floatx8(simd4::f4 lo, simd4::f4 hi) : m_Lo(lo), m_Hi(hi) {}
+	FLOATX8_INLINE simd4::f4 Lo() const { return m_Lo; }
+	FLOATX8_INLINE simd4::f4 Hi() const { return m_Hi; }
+#endif
+
+private:
+
+#if defined(FLOATX8_AVX2)
+	__m256 m_V;
+#else
+	simd4::f4 m_Lo;
+	simd4::f4 m_Hi;
+#endif
+};
+
+#endif
@@ -1,5 +1,5 @@
-#ifndef __VEC3__
-#define __VEC3__
+#ifndef __VEC2__
+#define __VEC2__
 #include <memory.h>
 #include <math.h>
 
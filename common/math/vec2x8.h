@@ -0,0 +1,146 @@
+#ifndef __VEC2X8__
+#define __VEC2X8__
+#include "floatx8.h"
+#include "vec2.h"
+
+// Eight Vec2s in structure-of-arrays form; lane i of X() and Y() together
+// make up the i-th vector.
+class Vec2x8
+{
+public:
+
+	Vec2x8()
+	{
+	}
+
+	Vec2x8(const Floatx8& xVal, const Floatx8& yVal)
+		: m_X(xVal)
+		, m_Y(yVal)
+	{
+	}
+
+	// Broadcasts one vector to every lane.
+	explicit Vec2x8(Vec2 value)
+		: m_X(value.X())
+		, m_Y(value.Y())
+	{
+	}
+
+	Vec2x8 operator +(const Vec2x8& rhs) const
+	{
+		return Vec2x8(m_X + rhs.m_X, m_Y + rhs.m_Y);
+	}
+
+	Vec2x8 operator +(const Floatx8& rhs) const
+	{
+		return Vec2x8(m_X + rhs, m_Y + rhs);
+	}
+
+	Vec2x8 operator -(const Vec2x8& rhs) const
+	{
+		return Vec2x8(m_X - rhs.m_X, m_Y - rhs.m_Y);
+	}
+
+	Vec2x8 operator -(const Floatx8& rhs) const
+	{
+		return Vec2x8(m_X - rhs, m_Y - rhs);
+	}
+
+	Vec2x8 operator *(const Vec2x8& rhs) const
+	{
+		return Vec2x8(m_X * rhs.m_X, m_Y * rhs.m_Y);
+	}
+
+	Vec2x8 operator *(const Floatx8& rhs) const
+	{
+		return Vec2x8(m_X * rhs, m_Y * rhs);
+	}
+
+	Vec2x8 operator /(const Floatx8& rhs) const
+	{
+		return *this * (Floatx8(1.0f) / rhs);
+	}
+
+	Floatx8 MagnitudeSqaured() const
+	{
+		return Dot(*this, *this);
+	}
+
+	Floatx8 Magnitude() const
+	{
+		return Sqrt(MagnitudeSqaured());
+	}
+
+	Floatx8 InverseMagnitude() const
+	{
+		return Floatx8(1.0f) / Magnitude();
+	}
+
+	Floatx8 InverseMagnitudeSquared() const
+	{
+		return Floatx8(1.0f) / MagnitudeSqaured();
+	}
+
+	void Normalize()
+	{
+		*this = GetNormalized();
+	}
+
+	Vec2x8 GetNormalized() const
+	{
+		return *this * InverseMagnitude();
+	}
+
+	inline Floatx8& X()
+	{
+		return m_X;
+	}
+
+	inline Floatx8& Y()
+	{
+		return m_Y;
+	}
+
+	inline const Floatx8& X() const
+	{
+		return m_X;
+	}
+
+	inline const Floatx8& Y() const
+	{
+		return m_Y;
+	}
+
+	// Copies one lane back out as a scalar Vec2.
+	Vec2 GetLane(int lane) const
+	{
+		return Vec2(m_X[lane], m_Y[lane]);
+	}
+
+	static Floatx8 Dot(const Vec2x8& lhs, const Vec2x8& rhs)
+	{
+		return lhs.m_X * rhs.m_X + lhs.m_Y * rhs.m_Y;
+	}
+
+	static Vec2x8 Project(const Vec2x8& a, const Vec2x8& b)
+	{
+		return b * (Dot(a, b) * b.InverseMagnitudeSquared());
+	}
+
+	static Floatx8 Length(const Vec2x8& lhs, const Vec2x8& rhs)
+	{
+		return Sqrt(Dot(lhs, rhs));
+	}
+
+	static Vec2x8 Lerp(const Vec2x8& lhs, const Vec2x8& rhs, const Floatx8& t)
+	{
+		Floatx8 OneMinusT = Floatx8(1.0f) - t;
+		return lhs * OneMinusT + rhs * t;
+	}
+
+private:
+	Floatx8 m_X;
+	Floatx8 m_Y;
+};
+
+#endif
@@ -52,7 +52,7 @@ public:
 
 	}
 
-	Vec3 operator *(const float& rhs)
+	Vec3 operator *(const float& rhs) const
 	{
 		Vec3 result(values[x] * rhs,
 					values[y] * rhs,
@@ -103,7 +103,7 @@ public:
 		return 1.0f / result;
 	}
 
-	float InverseMagnitudeSquared()
+	float InverseMagnitudeSquared() const
 	{
 		float result =
 			values[x] * values[x] +
@@ -0,0 +1,142 @@
+#ifndef __VEC3X8__
+#define __VEC3X8__
+#include "floatx8.h"
+#include "vec3.h"
+
+// Eight Vec3s in structure-of-arrays form; lane i of X(), Y() and Z()
+// together make up the i-th vector.
+class Vec3x8
+{
+public:
+
+	Vec3x8()
+	{
+	}
+
+	Vec3x8(const Floatx8& xVal, const Floatx8& yVal, const Floatx8& zVal)
+		: m_X(xVal)
+		, m_Y(yVal)
+		, m_Z(zVal)
+	{
+	}
+
+	// Broadcasts one vector to every lane.
+	explicit Vec3x8(Vec3 value)
+		: m_X(value.GetValues()[0])
+		, m_Y(value.GetValues()[1])
+		, m_Z(value.GetValues()[2])
+	{
+	}
+
+	Vec3x8 operator +(const Vec3x8& rhs) const
+	{
+		return Vec3x8(m_X + rhs.m_X, m_Y + rhs.m_Y, m_Z + rhs.m_Z);
+	}
+
+	Vec3x8 operator -(const Vec3x8& rhs) const
+	{
+		return Vec3x8(m_X - rhs.m_X, m_Y - rhs.m_Y, m_Z - rhs.m_Z);
+	}
+
+	Vec3x8 operator *(const Vec3x8& rhs) const
+	{
+		return Vec3x8(m_X * rhs.m_X, m_Y * rhs.m_Y, m_Z * rhs.m_Z);
+	}
+
+	Vec3x8 operator *(const Floatx8& rhs) const
+	{
+		return Vec3x8(m_X * rhs, m_Y * rhs, m_Z * rhs);
+	}
+
+	Vec3x8 operator /(const Floatx8& rhs) const
+	{
+		return *this * (Floatx8(1.0f) / rhs);
+	}
+
+	Floatx8 MagnitudeSqaured() const
+	{
+		return Dot(*this, *this);
+	}
+
+	Floatx8 Magnitude() const
+	{
+		return Sqrt(MagnitudeSqaured());
+	}
+
+	Floatx8 InverseMagnitude() const
+	{
+		return Floatx8(1.0f) / Magnitude();
+	}
+
+	Floatx8 InverseMagnitudeSquared() const
+	{
+		return Floatx8(1.0f) / MagnitudeSqaured();
+	}
+
+	void Normalize()
+	{
+		*this = GetNormalized();
+	}
+
+	Vec3x8 GetNormalized() const
+	{
+		return *this * InverseMagnitude();
+	}
+
+	inline Floatx8& X()
+	{
+		return m_X;
+	}
+
+	inline Floatx8& Y()
+	{
+		return m_Y;
+	}
+
+	inline Floatx8& Z()
+	{
+		return m_Z;
+	}
+
+	// Copies one lane back out as a scalar Vec3.
+	Vec3 GetLane(int lane) const
+	{
+		return Vec3(m_X[lane], m_Y[lane], m_Z[lane]);
+	}
+
+	static Floatx8 Dot(const Vec3x8& lhs, const Vec3x8& rhs)
+	{
+		return lhs.m_X * rhs.m_X + lhs.m_Y * rhs.m_Y + lhs.m_Z * rhs.m_Z;
+	}
+
+	static Vec3x8 Cross(const Vec3x8& lhs, const Vec3x8& rhs)
+	{
+		// same operand order as Vec3::Cross
+		return Vec3x8(rhs.m_Y * lhs.m_Z - rhs.m_Z * lhs.m_Y,
+					  rhs.m_Z * lhs.m_X - rhs.m_X * lhs.m_Z,
+					  rhs.m_X * lhs.m_Y - rhs.m_Y * lhs.m_X);
+	}
+
+	static Vec3x8 Project(const Vec3x8& a, const Vec3x8& b)
+	{
+		return b * (Dot(a, b) * b.InverseMagnitudeSquared());
+	}
+
+	static Floatx8 Length(const Vec3x8& lhs, const Vec3x8& rhs)
+	{
+		return Sqrt(Dot(lhs, rhs));
+	}
+
+	static Vec3x8 Lerp(const Vec3x8& lhs, const Vec3x8& rhs, const Floatx8& t)
+	{
+		Floatx8 OneMinusT = Floatx8(1.0f) - t;
+		return lhs * OneMinusT + rhs * t;
+	}
+
+private:
+	Floatx8 m_X;
+	Floatx8 m_Y;
+	Floatx8 m_Z;
+};
+
+#endif
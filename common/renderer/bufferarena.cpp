@@ -0,0 +1,151 @@
+#include "bufferarena.h"
+#include <map>
+#include <mutex>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+namespace
+{
+	std::mutex s_Mutex;
+	std::multimap<size_t, void*> s_Pool;
+	size_t s_PooledBytes = 0;
+	BufferArena::HugePages s_HugePages = BufferArena::HugePagesTransparent;
+
+	// Small blocks round to 64 KB and large ones to whole huge pages, so
+	// renders of similar sizes land on the same pooled blocks.
+	size_t RoundUp(size_t size)
+	{
+		size_t granularity = size < BufferArena::HugePageSize ? 64 * 1024 : BufferArena::HugePageSize;
+		return (size + granularity - 1) / granularity * granularity;
+	}
+
+#if defined(_WIN32)
+	void* MapBlock(size_t& size, BufferArena::HugePages mode)
+	{
+		if (mode == BufferArena::HugePagesExplicit)
+		{
+			// needs SeLockMemoryPrivilege, which most accounts lack
+			size_t largePage = GetLargePageMinimum();
+			if (largePage != 0)
+			{
+				size_t largeSize = (size + largePage - 1) / largePage * largePage;
+				void* block = VirtualAlloc(NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (block != NULL)
+				{
+					size = largeSize;
+					return block;
+				}
+			}
+		}
+		return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+
+	void UnmapBlock(void* block, size_t)
+	{
+		VirtualFree(block, 0, MEM_RELEASE);
+	}
+#else
+	void* MapBlock(size_t& size, BufferArena::HugePages mode)
+	{
+		void* block = MAP_FAILED;
+	#if defined(MAP_HUGETLB)
+		if (mode == BufferArena::HugePagesExplicit && size >= BufferArena::HugePageSize)
+			block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (block != MAP_FAILED)
+			return block;
+	#endif
+		block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED)
+			return NULL;
+	#if defined(MADV_HUGEPAGE)
+		if (mode != BufferArena::HugePagesOff && size >= BufferArena::HugePageSize)
+			madvise(block, size, MADV_HUGEPAGE);
+	#endif
+		return block;
+	}
+
+	void UnmapBlock(void* block, size_t size)
+	{
+		munmap(block, size);
+	}
+#endif
+
+	// with s_Mutex held
+	void UnmapPool()
+	{
+		for (std::multimap<size_t, void*>::iterator pooled = s_Pool.begin(); pooled != s_Pool.end(); ++pooled)
+			UnmapBlock(pooled->second, pooled->first);
+		s_Pool.clear();
+		s_PooledBytes = 0;
+	}
+}
+
+void BufferArena::SetHugePages(HugePages mode)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	s_HugePages = mode;
+}
+
+BufferArena::HugePages BufferArena::GetHugePages()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	return s_HugePages;
+}
+
+void* BufferArena::Allocate(size_t size, size_t& capacity)
+{
+	size = RoundUp(size == 0 ? 1 : size);
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+
+	// the smallest pooled block that fits, unless it would waste more than
+	// it holds
+	std::multimap<size_t, void*>::iterator pooled = s_Pool.lower_bound(size);
+	if (pooled != s_Pool.end() && pooled->first / 2 <= size)
+	{
+		void* block = pooled->second;
+		capacity = pooled->first;
+		s_PooledBytes -= capacity;
+		s_Pool.erase(pooled);
+		return block;
+	}
+
+	void* block = MapBlock(size, s_HugePages);
+	if (block == NULL)
+	{
+		// give the pool back and try once more before failing
+		UnmapPool();
+		block = MapBlock(size, s_HugePages);
+		if (block == NULL)
+			return NULL;
+	}
+	capacity = size;
+	return block;
+}
+
+void BufferArena::Release(void* block, size_t capacity)
+{
+	if (block == NULL)
+		return;
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	s_Pool.insert(std::make_pair(capacity, block));
+	s_PooledBytes += capacity;
+}
+
+void BufferArena::Trim()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	UnmapPool();
+}
+
+size_t BufferArena::GetPooledBytes()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	return s_PooledBytes;
+}
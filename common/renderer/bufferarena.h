@@ -0,0 +1,44 @@
+#ifndef __BUFFERARENA__
+#define __BUFFERARENA__
+#include <stddef.h>
+
+// Process-wide pool of page-aligned blocks for render buffers. Blocks come
+// straight from the OS (mmap, VirtualAlloc) rather than the heap, so they
+// can be backed by huge pages and are not touched until their first write:
+// whichever thread writes a page first decides which NUMA node it lives on.
+// Released blocks are kept for the next allocation of a similar size until
+// Trim() hands them back to the OS.
+class BufferArena
+{
+public:
+
+	enum HugePages
+	{
+		HugePagesOff,
+		// Linux: madvise(MADV_HUGEPAGE) on blocks of at least HugePageSize.
+		HugePagesTransparent,
+		// MAP_HUGETLB / MEM_LARGE_PAGES, falling back to transparent huge
+		// pages when the system has none reserved or no privilege for them.
+		HugePagesExplicit
+	};
+
+	static const size_t PageSize = 4096;
+	static const size_t HugePageSize = 2 * 1024 * 1024;
+
+	// Applies to blocks allocated from then on. Defaults to transparent.
+	static void SetHugePages(HugePages mode);
+	static HugePages GetHugePages();
+
+	// A block of at least size bytes; capacity receives its real size, to
+	// pass back to Release. Returns null if the OS is out of memory.
+	static void* Allocate(size_t size, size_t& capacity);
+	static void Release(void* block, size_t capacity);
+
+	// Returns every pooled block to the OS.
+	static void Trim();
+
+	// Bytes held in the pool, not counting blocks in use.
+	static size_t GetPooledBytes();
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "passgraph.h"
+#include "tilecache.h"
+#include "time/profiler.h"
+#include <string.h>
+
+namespace
+{
+	inline bool IsEmpty(const Renderer::Tile& rect)
+	{
+		return rect.left >= rect.right || rect.top >= rect.bottom;
+	}
+
+	inline void Include(Renderer::Tile& rect, const Renderer::Tile& other)
+	{
+		if (IsEmpty(other))
+			return;
+		if (IsEmpty(rect))
+		{
+			rect = other;
+			return;
+		}
+		rect.left = std::min(rect.left, other.left);
+		rect.top = std::min(rect.top, other.top);
+		rect.right = std::max(rect.right, other.right);
+		rect.bottom = std::max(rect.bottom, other.bottom);
+	}
+}
+
+int PassGraphContext::Acquire(size_t size)
+{
+	int buffer = m_Free.back();
+	m_Free.pop_back();
+	if (m_Buffers[buffer].size() < size)
+		m_Buffers[buffer].resize(size);
+	return buffer;
+}
+
+PassGraph::PassGraph()
+	: m_Radius(0)
+{
+}
+
+int PassGraph::AddPoint(PointFunc func, std::initializer_list<int> inputs)
+{
+	Pass pass;
+	pass.point = func;
+	pass.stencil = 0;
+	pass.radius = 0;
+	pass.inputs = inputs;
+	pass.group = 0;
+	pass.lastUse = -1;
+	pass.stored = false;
+	m_Passes.push_back(pass);
+	return (int)m_Passes.size() - 1;
+}
+
+int PassGraph::AddStencil(StencilFunc func, int radius, std::initializer_list<int> inputs)
+{
+	Pass pass;
+	pass.point = 0;
+	pass.stencil = func;
+	pass.radius = radius;
+	pass.inputs = inputs;
+	pass.group = 0;
+	pass.lastUse = -1;
+	pass.stored = false;
+	m_Passes.push_back(pass);
+	return (int)m_Passes.size() - 1;
+}
+
+int PassGraph::AddSource()
+{
+	return AddPoint(ReadSource);
+}
+
+void PassGraph::ReadSource(const Row& row, const float* const*, float* output)
+{
+	for (int i = 0; i < row.count; ++i)
+	{
+		Color color = row.source->Sample(row.x0 + i, row.y);
+		memcpy(output + i * Channels, color.GetValues(), sizeof(float) * Channels);
+	}
+}
+
+void PassGraph::Compile()
+{
+	int passCount = (int)m_Passes.size();
+
+	m_Groups.clear();
+	for (int p = 0; p < passCount; ++p)
+	{
+		Pass& pass = m_Passes[p];
+		if (pass.stencil || m_Groups.empty() || m_Passes[m_Groups.back().last].stencil)
+		{
+			Group group;
+			group.first = group.last = p;
+			m_Groups.push_back(group);
+		}
+		m_Groups.back().last = p;
+		pass.group = (int)m_Groups.size() - 1;
+		pass.lastUse = -1;
+		pass.stored = p == passCount - 1;
+	}
+
+	for (int p = 0; p < passCount; ++p)
+	{
+		const Pass& pass = m_Passes[p];
+		for (size_t i = 0; i < pass.inputs.size(); ++i)
+		{
+			Pass& input = m_Passes[pass.inputs[i]];
+			input.lastUse = std::max(input.lastUse, pass.group);
+			input.stored = input.stored || input.group != pass.group;
+		}
+	}
+
+	// how far from the output tile each pass is read
+	std::vector<int> reach(passCount, 0);
+	m_Radius = 0;
+	for (int p = passCount - 1; p >= 0; --p)
+	{
+		const Pass& pass = m_Passes[p];
+		for (size_t i = 0; i < pass.inputs.size(); ++i)
+			reach[pass.inputs[i]] = std::max(reach[pass.inputs[i]], reach[p] + pass.radius);
+		if (pass.point == ReadSource)
+			m_Radius = std::max(m_Radius, reach[p]);
+	}
+}
+
+const float* PassGraph::Evaluate(const Renderer::Tile& tile, unsigned int width, unsigned int height,
+	const TileCache* source, PassGraphContext& context) const
+{
+	PROFILE_ZONE("PassGraph");
+
+	int passCount = (int)m_Passes.size();
+	Renderer::Tile empty = { 0, 0, 0, 0 };
+
+	// halos reach as far as there is source image to read, which goes on
+	// past the rendered image when that is part of a larger document
+	int right = source != 0 ? std::max((int)width, source->GetWidth()) : (int)width;
+	int bottom = source != 0 ? std::max((int)height, source->GetHeight()) : (int)height;
+
+	// what each pass has to cover for the tile, halos included. Fused
+	// passes all run over the union of what they cover, so a group's
+	// union is settled before its inputs are sized from it
+	std::vector<Renderer::Tile>& regions = context.m_Regions;
+	regions.assign(passCount, empty);
+	regions[passCount - 1] = tile;
+	for (int g = (int)m_Groups.size() - 1; g >= 0; --g)
+	{
+		const Group& group = m_Groups[g];
+		Renderer::Tile rect = empty;
+		for (int p = group.first; p <= group.last; ++p)
+			Include(rect, regions[p]);
+		if (IsEmpty(rect))
+			continue;
+
+		for (int p = group.first; p <= group.last; ++p)
+		{
+			const Pass& pass = m_Passes[p];
+			regions[p] = rect;
+
+			Renderer::Tile need;
+			need.left = std::max(rect.left - pass.radius, 0);
+			need.top = std::max(rect.top - pass.radius, 0);
+			need.right = std::min(rect.right + pass.radius, right);
+			need.bottom = std::min(rect.bottom + pass.radius, bottom);
+			for (size_t i = 0; i < pass.inputs.size(); ++i)
+				Include(regions[pass.inputs[i]], need);
+		}
+	}
+
+	// every pooled image is free again once the last output is replaced
+	context.m_Free.clear();
+	for (int buffer = (int)context.m_Buffers.size() - 1; buffer >= 0; --buffer)
+		context.m_Free.push_back(buffer);
+	context.m_PassBuffers.assign(passCount, -1);
+	context.m_Rows.assign(passCount, 0);
+	if ((int)context.m_RowScratch.size() < passCount)
+		context.m_RowScratch.resize(passCount);
+
+	Row row;
+	row.width = width;
+	row.height = height;
+	row.source = source;
+
+	for (size_t g = 0; g < m_Groups.size(); ++g)
+	{
+		const Group& group = m_Groups[g];
+
+		const Renderer::Tile& rect = regions[group.first];
+		if (IsEmpty(rect))
+			continue;
+
+		int rectWidth = rect.right - rect.left;
+		for (int p = group.first; p <= group.last; ++p)
+		{
+			if (m_Passes[p].stored)
+			{
+				if (context.m_Free.empty())
+				{
+					context.m_Free.push_back((int)context.m_Buffers.size());
+					context.m_Buffers.push_back(std::vector<float>());
+				}
+				context.m_PassBuffers[p] = context.Acquire((size_t)rectWidth * (rect.bottom - rect.top) * Channels);
+			}
+			else if (context.m_RowScratch[p].size() < (size_t)rectWidth * Channels)
+			{
+				context.m_RowScratch[p].resize((size_t)rectWidth * Channels);
+			}
+		}
+
+		row.x0 = rect.left;
+		row.count = rectWidth;
+		for (int y = rect.top; y < rect.bottom; ++y)
+		{
+			row.y = y;
+			for (int p = group.first; p <= group.last; ++p)
+			{
+				const Pass& pass = m_Passes[p];
+				float* output = pass.stored ?
+					context.GetBuffer(context.m_PassBuffers[p]) + (size_t)(y - rect.top) * rectWidth * Channels :
+					&context.m_RowScratch[p][0];
+				context.m_Rows[p] = output;
+
+				if (pass.stencil)
+				{
+					context.m_Views.resize(pass.inputs.size());
+					for (size_t i = 0; i < pass.inputs.size(); ++i)
+					{
+						context.m_Views[i].data = context.GetBuffer(context.m_PassBuffers[pass.inputs[i]]);
+						context.m_Views[i].rect = regions[pass.inputs[i]];
+					}
+					pass.stencil(row, context.m_Views.empty() ? 0 : &context.m_Views[0], output);
+					continue;
+				}
+
+				// inputs fused into this run are read from their current
+				// row, the others from their images
+				context.m_RowInputs.resize(pass.inputs.size());
+				for (size_t i = 0; i < pass.inputs.size(); ++i)
+				{
+					int input = pass.inputs[i];
+					const Renderer::Tile& inputRect = regions[input];
+					if (m_Passes[input].group == (int)g)
+						context.m_RowInputs[i] = context.m_Rows[input];
+					else
+						context.m_RowInputs[i] = context.GetBuffer(context.m_PassBuffers[input]) +
+							((size_t)(y - inputRect.top) * (inputRect.right - inputRect.left) + (rect.left - inputRect.left)) * Channels;
+				}
+				pass.point(row, context.m_RowInputs.empty() ? 0 : &context.m_RowInputs[0], output);
+			}
+		}
+
+		// hand back images no later group reads
+		for (int p = 0; p <= group.last; ++p)
+			if (m_Passes[p].lastUse == (int)g && context.m_PassBuffers[p] >= 0 && p != passCount - 1)
+			{
+				context.Release(context.m_PassBuffers[p]);
+				context.m_PassBuffers[p] = -1;
+			}
+	}
+
+	return context.GetBuffer(context.m_PassBuffers[passCount - 1]);
+}
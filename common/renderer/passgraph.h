@@ -0,0 +1,128 @@
+#ifndef __PASSGRAPH__
+#define __PASSGRAPH__
+#include "renderer.h"
+#include <initializer_list>
+#include <vector>
+
+class PassGraphContext;
+
+// A chain of image passes the Renderer evaluates a tile at a time. Each pass
+// writes one image of Channels floats per pixel from the images of earlier
+// passes; the last pass added is the graph's output.
+//
+// Point passes read only the pixel they write and stencil passes up to
+// radius pixels around it. Consecutive point passes are fused and run over
+// a row at a time, so only passes a later pass reads from outside the
+// fused run get an image of their own. Stencil passes get their inputs
+// rendered over the tile plus a halo of their radius, clipped to the source
+// image (or the rendered image, where that is larger or there is no
+// source), where sampling clamps to the edge. Intermediate images are recycled from
+// a per-worker pool.
+class PassGraph
+{
+public:
+
+	static const int Channels = 4;
+
+	// Pixels [x0, x0 + count) of row y of an image of width x height, and
+	// the input image when the renderer has one.
+	struct Row
+	{
+		int x0;
+		int y;
+		int count;
+		unsigned int width;
+		unsigned int height;
+		const TileCache* source;
+	};
+
+	// A stencil pass's view of an input image over rect.
+	struct View
+	{
+		const float* data;
+		Renderer::Tile rect;
+
+		// Channels floats of pixel (x, y), clamped to rect.
+		inline const float* At(int x, int y) const
+		{
+			x = std::min(std::max(x, rect.left), rect.right - 1);
+			y = std::min(std::max(y, rect.top), rect.bottom - 1);
+			return data + ((size_t)(y - rect.top) * (rect.right - rect.left) + (x - rect.left)) * Channels;
+		}
+	};
+
+	// inputs[i] points at pixel row.x0 of the i-th input, output likewise.
+	typedef void(*PointFunc)(const Row& row, const float* const* inputs, float* output);
+	typedef void(*StencilFunc)(const Row& row, const View* inputs, float* output);
+
+	PassGraph();
+
+	// Each returns the new pass's index; inputs are indices of earlier
+	// passes.
+	int AddPoint(PointFunc func, std::initializer_list<int> inputs = std::initializer_list<int>());
+	int AddStencil(StencilFunc func, int radius, std::initializer_list<int> inputs);
+
+	// A point pass that reads the renderer's source image.
+	int AddSource();
+
+	// Call after the last pass is added, before rendering.
+	void Compile();
+
+	// How far outside a tile the graph reads the source image.
+	inline int GetRadius() const { return m_Radius; }
+	inline int GetPassCount() const { return (int)m_Passes.size(); }
+
+	// Evaluates the output over tile and returns it, rows of tile width,
+	// valid until the next call with the same context.
+	const float* Evaluate(const Renderer::Tile& tile, unsigned int width, unsigned int height,
+		const TileCache* source, PassGraphContext& context) const;
+
+private:
+
+	struct Pass
+	{
+		PointFunc point;
+		StencilFunc stencil;
+		int radius;
+		std::vector<int> inputs;
+		int group;			// set by Compile, like lastUse and stored
+		int lastUse;		// last group reading this pass
+		bool stored;		// has an image of its own
+	};
+
+	// Passes [first, last]: fused point passes, or a single stencil pass.
+	struct Group
+	{
+		int first;
+		int last;
+	};
+
+	static void ReadSource(const Row& row, const float* const* inputs, float* output);
+
+	std::vector<Pass> m_Passes;
+	std::vector<Group> m_Groups;
+	int m_Radius;
+};
+
+// Per-worker scratch for PassGraph::Evaluate.
+class PassGraphContext
+{
+private:
+
+	friend class PassGraph;
+
+	int Acquire(size_t size);
+	inline void Release(int buffer) { m_Free.push_back(buffer); }
+	inline float* GetBuffer(int buffer) { return &m_Buffers[buffer][0]; }
+
+	std::vector<std::vector<float> > m_Buffers;
+	std::vector<int> m_Free;
+	std::vector<int> m_PassBuffers;
+	std::vector<Renderer::Tile> m_Regions;
+	std::vector<std::vector<float> > m_RowScratch;
+	std::vector<float*> m_Rows;
+	std::vector<const float*> m_RowInputs;
+	std::vector<PassGraph::View> m_Views;
+};
+
+#endif
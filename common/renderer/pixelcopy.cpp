@@ -0,0 +1,283 @@
+#include "pixelcopy.h"
+#include "math/floatx8.h"
+#include <string.h>
+
+namespace
+{
+	inline bool IsInterleaved(const PixelLayout& layout, int channels, int bytesPerSample)
+	{
+		return layout.planeBytes == bytesPerSample && layout.columnBytes == channels * bytesPerSample;
+	}
+
+	inline bool IsPlanar(const PixelLayout& layout, int bytesPerSample)
+	{
+		return layout.columnBytes == bytesPerSample;
+	}
+
+	// Scalar copy of pixels [x0, width) of one row between any two layouts.
+	template <class T>
+	void CopyRow(const unsigned char* source, const PixelLayout& sourceLayout,
+		unsigned char* destination, const PixelLayout& destinationLayout, int x0, int width, int channels)
+	{
+		for (int c = 0; c < channels; ++c)
+		{
+			const unsigned char* input = source + x0 * sourceLayout.columnBytes + c * sourceLayout.planeBytes;
+			unsigned char* output = destination + x0 * destinationLayout.columnBytes + c * destinationLayout.planeBytes;
+			for (int x = x0; x < width; ++x)
+			{
+				*reinterpret_cast<T*>(output) = *reinterpret_cast<const T*>(input);
+				input += sourceLayout.columnBytes;
+				output += destinationLayout.columnBytes;
+			}
+		}
+	}
+
+	// destination + (source - destination) * coverage / 255, rounded for
+	// integer samples.
+	inline unsigned char Blend(unsigned char source, unsigned char destination, int coverage)
+	{
+		return (unsigned char)((destination * (255 - coverage) + source * coverage + 127) / 255);
+	}
+
+	inline unsigned short Blend(unsigned short source, unsigned short destination, int coverage)
+	{
+		return (unsigned short)((destination * (255 - coverage) + source * coverage + 127) / 255);
+	}
+
+	inline float Blend(float source, float destination, int coverage)
+	{
+		return destination + (source - destination) * (coverage * (1.0f / 255.0f));
+	}
+
+	template <class T>
+	void BlendRow(const unsigned char* source, const PixelLayout& sourceLayout,
+		unsigned char* destination, const PixelLayout& destinationLayout,
+		const unsigned char* mask, int width, int channels)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int coverage = mask[x];
+			if (coverage == 0)
+				continue;
+
+			const unsigned char* input = source + x * sourceLayout.columnBytes;
+			unsigned char* output = destination + x * destinationLayout.columnBytes;
+			for (int c = 0; c < channels; ++c)
+			{
+				const T& value = *reinterpret_cast<const T*>(input + c * sourceLayout.planeBytes);
+				T& target = *reinterpret_cast<T*>(output + c * destinationLayout.planeBytes);
+				target = coverage == 255 ? value : Blend(value, target, coverage);
+			}
+		}
+	}
+
+#if defined(FLOATX8_SSE2) || defined(FLOATX8_AVX2)
+	// 4x4 transpose of 16 byte blocks: four pixels of four 32-bit channels
+	// become four channels of four pixels, and back.
+	inline void Transpose32(__m128i& p0, __m128i& p1, __m128i& p2, __m128i& p3)
+	{
+		__m128 r0 = _mm_castsi128_ps(p0);
+		__m128 r1 = _mm_castsi128_ps(p1);
+		__m128 r2 = _mm_castsi128_ps(p2);
+		__m128 r3 = _mm_castsi128_ps(p3);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		p0 = _mm_castps_si128(r0);
+		p1 = _mm_castps_si128(r1);
+		p2 = _mm_castps_si128(r2);
+		p3 = _mm_castps_si128(r3);
+	}
+
+	// Four-channel interleaved row into four planes. Each round of unpacks
+	// halves the distance between samples of the same channel. Returns how
+	// many pixels were handled.
+	int DeinterleaveRow4(const unsigned char* source, unsigned char* destination, ptrdiff_t planeBytes,
+		int width, int bytesPerSample)
+	{
+		int step = 16 / bytesPerSample;
+		int x = 0;
+		for (; x + step <= width; x += step)
+		{
+			const __m128i* input = reinterpret_cast<const __m128i*>(source + x * 4 * bytesPerSample);
+			__m128i p0 = _mm_loadu_si128(input);
+			__m128i p1 = _mm_loadu_si128(input + 1);
+			__m128i p2 = _mm_loadu_si128(input + 2);
+			__m128i p3 = _mm_loadu_si128(input + 3);
+
+			if (bytesPerSample == 4)
+			{
+				Transpose32(p0, p1, p2, p3);
+			}
+			else
+			{
+				for (int round = bytesPerSample == 1 ? 4 : 3; round > 0; --round)
+				{
+					__m128i q0 = bytesPerSample == 1 ? _mm_unpacklo_epi8(p0, p2) : _mm_unpacklo_epi16(p0, p2);
+					__m128i q1 = bytesPerSample == 1 ? _mm_unpackhi_epi8(p0, p2) : _mm_unpackhi_epi16(p0, p2);
+					__m128i q2 = bytesPerSample == 1 ? _mm_unpacklo_epi8(p1, p3) : _mm_unpacklo_epi16(p1, p3);
+					__m128i q3 = bytesPerSample == 1 ? _mm_unpackhi_epi8(p1, p3) : _mm_unpackhi_epi16(p1, p3);
+					p0 = q0; p1 = q1; p2 = q2; p3 = q3;
+				}
+			}
+
+			unsigned char* output = destination + x * bytesPerSample;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output), p0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + planeBytes), p1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2 * planeBytes), p2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + 3 * planeBytes), p3);
+		}
+		return x;
+	}
+
+	// Four planes into a four-channel interleaved row: pair up channels
+	// (R with G, B with A), then pair up the pairs.
+	int InterleaveRow4(const unsigned char* source, ptrdiff_t planeBytes, unsigned char* destination,
+		int width, int bytesPerSample)
+	{
+		int step = 16 / bytesPerSample;
+		int x = 0;
+		for (; x + step <= width; x += step)
+		{
+			const unsigned char* input = source + x * bytesPerSample;
+			__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+			__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + planeBytes));
+			__m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 2 * planeBytes));
+			__m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 3 * planeBytes));
+
+			__m128i q0, q1, q2, q3;
+			if (bytesPerSample == 4)
+			{
+				Transpose32(p0, p1, p2, p3);
+				q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+			}
+			else
+			{
+				__m128i rg0 = bytesPerSample == 1 ? _mm_unpacklo_epi8(p0, p1) : _mm_unpacklo_epi16(p0, p1);
+				__m128i rg1 = bytesPerSample == 1 ? _mm_unpackhi_epi8(p0, p1) : _mm_unpackhi_epi16(p0, p1);
+				__m128i ba0 = bytesPerSample == 1 ? _mm_unpacklo_epi8(p2, p3) : _mm_unpacklo_epi16(p2, p3);
+				__m128i ba1 = bytesPerSample == 1 ? _mm_unpackhi_epi8(p2, p3) : _mm_unpackhi_epi16(p2, p3);
+				q0 = bytesPerSample == 1 ? _mm_unpacklo_epi16(rg0, ba0) : _mm_unpacklo_epi32(rg0, ba0);
+				q1 = bytesPerSample == 1 ? _mm_unpackhi_epi16(rg0, ba0) : _mm_unpackhi_epi32(rg0, ba0);
+				q2 = bytesPerSample == 1 ? _mm_unpacklo_epi16(rg1, ba1) : _mm_unpacklo_epi32(rg1, ba1);
+				q3 = bytesPerSample == 1 ? _mm_unpackhi_epi16(rg1, ba1) : _mm_unpackhi_epi32(rg1, ba1);
+			}
+
+			__m128i* output = reinterpret_cast<__m128i*>(destination + x * 4 * bytesPerSample);
+			_mm_storeu_si128(output, q0);
+			_mm_storeu_si128(output + 1, q1);
+			_mm_storeu_si128(output + 2, q2);
+			_mm_storeu_si128(output + 3, q3);
+		}
+		return x;
+	}
+#else
+	int DeinterleaveRow4(const unsigned char*, unsigned char*, ptrdiff_t, int, int)
+	{
+		return 0;
+	}
+
+	int InterleaveRow4(const unsigned char*, ptrdiff_t, unsigned char*, int, int)
+	{
+		return 0;
+	}
+#endif
+}
+
+void PixelCopy::CopyRows(const PixelLayout& source, const PixelLayout& destination,
+	int width, int channels, int bytesPerSample, int top, int bottom)
+{
+	const unsigned char* input = static_cast<const unsigned char*>(source.data) + top * source.rowBytes;
+	unsigned char* output = static_cast<unsigned char*>(destination.data) + top * destination.rowBytes;
+
+	bool sourceInterleaved = IsInterleaved(source, channels, bytesPerSample);
+	bool sourcePlanar = IsPlanar(source, bytesPerSample);
+	bool destinationInterleaved = IsInterleaved(destination, channels, bytesPerSample);
+	bool destinationPlanar = IsPlanar(destination, bytesPerSample);
+
+	// whole planes or the whole band in one go when rows are packed the same way
+	size_t rowBytes = (size_t)width * (sourceInterleaved ? channels : 1) * bytesPerSample;
+	bool packedRows = source.rowBytes == (ptrdiff_t)rowBytes && destination.rowBytes == (ptrdiff_t)rowBytes;
+	if (packedRows && sourceInterleaved && destinationInterleaved)
+	{
+		memcpy(output, input, (bottom - top) * rowBytes);
+		return;
+	}
+	if (packedRows && sourcePlanar && destinationPlanar)
+	{
+		for (int c = 0; c < channels; ++c)
+			memcpy(output + c * destination.planeBytes, input + c * source.planeBytes, (bottom - top) * rowBytes);
+		return;
+	}
+
+	for (int y = top; y < bottom; ++y)
+	{
+		int x0 = 0;
+		if (sourceInterleaved && destinationInterleaved)
+		{
+			memcpy(output, input, rowBytes);
+			x0 = width;
+		}
+		else if (sourcePlanar && destinationPlanar)
+		{
+			for (int c = 0; c < channels; ++c)
+				memcpy(output + c * destination.planeBytes, input + c * source.planeBytes, rowBytes);
+			x0 = width;
+		}
+		else if (channels == 4 && sourceInterleaved && destinationPlanar)
+		{
+			x0 = DeinterleaveRow4(input, output, destination.planeBytes, width, bytesPerSample);
+		}
+		else if (channels == 4 && sourcePlanar && destinationInterleaved)
+		{
+			x0 = InterleaveRow4(input, source.planeBytes, output, width, bytesPerSample);
+		}
+
+		if (x0 < width)
+		{
+			if (bytesPerSample == 1)
+				CopyRow<unsigned char>(input, source, output, destination, x0, width, channels);
+			else if (bytesPerSample == 2)
+				CopyRow<unsigned short>(input, source, output, destination, x0, width, channels);
+			else
+				CopyRow<float>(input, source, output, destination, x0, width, channels);
+		}
+
+		input += source.rowBytes;
+		output += destination.rowBytes;
+	}
+}
+
+PixelCopy::Coverage PixelCopy::GetCoverage(const MaskLayout& mask, int width, int height)
+{
+	bool selected = false;
+	bool unselected = false;
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char* row = mask.data + y * mask.rowBytes;
+		for (int x = 0; x < width; ++x)
+		{
+			selected |= row[x] != 0;
+			unselected |= row[x] != 255;
+		}
+		if (selected && unselected)
+			return PartlySelected;
+	}
+	return selected ? FullySelected : Unselected;
+}
+
+void PixelCopy::BlendRows(const PixelLayout& source, const PixelLayout& destination, const MaskLayout& mask,
+	int width, int channels, int bytesPerSample, int top, int bottom)
+{
+	for (int y = top; y < bottom; ++y)
+	{
+		const unsigned char* input = static_cast<const unsigned char*>(source.data) + y * source.rowBytes;
+		unsigned char* output = static_cast<unsigned char*>(destination.data) + y * destination.rowBytes;
+		const unsigned char* coverage = mask.data + y * mask.rowBytes;
+
+		if (bytesPerSample == 1)
+			BlendRow<unsigned char>(input, source, output, destination, coverage, width, channels);
+		else if (bytesPerSample == 2)
+			BlendRow<unsigned short>(input, source, output, destination, coverage, width, channels);
+		else
+			BlendRow<float>(input, source, output, destination, coverage, width, channels);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef __PIXELCOPY__
+#define __PIXELCOPY__
+#include <stddef.h>
+
+// Where a block of samples lives and how it is laid out, in the terms the
+// host uses for outData: byte offsets between rows, between pixels in a row
+// and between the planes of a pixel.
+struct PixelLayout
+{
+	void* data;
+	ptrdiff_t rowBytes;
+	ptrdiff_t columnBytes;
+	ptrdiff_t planeBytes;
+};
+
+// A selection in the host's maskData form: one byte of coverage per pixel,
+// 0 leaving the pixel alone and 255 replacing it, rows rowBytes apart.
+struct MaskLayout
+{
+	const unsigned char* data;
+	ptrdiff_t rowBytes;
+};
+
+namespace PixelCopy
+{
+	enum Coverage
+	{
+		Unselected,
+		PartlySelected,
+		FullySelected
+	};
+
+	// Classifies width x height pixels of mask, stopping as soon as both
+	// selected and unselected pixels have been seen.
+	Coverage GetCoverage(const MaskLayout& mask, int width, int height);
+
+	// Copies rows [top, bottom) of width pixels with channels samples of
+	// bytesPerSample (1, 2 or 4) bytes each from source to destination. Row
+	// top of the source lands at row top of the destination. Rows are
+	// independent, so bands can be copied in parallel.
+	//
+	// Matching layouts, interleaved to interleaved or planar to planar, are
+	// copied with memcpy. Converting between the two goes a row at a time so
+	// each source row is read once, with SSE2 shuffles for four channels.
+	void CopyRows(const PixelLayout& source, const PixelLayout& destination,
+		int width, int channels, int bytesPerSample, int top, int bottom);
+
+	// Like CopyRows, but mixes source into what destination already holds
+	// by mask coverage. Pixels with no coverage are not read from source,
+	// so they may be left unrendered.
+	void BlendRows(const PixelLayout& source, const PixelLayout& destination, const MaskLayout& mask,
+		int width, int channels, int bytesPerSample, int top, int bottom);
+}
+
+#endif
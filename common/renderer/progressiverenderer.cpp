@@ -0,0 +1,155 @@
+#include "progressiverenderer.h"
+#include "time/profiler.h"
+#include <algorithm>
+#include <string.h>
+
+ProgressiveRenderer::ProgressiveRenderer(Renderer& renderer, int channels, int coarsestBlockSize)
+	: m_Renderer(renderer)
+	, m_Bounds(renderer.GetBounds())
+	, m_ImageWidth(renderer.GetWidth())
+	, m_ImageHeight(renderer.GetHeight())
+	, m_Width(m_Bounds.right - m_Bounds.left)
+	, m_Height(m_Bounds.bottom - m_Bounds.top)
+	, m_Channels(channels)
+	, m_CoarsestBlockSize(coarsestBlockSize)
+	, m_Generation(0)
+	, m_WantedGeneration(0)
+	, m_Running(false)
+	, m_Quit(false)
+	, m_FrontBlockSize(0)
+	, m_FrontSerial(0)
+	, m_CopiedSerial(0)
+{
+	m_Renderer.SetOutputDepth(8);
+	m_Renderer.SetLayout(Renderer::Interleaved);
+	m_Back.resize((size_t)m_Width * m_Height * channels);
+	m_Front.resize(m_Back.size());
+	m_Thread = std::thread(&ProgressiveRenderer::ThreadMain, this);
+}
+
+ProgressiveRenderer::~ProgressiveRenderer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+		++m_Generation;
+	}
+	m_Wake.notify_one();
+	m_Thread.join();
+}
+
+void ProgressiveRenderer::Restart()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_WantedGeneration = ++m_Generation;
+		m_Running = true;
+	}
+	m_Wake.notify_one();
+}
+
+void ProgressiveRenderer::Cancel()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	++m_Generation;
+	m_Running = false;
+}
+
+int ProgressiveRenderer::CopyLatest(unsigned char* destination, ptrdiff_t rowBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_FrontSerial == m_CopiedSerial)
+		return 0;
+
+	size_t frontRowBytes = (size_t)m_Width * m_Channels;
+	for (int y = 0; y < m_Height; ++y)
+		memcpy(destination + y * rowBytes, &m_Front[y * frontRowBytes], frontRowBytes);
+
+	m_CopiedSerial = m_FrontSerial;
+	return m_FrontBlockSize;
+}
+
+void ProgressiveRenderer::ThreadMain()
+{
+	for (;;)
+	{
+		unsigned int generation;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Wake.wait(lock, [this] { return m_Quit || m_Running; });
+			if (m_Quit)
+				return;
+			generation = m_WantedGeneration;
+		}
+
+		for (int blockSize = m_CoarsestBlockSize; blockSize > 0; blockSize >>= 1)
+		{
+			if (!RenderPass(blockSize, generation))
+				break;
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Generation != generation)
+				break;
+			m_Front.swap(m_Back);
+			m_FrontBlockSize = blockSize;
+			++m_FrontSerial;
+			if (blockSize == 1)
+				m_Running = false;
+		}
+	}
+}
+
+// Returns false if the pass was abandoned.
+bool ProgressiveRenderer::RenderPass(int blockSize, unsigned int generation)
+{
+	PROFILE_ZONE("PreviewPass");
+
+	// the samples covering the bounds in the image scaled down by blockSize
+	m_Renderer.SetImageSize((m_ImageWidth + blockSize - 1) / blockSize, (m_ImageHeight + blockSize - 1) / blockSize);
+	int left = m_Bounds.left / blockSize;
+	int right = (m_Bounds.right + blockSize - 1) / blockSize;
+	int bottom = (m_Bounds.bottom + blockSize - 1) / blockSize;
+
+	for (int top = m_Bounds.top / blockSize; top < bottom; top += BandHeight)
+	{
+		if (m_Generation.load(std::memory_order_relaxed) != generation)
+			return false;
+
+		Renderer::Tile band;
+		band.left = left;
+		band.top = top;
+		band.right = right;
+		band.bottom = std::min(top + BandHeight, bottom);
+		m_Renderer.Render(band);
+		ExpandBand(band, blockSize);
+	}
+	return true;
+}
+
+// Writes each rendered sample of band as the part of its blockSize square
+// that falls inside the bounds into m_Back.
+void ProgressiveRenderer::ExpandBand(const Renderer::Tile& band, int blockSize)
+{
+	const unsigned char* samples = static_cast<const unsigned char*>(m_Renderer.GetPixelData());
+	size_t sampleRowBytes = (size_t)(band.right - band.left) * m_Channels;
+	size_t rowBytes = (size_t)m_Width * m_Channels;
+
+	for (int row = band.top; row < band.bottom; ++row)
+	{
+		const unsigned char* source = samples + (row - band.top) * sampleRowBytes;
+		int y0 = std::max(row * blockSize - m_Bounds.top, 0);
+		int y1 = std::min((row + 1) * blockSize - m_Bounds.top, m_Height);
+
+		unsigned char* destination = &m_Back[y0 * rowBytes];
+		if (blockSize == 1)
+		{
+			memcpy(destination, source, rowBytes);
+			continue;
+		}
+
+		for (int x = 0; x < m_Width; ++x)
+			memcpy(destination + x * m_Channels, source + ((m_Bounds.left + x) / blockSize - band.left) * m_Channels, m_Channels);
+		for (int y = y0 + 1; y < y1; ++y)
+			memcpy(&m_Back[y * rowBytes], destination, rowBytes);
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef __PROGRESSIVERENDERER__
+#define __PROGRESSIVERENDERER__
+#include "renderer.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Renders an 8-bit preview of the renderer's bounds on a background thread
+// in passes of decreasing block size: 1/8, 1/4, 1/2 and then full
+// resolution. Each pass renders the image scaled down by its block size and
+// writes every sample as a block of pixels, so the kernel sees the same
+// normalized coordinates at every pass.
+// A finished pass replaces the previous one. Restart() abandons the pass in
+// flight within one band of rows and starts again from the coarsest.
+class ProgressiveRenderer
+{
+public:
+
+	static const int PassCount = 4;
+	static const int BandHeight = 16;
+
+	// renderer is only used from the background thread from now on; it is
+	// switched to 8-bit interleaved output and its image size changes per
+	// pass. The preview is the size of the renderer's bounds.
+	// coarsestBlockSize is the first pass's block size: pass 1 for kernels
+	// that read their source in pixels, which only lines up at full
+	// resolution.
+	ProgressiveRenderer(Renderer& renderer, int channels, int coarsestBlockSize = 1 << (PassCount - 1));
+	~ProgressiveRenderer();
+
+	void Restart();
+	void Cancel();
+
+	// Copies the latest finished pass into destination, interleaved rows
+	// rowBytes apart, if it has not been copied yet. Returns that pass's
+	// block size, or 0 when there is nothing new.
+	int CopyLatest(unsigned char* destination, ptrdiff_t rowBytes);
+
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+	inline int GetChannels() const { return m_Channels; }
+
+private:
+
+	ProgressiveRenderer(const ProgressiveRenderer&);
+	ProgressiveRenderer& operator =(const ProgressiveRenderer&);
+
+	void ThreadMain();
+	bool RenderPass(int blockSize, unsigned int generation);
+	void ExpandBand(const Renderer::Tile& band, int blockSize);
+
+	Renderer& m_Renderer;
+	Renderer::Tile m_Bounds;
+	int m_ImageWidth;
+	int m_ImageHeight;
+	int m_Width;
+	int m_Height;
+	int m_Channels;
+	int m_CoarsestBlockSize;
+
+	// bumped by Restart and Cancel; a pass stops when it no longer matches
+	std::atomic<unsigned int> m_Generation;
+	unsigned int m_WantedGeneration;
+	bool m_Running;
+	bool m_Quit;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+
+	std::vector<unsigned char> m_Back;
+	std::vector<unsigned char> m_Front;
+	int m_FrontBlockSize;
+	unsigned int m_FrontSerial;
+	unsigned int m_CopiedSerial;
+
+	std::thread m_Thread;
+};
+
+#endif
@@ -1,52 +1,877 @@
 #include "renderer.h"
-#include <thread>
+#include "bufferarena.h"
+#include "tilecache.h"
+#include "passgraph.h"
+#include "shader/shaderprogram.h"
+#include "color/quantize.h"
+#include "time/profiler.h"
+#include <algorithm>
+#include <cfenv>
+#include <cfloat>
+#include <cmath>
+#include <new>
 
-Renderer::Renderer(KernelFunc kernelFunc, int width, int height, int bytesPerPixel) 
-	: m_KernelFunc(kernelFunc)
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define RENDERER_MXCSR 1
+	#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// x and y's bits interleaved, x in the even bits.
+	unsigned long long MortonIndex(unsigned int x, unsigned int y)
+	{
+		unsigned long long index = 0;
+		for (int bit = 0; bit < 32; ++bit)
+		{
+			index |= (unsigned long long)((x >> bit) & 1) << (2 * bit);
+			index |= (unsigned long long)((y >> bit) & 1) << (2 * bit + 1);
+		}
+		return index;
+	}
+
+	// Stable jitter in [0, 1) for sample index of pixel (x, y), so
+	// supersampled renders repeat exactly.
+	inline void Jitter(int x, int y, int index, float& jx, float& jy)
+	{
+		unsigned int hash = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)index * 83492791u;
+		hash ^= hash >> 13;
+		hash *= 0x5bd1e995u;
+		hash ^= hash >> 15;
+		jx = (hash & 0xFFFF) * (1.0f / 65536.0f);
+		jy = (hash >> 16) * (1.0f / 65536.0f);
+	}
+
+	// Round-to-nearest with denormals kept on the calling thread while in
+	// scope, when enabled; the thread's own mode comes back after, so the
+	// pool's workers keep whatever the host gave them.
+	class StandardFloatingPoint
+	{
+	public:
+
+		explicit StandardFloatingPoint(bool enabled)
+			: m_Enabled(enabled)
+			, m_Rounding(0)
+			, m_Control(0)
+		{
+			if (!m_Enabled)
+				return;
+			m_Rounding = fegetround();
+		#if defined(RENDERER_MXCSR)
+			// the SSE unit, which does the float math: clear rounding control
+			// (bits 13-14), flush-to-zero (15) and denormals-are-zero (6)
+			m_Control = _mm_getcsr();
+			_mm_setcsr((unsigned int)m_Control & ~0xE040u);
+		#elif defined(__aarch64__) && defined(__GNUC__)
+			// clear FPCR's rounding mode (bits 22-23) and flush-to-zero (24)
+			__asm__ volatile("mrs %0, fpcr" : "=r"(m_Control));
+			__asm__ volatile("msr fpcr, %0" : : "r"(m_Control & ~(7ull << 22)));
+		#endif
+			fesetround(FE_TONEAREST);
+		}
+
+		~StandardFloatingPoint()
+		{
+			if (!m_Enabled)
+				return;
+			fesetround(m_Rounding);
+		#if defined(RENDERER_MXCSR)
+			_mm_setcsr((unsigned int)m_Control);
+		#elif defined(__aarch64__) && defined(__GNUC__)
+			__asm__ volatile("msr fpcr, %0" : : "r"(m_Control));
+		#endif
+		}
+
+	private:
+
+		StandardFloatingPoint(const StandardFloatingPoint&);
+		StandardFloatingPoint& operator =(const StandardFloatingPoint&);
+
+		bool m_Enabled;
+		int m_Rounding;
+		unsigned long long m_Control;
+	};
+
+	// Zeroes the span's channels past the four a Color holds, so images
+	// with more planes than that never show what the buffer held before.
+	void ClearExtraChannels(const Renderer::Span& span)
+	{
+		if (span.channels <= 4)
+			return;
+		float* output = span.output;
+		for (unsigned int x = span.x0; x < span.x1; ++x)
+		{
+			for (int c = 4; c < span.channels; ++c)
+				output[c * span.planeStride] = 0.0f;
+			output += span.stride;
+		}
+	}
+
+	// Distance along the Hilbert curve filling a side x side grid, side a
+	// power of two.
+	unsigned long long HilbertIndex(unsigned int side, unsigned int x, unsigned int y)
+	{
+		unsigned long long index = 0;
+		for (unsigned int s = side / 2; s > 0; s /= 2)
+		{
+			unsigned int rx = (x & s) != 0 ? 1 : 0;
+			unsigned int ry = (y & s) != 0 ? 1 : 0;
+			index += (unsigned long long)s * s * ((3 * rx) ^ ry);
+
+			// rotate the quadrant so the curve continues from where the
+			// last one ended
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = side - 1 - x;
+					y = side - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return index;
+	}
+}
+
+const float Renderer::DefaultSupersampleThreshold = 0.05f;
+
+Renderer::Renderer(KernelFunc kernelFunc, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(kernelFunc);
+}
+
+Renderer::Renderer(SpanKernelFunc spanKernelFunc, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(spanKernelFunc);
+}
+
+Renderer::Renderer(PacketKernelFunc packetKernelFunc, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(packetKernelFunc);
+}
+
+Renderer::Renderer(SourceKernelFunc sourceKernelFunc, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(sourceKernelFunc);
+}
+
+Renderer::Renderer(const PassGraph& graph, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(graph);
+}
+
+Renderer::Renderer(const ShaderProgram& program, int width, int height, int bytesPerPixel, int threadCount)
+	: Renderer(width, height, bytesPerPixel, threadCount)
+{
+	SetKernel(program);
+}
+
+Renderer::Renderer(int width, int height, int bytesPerPixel, int threadCount)
+	: m_KernelFunc(0)
+	, m_SpanKernelFunc(0)
+	, m_PacketKernelFunc(0)
+	, m_SourceKernelFunc(0)
+	, m_Source(0)
+	, m_Graph(0)
+	, m_Program(0)
 	, m_Width(width)
 	, m_Height(height)
 	, m_BytesPerPixel(bytesPerPixel)
-	, m_JobsCompleted(0)
+	, m_Depth(32)
+	, m_Dither(false)
+	, m_Layout(Interleaved)
+	, m_TileOrder(TileOrderAuto)
+	, m_SupersampleGrid(1)
+	, m_SupersampleThreshold(DefaultSupersampleThreshold)
+	, m_SampleCount(0)
+	, m_CollectStatistics(false)
+	, m_Deterministic(false)
+	, m_Statistics()
 	, m_Pixels(0)
+	, m_Capacity(0)
+	, m_PlaneBytes(0)
+	, m_Mask(0)
+	, m_TilesDone(0)
+	, m_Cancelled(false)
+	, m_WorkerPool(threadCount)
 {
-	m_Pixels = new float[width * height * bytesPerPixel];
+	m_Region.left = m_Region.top = m_Region.right = m_Region.bottom = 0;
+	SetImageSize(width, height);
 }
 
-void Render_Thread(Renderer::KernelFunc kernelFunc, int* jobsCompleted, int startingX, int startingY, int endingX, int endingY, int width, int height, int bytesPerPixel, float* pixels)
+Renderer::~Renderer()
 {
-	Color outputColor;
-	for (int y = startingY; y < endingY; ++y)
+	BufferArena::Release(m_Pixels, m_Capacity);
+}
+
+void Renderer::ClearKernel()
+{
+	m_KernelFunc = 0;
+	m_SpanKernelFunc = 0;
+	m_PacketKernelFunc = 0;
+	m_SourceKernelFunc = 0;
+	m_Graph = 0;
+	m_Program = 0;
+}
+
+void Renderer::SetKernel(KernelFunc kernelFunc)
+{
+	ClearKernel();
+	m_KernelFunc = kernelFunc;
+}
+
+void Renderer::SetKernel(SpanKernelFunc spanKernelFunc)
+{
+	ClearKernel();
+	m_SpanKernelFunc = spanKernelFunc;
+}
+
+void Renderer::SetKernel(PacketKernelFunc packetKernelFunc)
+{
+	ClearKernel();
+	m_PacketKernelFunc = packetKernelFunc;
+}
+
+void Renderer::SetKernel(SourceKernelFunc sourceKernelFunc)
+{
+	ClearKernel();
+	m_SourceKernelFunc = sourceKernelFunc;
+}
+
+void Renderer::SetKernel(const PassGraph& graph)
+{
+	ClearKernel();
+	m_Graph = &graph;
+	while ((int)m_GraphContexts.size() < GetThreadCount())
+		m_GraphContexts.push_back(std::unique_ptr<PassGraphContext>(new PassGraphContext()));
+}
+
+void Renderer::SetKernel(const ShaderProgram& program)
+{
+	ClearKernel();
+	m_Program = &program;
+}
+
+void Renderer::SetBytesPerPixel(int bytesPerPixel)
+{
+	m_BytesPerPixel = bytesPerPixel;
+	UpdateOutputTables();
+}
+
+void Renderer::SetSupersampling(int grid, float threshold)
+{
+	m_SupersampleGrid = std::max(grid, 1);
+	m_SupersampleThreshold = threshold;
+
+	// per worker: the tile sampled once with a one pixel apron, then the
+	// finished tile
+	size_t size = m_SupersampleGrid > 1 ? SampleApronFloats + (size_t)TileSize * TileSize * PassGraph::Channels : 0;
+	m_SampleTiles.resize(GetThreadCount());
+	for (size_t i = 0; i < m_SampleTiles.size(); ++i)
+		m_SampleTiles[i].assign(size, 0.0f);
+}
+
+void Renderer::ReleaseMemory()
+{
+	BufferArena::Release(m_Pixels, m_Capacity);
+	m_Pixels = 0;
+	m_Capacity = 0;
+	m_Region.left = m_Region.top = m_Region.right = m_Region.bottom = 0;
+	for (size_t i = 0; i < m_GraphContexts.size(); ++i)
+		m_GraphContexts[i].reset(new PassGraphContext());
+}
+
+void Renderer::SetImageSize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+	m_Bounds.left = 0;
+	m_Bounds.top = 0;
+	m_Bounds.right = width;
+	m_Bounds.bottom = height;
+}
+
+void Renderer::SetOutputDepth(int depth, bool dither)
+{
+	m_Depth = depth;
+	m_Dither = dither;
+	UpdateOutputTables();
+}
+
+void Renderer::SetLayout(Layout layout)
+{
+	m_Layout = layout;
+	UpdateOutputTables();
+}
+
+// Quantized spans are rendered into a per-worker float row first, laid out
+// like the render target. Rounding offsets are laid out as 8 rows of
+// TileSize + 8 pixels so any span can read its offsets contiguously,
+// starting at its x phase in the dither pattern; planar targets quantize a
+// channel at a time and only need one offset per pixel.
+void Renderer::UpdateOutputTables()
+{
+	m_SpanScratch.clear();
+	m_QuantizeOffsets.clear();
+	if (m_Depth == 32)
+		return;
+
+	m_SpanScratch.resize((size_t)GetThreadCount() * TileSize * m_BytesPerPixel);
+
+	int rowLength = TileSize + 8;
+	int channels = m_Layout == Planar ? 1 : m_BytesPerPixel;
+	m_QuantizeOffsets.resize((size_t)8 * rowLength * channels);
+	for (int y = 0; y < 8; ++y)
+		for (int x = 0; x < rowLength; ++x)
+			for (int c = 0; c < channels; ++c)
+				m_QuantizeOffsets[((size_t)y * rowLength + x) * channels + c] = m_Dither ? Quantize::DitherOffset(x, y) : 0.5f;
+}
+
+void Renderer::Reserve(size_t pixelCount)
+{
+	size_t sampleBytes = pixelCount * (m_Depth / 8);
+	m_PlaneBytes = (sampleBytes + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+
+	size_t size = (m_Layout == Planar ? m_PlaneBytes : sampleBytes) * m_BytesPerPixel;
+	if (size <= m_Capacity)
+		return;
+
+	// arena blocks are page aligned and untouched, so each page is first
+	// written, and placed on its NUMA node, by the worker rendering the
+	// tile over it; workers take contiguous runs of tile rows
+	BufferArena::Release(m_Pixels, m_Capacity);
+	m_Pixels = 0;
+	m_Capacity = 0;
+	void* block = BufferArena::Allocate(size, m_Capacity);
+	if (block == 0)
+		throw std::bad_alloc();
+	m_Pixels = static_cast<unsigned char*>(block);
+}
+
+PixelLayout Renderer::GetPixelLayout() const
+{
+	int bytesPerSample = m_Depth / 8;
+	int regionWidth = m_Region.right - m_Region.left;
+
+	PixelLayout layout;
+	layout.data = m_Pixels;
+	if (m_Layout == Planar)
+	{
+		layout.rowBytes = regionWidth * bytesPerSample;
+		layout.columnBytes = bytesPerSample;
+		layout.planeBytes = m_PlaneBytes;
+	}
+	else
+	{
+		layout.rowBytes = regionWidth * m_BytesPerPixel * bytesPerSample;
+		layout.columnBytes = m_BytesPerPixel * bytesPerSample;
+		layout.planeBytes = bytesPerSample;
+	}
+	return layout;
+}
+
+void Renderer::BuildTiles(const Tile& region)
+{
+	m_Tiles.clear();
+	for (int top = region.top; top < region.bottom; top += TileSize)
+	{
+		for (int left = region.left; left < region.right; left += TileSize)
+		{
+			Tile tile;
+			tile.left = left;
+			tile.top = top;
+			tile.right = std::min(left + TileSize, region.right);
+			tile.bottom = std::min(top + TileSize, region.bottom);
+			m_Tiles.push_back(tile);
+		}
+	}
+
+	TileOrder order = m_TileOrder;
+	if (order == TileOrderAuto)
+	{
+		// the input a row of tiles reads, as the TileCache's floats
+		bool sampling = m_Source != 0 || m_Graph != 0 || (m_Program != 0 && m_Program->UsesSource());
+		size_t rowFootprint = (size_t)(region.right - region.left) * TileSize * 4 * sizeof(float);
+		order = sampling && rowFootprint > WorkerPool::CacheSize() ? TileOrderHilbert : TileOrderRows;
+	}
+	if (order == TileOrderRows)
+		return;
+
+	// sort by position along the curve through a power of two grid
+	// covering the tiles, or by block and then row-major within it
+	int columns = (region.right - region.left + TileSize - 1) / TileSize;
+	int rows = (region.bottom - region.top + TileSize - 1) / TileSize;
+	unsigned int side = 1;
+	while (side < (unsigned int)std::max(columns, rows))
+		side *= 2;
+
+	size_t tileFootprint = (size_t)TileSize * TileSize * 4 * sizeof(float);
+	unsigned int block = (unsigned int)std::max(WorkerPool::CacheSize() / (2 * tileFootprint), (size_t)1);
+	unsigned int blockColumns = ((unsigned int)columns + block - 1) / block;
+
+	std::vector<std::pair<unsigned long long, int> > keys(m_Tiles.size());
+	for (size_t i = 0; i < m_Tiles.size(); ++i)
+	{
+		unsigned int column = (unsigned int)(i % columns);
+		unsigned int row = (unsigned int)(i / columns);
+		if (order == TileOrderTiled)
+			keys[i].first = (((unsigned long long)(row / block) * blockColumns + column / block) * block + row % block) * block + column % block;
+		else
+			keys[i].first = order == TileOrderMorton ? MortonIndex(column, row) : HilbertIndex(side, column, row);
+		keys[i].second = (int)i;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Tile> sorted(m_Tiles.size());
+	for (size_t i = 0; i < keys.size(); ++i)
+		sorted[i] = m_Tiles[keys[i].second];
+	m_Tiles.swap(sorted);
+}
+
+void Renderer::RenderTile(const Tile& tile, int workerIndex)
+{
+	PROFILE_ZONE("RenderTile");
+
+	bool planar = m_Layout == Planar;
+	int bytesPerSample = m_Depth / 8;
+	size_t regionWidth = m_Region.right - m_Region.left;
+	size_t pixelSamples = planar ? 1 : m_BytesPerPixel;
+
+	Span span;
+	span.width = m_Width;
+	span.height = m_Height;
+	span.stride = (int)pixelSamples;
+	span.planeStride = planar ? m_PlaneBytes / bytesPerSample : 1;
+	span.channels = m_BytesPerPixel;
+	span.source = m_Source;
+
+	float* scratch = 0;
+	if (!m_SpanScratch.empty())
+	{
+		scratch = &m_SpanScratch[(size_t)workerIndex * TileSize * m_BytesPerPixel];
+		span.planeStride = planar ? TileSize : 1;
+	}
+
+	const float* graphTile = 0;
+	if (m_Graph != 0)
+		graphTile = m_Graph->Evaluate(tile, m_Width, m_Height, m_Source, *m_GraphContexts[workerIndex]);
+	else if (m_SupersampleGrid > 1 && m_PacketKernelFunc != 0)
+		graphTile = SupersampleTile(tile, workerIndex);
+
+	// the tile's sums sit at its position in the region
+	Statistics* statistics = 0;
+	double* sums = 0;
+	if (m_CollectStatistics)
+	{
+		int columns = (m_Region.right - m_Region.left + TileSize - 1) / TileSize;
+		int position = (tile.top - m_Region.top) / TileSize * columns + (tile.left - m_Region.left) / TileSize;
+		statistics = &m_WorkerStatistics[workerIndex];
+		sums = &m_TileSums[(size_t)position * Statistics::Channels];
+	}
+
+	for (int y = tile.top; y < tile.bottom; ++y)
+	{
+		// trim the span to the selected pixels of the row
+		int x0 = tile.left;
+		int x1 = tile.right;
+		if (m_Mask != 0)
+		{
+			const unsigned char* coverage = m_Mask->data + (y - m_Region.top) * m_Mask->rowBytes - m_Region.left;
+			while (x0 < x1 && coverage[x0] == 0)
+				++x0;
+			while (x1 > x0 && coverage[x1 - 1] == 0)
+				--x1;
+			if (x0 == x1)
+				continue;
+		}
+
+		span.y = y;
+		span.x0 = x0;
+		span.x1 = x1;
+		unsigned char* output = m_Pixels + ((y - m_Region.top) * regionWidth + (x0 - m_Region.left)) * pixelSamples * bytesPerSample;
+
+		const float* graphRow = graphTile == 0 ? 0 :
+			graphTile + ((size_t)(y - tile.top) * (tile.right - tile.left) + (x0 - tile.left)) * PassGraph::Channels;
+		if (scratch == 0)
+		{
+			span.output = reinterpret_cast<float*>(output);
+			if (graphTile)
+				StoreGraphRow(span, graphRow);
+			else
+				RenderSpan(span);
+			if (statistics)
+				AccumulateRow(span, *statistics, sums);
+			continue;
+		}
+
+		span.output = scratch;
+		if (graphTile)
+			StoreGraphRow(span, graphRow);
+		else
+			RenderSpan(span);
+		if (statistics)
+			AccumulateRow(span, *statistics, sums);
+
+		const float* offsets = &m_QuantizeOffsets[((size_t)(y & 7) * (TileSize + 8) + (x0 & 7)) * pixelSamples];
+		if (planar)
+		{
+			for (int c = 0; c < m_BytesPerPixel; ++c)
+				QuantizeRow(scratch + c * TileSize, offsets, output + c * m_PlaneBytes, x1 - x0);
+		}
+		else
+		{
+			QuantizeRow(scratch, offsets, output, (x1 - x0) * m_BytesPerPixel);
+		}
+	}
+}
+
+void Renderer::QuantizeRow(const float* source, const float* offsets, unsigned char* output, int count) const
+{
+	if (m_Depth == 8)
+		Quantize::Store(source, offsets, Quantize::MaxValue8, output, count);
+	else
+		Quantize::Store(source, offsets, Quantize::MaxValue16, reinterpret_cast<unsigned short*>(output), count);
+}
+
+void Renderer::RenderSpan(const Span& span)
+{
+	if (m_SpanKernelFunc)
+	{
+		m_SpanKernelFunc(span);
+		return;
+	}
+
+	if (m_Program)
+		m_Program->Run(span);
+	else if (m_PacketKernelFunc)
+		RenderSpanPerPacket(span);
+	else
+		RenderSpanPerPixel(span);
+	ClearExtraChannels(span);
+}
+
+// Adds a rendered row to a worker's counts and its tile's sums. Rows are
+// added in order within a tile, so each tile's sums come out the same
+// whichever worker renders it.
+void Renderer::AccumulateRow(const Span& span, Statistics& statistics, double* sums) const
+{
+	const int Channels = Statistics::Channels;
+	int channels = std::min(span.channels, (int)Channels);
+	int count = span.x1 - span.x0;
+	statistics.pixelCount += count;
+
+	// a pixel's channels at a time: each channel's histogram is a separate
+	// chain of increments. Sums are double from the first add: a float
+	// running sum rounds away low bits of every value once it outgrows them
+	float minimum[Channels];
+	float maximum[Channels];
+	double sum[Channels];
+	for (int c = 0; c < channels; ++c)
+	{
+		minimum[c] = statistics.minimum[c];
+		maximum[c] = statistics.maximum[c];
+		sum[c] = 0.0;
+	}
+
+	const float* pixel = span.output;
+	for (int i = 0; i < count; ++i, pixel += span.stride)
 	{
-		for (int x = startingX; x < endingX; ++x)
+		for (int c = 0; c < channels; ++c)
 		{
-			kernelFunc(x, y, width, height, outputColor);
+			float value = pixel[c * span.planeStride];
+			minimum[c] = std::min(minimum[c], value);
+			maximum[c] = std::max(maximum[c], value);
+			sum[c] += value;
 
-			int redIndex = (y*width*bytesPerPixel) + (x*bytesPerPixel + 0);
-			memcpy(&pixels[redIndex], outputColor.GetValues(), sizeof(float) * bytesPerPixel);
+			// NaN lands in bin 0
+			int bin = value > 0.0f ? (int)std::min(value * Statistics::Bins, (float)(Statistics::Bins - 1)) : 0;
+			++statistics.histogram[c][bin];
 		}
 	}
 
-	++(*jobsCompleted);
+	for (int c = 0; c < channels; ++c)
+	{
+		statistics.minimum[c] = minimum[c];
+		statistics.maximum[c] = maximum[c];
+		sums[c] += sum[c];
+	}
 }
 
-void Renderer::Render()
+// Combines the workers' counts, which do not depend on the order they are
+// added in, and the tiles' sums, in the tiles' row-major order.
+void Renderer::MergeStatistics(const Tile& region)
 {
-	int d = m_Width / 5;
+	Statistics& merged = m_Statistics;
+	merged = m_WorkerStatistics[0];
+	for (size_t w = 1; w < m_WorkerStatistics.size(); ++w)
+	{
+		const Statistics& statistics = m_WorkerStatistics[w];
+		merged.pixelCount += statistics.pixelCount;
+		for (int c = 0; c < Statistics::Channels; ++c)
+		{
+			merged.minimum[c] = std::min(merged.minimum[c], statistics.minimum[c]);
+			merged.maximum[c] = std::max(merged.maximum[c], statistics.maximum[c]);
+			for (int b = 0; b < Statistics::Bins; ++b)
+				merged.histogram[c][b] += statistics.histogram[c][b];
+		}
+	}
 
-	std::thread t1(Render_Thread, m_KernelFunc, &m_JobsCompleted, 0, 0, d, m_Height, m_Width, m_Height, m_BytesPerPixel, m_Pixels);
-	t1.detach();
+	int tileCount = CountTiles(region);
+	for (int c = 0; c < Statistics::Channels; ++c)
+	{
+		double sum = 0.0;
+		for (int t = 0; t < tileCount; ++t)
+			sum += m_TileSums[(size_t)t * Statistics::Channels + c];
+		merged.mean[c] = merged.pixelCount > 0 ? sum / merged.pixelCount : 0.0;
+	}
+}
 
-	std::thread t2(Render_Thread, m_KernelFunc, &m_JobsCompleted, d, 0, d * 2, m_Height, m_Width, m_Height, m_BytesPerPixel, m_Pixels);
-	t2.detach();
+// Returns tile rendered as rows of four floats, like a PassGraph's output.
+// The first pass covers a one pixel apron around the tile, so an edge along
+// the tile's border is seen from the pixels on both sides of it; at the
+// image's border the apron repeats the edge pixels.
+const float* Renderer::SupersampleTile(const Tile& tile, int workerIndex)
+{
+	PROFILE_ZONE("Supersample");
 
-	std::thread t3(Render_Thread, m_KernelFunc, &m_JobsCompleted, d * 2, 0, d * 3, m_Height, m_Width, m_Height, m_BytesPerPixel, m_Pixels);
-	t3.detach();
+	const int channels = PassGraph::Channels;
+	int tileWidth = tile.right - tile.left;
+	int tileHeight = tile.bottom - tile.top;
+	int apronWidth = tileWidth + 2;
+	size_t apronRow = (size_t)apronWidth * channels;
 
-	std::thread t4(Render_Thread, m_KernelFunc, &m_JobsCompleted, d * 3, 0, d * 4, m_Height, m_Width, m_Height, m_BytesPerPixel, m_Pixels);
-	t4.detach();
+	float* once = &m_SampleTiles[workerIndex][0];
+	float* result = once + SampleApronFloats;
 
-	std::thread t5(Render_Thread, m_KernelFunc, &m_JobsCompleted, d * 4, 0, m_Width, m_Height, m_Width, m_Height, m_BytesPerPixel, m_Pixels);
-	t5.detach();
+	Span span;
+	span.width = m_Width;
+	span.height = m_Height;
+	span.stride = channels;
+	span.planeStride = 1;
+	span.channels = channels;
+	span.source = m_Source;
+	span.x0 = std::max(tile.left - 1, 0);
+	span.x1 = std::min(tile.right + 1, m_Width);
+	for (int y = tile.top - 1; y <= tile.bottom; ++y)
+	{
+		float* row = once + (size_t)(y - tile.top + 1) * apronRow;
+		if (y < 0 || y >= m_Height)
+			continue;
+		span.y = y;
+		span.output = row + (span.x0 - (tile.left - 1)) * channels;
+		RenderSpanPerPacket(span);
+		if (tile.left == 0)
+			memcpy(row, row + channels, sizeof(float) * channels);
+		if (tile.right == m_Width)
+			memcpy(row + (apronWidth - 1) * channels, row + (apronWidth - 2) * channels, sizeof(float) * channels);
+	}
+	if (tile.top == 0)
+		memcpy(once, once + apronRow, sizeof(float) * apronRow);
+	if (tile.bottom == m_Height)
+		memcpy(once + (tileHeight + 1) * apronRow, once + tileHeight * apronRow, sizeof(float) * apronRow);
+	long long sampleCount = (long long)(span.x1 - span.x0) * (std::min(tile.bottom + 1, m_Height) - std::max(tile.top - 1, 0));
+
+	// two pixels per packet; only a tile narrower than TileSize can end in
+	// a lone pixel, so its partner stays inside the buffers, and is ignored
+	Floatx8 threshold(m_SupersampleThreshold);
+	for (int y = tile.top; y < tile.bottom; ++y)
+	{
+		const float* row = once + (size_t)(y - tile.top + 1) * apronRow + channels;
+		float* output = result + (size_t)(y - tile.top) * tileWidth * channels;
+		for (int i = 0; i < tileWidth; i += 2)
+		{
+			const float* center = row + i * channels;
+			Floatx8 value = Floatx8::Load(center);
+			Floatx8 contrast = Max(Max(Abs(Floatx8::Load(center - channels) - value), Abs(Floatx8::Load(center + channels) - value)),
+				Max(Abs(Floatx8::Load(center - apronRow) - value), Abs(Floatx8::Load(center + apronRow) - value)));
+			value.Store(output + i * channels);
 
-	while (m_JobsCompleted < 5);
-}
\ No newline at end of file
+			int edges = MoveMask(contrast > threshold) & (i + 1 < tileWidth ? 0xFF : 0x0F);
+			if ((edges & 0x0F) != 0)
+				sampleCount += ResamplePixel(tile.left + i, y, output + i * channels);
+			if ((edges & 0xF0) != 0)
+				sampleCount += ResamplePixel(tile.left + i + 1, y, output + (i + 1) * channels);
+		}
+	}
+
+	m_SampleCount.fetch_add(sampleCount, std::memory_order_relaxed);
+	return result;
+}
+
+// Averages a jittered sample from each cell of a grid over pixel (x, y),
+// centred where the single sample was taken, into output's four channels.
+// Returns the samples taken.
+int Renderer::ResamplePixel(int x, int y, float* output) const
+{
+	const int channels = PassGraph::Channels;
+	int grid = m_SupersampleGrid;
+	int gridSamples = grid * grid;
+	float cell = 1.0f / grid;
+
+	float sum[channels] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int first = 0; first < gridSamples; first += Colorx8::Width)
+	{
+		float xs[Colorx8::Width];
+		float ys[Colorx8::Width];
+		for (int i = 0; i < Colorx8::Width; ++i)
+		{
+			float jx, jy;
+			int index = first + i;
+			Jitter(x, y, index, jx, jy);
+			xs[i] = x + ((index % grid) + jx) * cell - 0.5f;
+			ys[i] = y + ((index / grid) + jy) * cell - 0.5f;
+		}
+
+		Colorx8 color;
+		m_PacketKernelFunc(Floatx8::Load(xs), Floatx8::Load(ys), m_Width, m_Height, color);
+
+		// lanes past the last sample are dropped
+		int count = std::min(gridSamples - first, (int)Colorx8::Width);
+		float lanes[Colorx8::Width * channels];
+		color.Store(lanes, channels, channels, count);
+		for (int i = 0; i < count; ++i)
+			for (int c = 0; c < channels; ++c)
+				sum[c] += lanes[i * channels + c];
+	}
+	for (int c = 0; c < channels; ++c)
+		output[c] = sum[c] / gridSamples;
+	return gridSamples;
+}
+
+// Writes a row of a PassGraph's output to the span.
+void Renderer::StoreGraphRow(const Span& span, const float* values)
+{
+	int channels = std::min(span.channels, (int)PassGraph::Channels);
+	float* output = span.output;
+
+	for (unsigned int x = span.x0; x < span.x1; ++x)
+	{
+		for (int c = 0; c < channels; ++c)
+			output[c * span.planeStride] = values[c];
+		values += PassGraph::Channels;
+		output += span.stride;
+	}
+	ClearExtraChannels(span);
+}
+
+// Adapter that drives a per-pixel KernelFunc or SourceKernelFunc over a
+// span.
+void Renderer::RenderSpanPerPixel(const Span& span)
+{
+	Color outputColor;
+	int channels = std::min(span.channels, 4);
+	float* output = span.output;
+
+	for (unsigned int x = span.x0; x < span.x1; ++x)
+	{
+		if (m_SourceKernelFunc)
+			m_SourceKernelFunc(x, span.y, span.width, span.height, *span.source, outputColor);
+		else
+			m_KernelFunc(x, span.y, span.width, span.height, outputColor);
+
+		if (span.planeStride == 1)
+			memcpy(output, outputColor.GetValues(), sizeof(float) * channels);
+		else
+			for (int c = 0; c < channels; ++c)
+				output[c * span.planeStride] = outputColor.GetValues()[c];
+		output += span.stride;
+	}
+}
+
+// Adapter that drives a PacketKernelFunc over a span, Colorx8::Width pixels
+// per call.
+void Renderer::RenderSpanPerPacket(const Span& span)
+{
+	Colorx8 outputColor;
+	Floatx8 y((float)span.y);
+	float* output = span.output;
+
+	for (unsigned int x = span.x0; x < span.x1; x += Colorx8::Width)
+	{
+		m_PacketKernelFunc(Floatx8::Ramp((float)x), y, span.width, span.height, outputColor);
+
+		int count = (int)std::min(span.x1 - x, (unsigned int)Colorx8::Width);
+		if (span.planeStride == 1)
+			outputColor.Store(output, span.stride, span.channels, count);
+		else
+			outputColor.StorePlanar(output, span.planeStride, span.channels, count);
+		output += span.stride * Colorx8::Width;
+	}
+}
+
+int Renderer::CountTiles(const Tile& region)
+{
+	int columns = (region.right - region.left + TileSize - 1) / TileSize;
+	int rows = (region.bottom - region.top + TileSize - 1) / TileSize;
+	return columns * rows;
+}
+
+bool Renderer::Render()
+{
+	return Render(m_Bounds);
+}
+
+bool Renderer::Render(const Tile& region, const MaskLayout* mask)
+{
+	PROFILE_ZONE("Render");
+
+	m_Region = region;
+	m_Mask = mask;
+	Reserve((size_t)(region.right - region.left) * (region.bottom - region.top));
+	BuildTiles(region);
+
+	// workers only check the flag between tiles, so a cancel lands within
+	// one tile of work
+	m_TilesDone = 0;
+	m_SampleCount = 0;
+	m_Cancelled = false;
+	int tileCount = (int)m_Tiles.size();
+
+	if (m_CollectStatistics)
+	{
+		Statistics empty;
+		memset(&empty, 0, sizeof(empty));
+		for (int c = 0; c < Statistics::Channels; ++c)
+		{
+			empty.minimum[c] = FLT_MAX;
+			empty.maximum[c] = -FLT_MAX;
+		}
+		m_WorkerStatistics.assign(GetThreadCount(), empty);
+		m_TileSums.assign((size_t)tileCount * Statistics::Channels, 0.0);
+	}
+
+	WorkerPool::TaskFunc task = [this](int tileIndex, int workerIndex)
+	{
+		if (m_Cancelled.load(std::memory_order_relaxed))
+			return;
+		StandardFloatingPoint floatingPoint(m_Deterministic);
+		RenderTile(m_Tiles[tileIndex], workerIndex);
+		m_TilesDone.fetch_add(1, std::memory_order_relaxed);
+	};
+
+	if (!m_Progress)
+	{
+		m_WorkerPool.Run(tileCount, task);
+	}
+	else
+	{
+		m_WorkerPool.Run(tileCount, task, [this, tileCount]
+		{
+			if (!m_Cancelled && !m_Progress(m_TilesDone.load(std::memory_order_relaxed), tileCount))
+				m_Cancelled = true;
+		}, ProgressInterval);
+
+		if (!m_Cancelled && !m_Progress(m_TilesDone, tileCount))
+			m_Cancelled = true;
+	}
+
+	if (m_CollectStatistics && !m_Cancelled)
+		MergeStatistics(region);
+	return !m_Cancelled;
+}
@@ -1,29 +1,318 @@
 #ifndef __RENDERER__
 #define __RENDERER__
 #include "color/color.h"
+#include "color/colorx8.h"
+#include "pixelcopy.h"
+#include "workerpool.h"
+
+class TileCache;
+class PassGraph;
+class PassGraphContext;
+class ShaderProgram;
 
 class Renderer
 {
 public:
-	
+
 	typedef void(*KernelFunc)(const unsigned int& x,
 		const unsigned int& y,
 		const unsigned int& width,
 		const unsigned int& height,
 		Color& outputColor);
 
-	Renderer(KernelFunc kernelFunc, int width, int height, int bytesPerPixel);
-	void Render();
-	inline float* GetPixels() { return m_Pixels; }
+	// A KernelFunc that also reads the input image. Runs only with a source
+	// set, prepared for every pixel the kernel samples.
+	typedef void(*SourceKernelFunc)(const unsigned int& x,
+		const unsigned int& y,
+		const unsigned int& width,
+		const unsigned int& height,
+		const TileCache& source,
+		Color& outputColor);
+
+	// A run of pixels [x0, x1) on row y. output points at channel 0 of pixel
+	// x0; channel c of the i-th pixel is output[i * stride + c * planeStride].
+	// Interleaved targets have stride == channels and planeStride == 1,
+	// planar ones stride == 1. Kernels that produce a Color fill its four
+	// channels and the renderer zeroes any past those; span kernels write
+	// all of them.
+	struct Span
+	{
+		unsigned int y;
+		unsigned int x0;
+		unsigned int x1;
+		unsigned int width;
+		unsigned int height;
+		float* output;
+		int stride;
+		ptrdiff_t planeStride;
+		int channels;
+		const TileCache* source;
+	};
+
+	typedef void(*SpanKernelFunc)(const Span& span);
+
+	// Evaluates Colorx8::Width horizontally adjacent pixels at once: lane i
+	// is pixel (x + i, y). Lanes past the end of a span are computed but
+	// never stored.
+	typedef void(*PacketKernelFunc)(const Floatx8& x,
+		const Floatx8& y,
+		const unsigned int& width,
+		const unsigned int& height,
+		Colorx8& outputColor);
+
+	struct Tile
+	{
+		int left;
+		int top;
+		int right;
+		int bottom;
+	};
+
+	// How the render target stores channels. Planar keeps each channel in
+	// its own cache line aligned plane of packed rows.
+	enum Layout
+	{
+		Interleaved,
+		Planar
+	};
+
+	// The order tiles are handed to the workers in. Each worker starts on a
+	// contiguous run of it, so along a Morton or Hilbert curve the source
+	// pixels a worker samples stay close together and in its cache. Tiled
+	// walks square blocks of tiles row by row, block by block; a block row's
+	// source footprint fits in half of WorkerPool::CacheSize(). Auto takes
+	// Hilbert when a row of tiles' source footprint outgrows the cache, and
+	// rows otherwise.
+	//
+	// Tiles themselves stay TileSize pixels whatever the cache: the
+	// TileCache's grid, the per-worker scratch and the supersampling apron
+	// are sized by it at compile time. The cache size picks the order, and
+	// the block size of Tiled, instead.
+	enum TileOrder
+	{
+		TileOrderRows,
+		TileOrderTiled,
+		TileOrderMorton,
+		TileOrderHilbert,
+		TileOrderAuto
+	};
+
+	// Per-channel statistics of the shaded values, before quantization, of
+	// the pixels a render produced. Histogram bins split [0, 1]; values
+	// outside it count in the end bins. Only the first Channels channels
+	// are covered.
+	struct Statistics
+	{
+		static const int Channels = 4;
+		static const int Bins = 256;
+
+		long long pixelCount;
+		float minimum[Channels];
+		float maximum[Channels];
+		double mean[Channels];
+		unsigned int histogram[Channels][Bins];
+	};
+
+	// Called on the thread running Render() about every ProgressInterval
+	// milliseconds, and once more at the end, with the number of tiles
+	// finished so far. Returning false cancels the render.
+	typedef std::function<bool(int tilesDone, int tileCount)> ProgressFunc;
+
+	static const int TileSize = 64;
+	static const int CacheLineSize = 64;
+	static const int ProgressInterval = 50;
+	static const float DefaultSupersampleThreshold;
+
+	// width and height are the size of the whole image the kernel sees.
+	// threadCount <= 0 sizes the worker pool to the hardware concurrency.
+	Renderer(KernelFunc kernelFunc, int width, int height, int bytesPerPixel, int threadCount = 0);
+	Renderer(SpanKernelFunc spanKernelFunc, int width, int height, int bytesPerPixel, int threadCount = 0);
+	Renderer(PacketKernelFunc packetKernelFunc, int width, int height, int bytesPerPixel, int threadCount = 0);
+	Renderer(SourceKernelFunc sourceKernelFunc, int width, int height, int bytesPerPixel, int threadCount = 0);
+
+	// Renders graph's output; graph must be compiled and outlive the
+	// renderer.
+	Renderer(const PassGraph& graph, int width, int height, int bytesPerPixel, int threadCount = 0);
+
+	// Runs a compiled shader program, which must outlive the renderer.
+	Renderer(const ShaderProgram& program, int width, int height, int bytesPerPixel, int threadCount = 0);
+	~Renderer();
+
+	// Swap what is rendered between renders, keeping the workers and the
+	// pixel buffer, so one renderer can serve a whole batch of filter runs.
+	void SetKernel(KernelFunc kernelFunc);
+	void SetKernel(SpanKernelFunc spanKernelFunc);
+	void SetKernel(PacketKernelFunc packetKernelFunc);
+	void SetKernel(SourceKernelFunc sourceKernelFunc);
+	void SetKernel(const PassGraph& graph);
+	void SetKernel(const ShaderProgram& program);
+	void SetBytesPerPixel(int bytesPerPixel);
+	inline int GetBytesPerPixel() const { return m_BytesPerPixel; }
+
+	// Frees the pixel buffer, back to the BufferArena pool, and the pass
+	// graph images, e.g. when the host is short of memory; the next render
+	// allocates them again.
+	void ReleaseMemory();
+
+	// Bytes held by the pixel buffer, which only grows between
+	// ReleaseMemory calls.
+	inline size_t GetMemoryUsage() const { return m_Capacity; }
+
+	// Renders the bounds, by default the whole image. Returns false if the
+	// render was cancelled, leaving the pixels partly rendered.
+	bool Render();
+
+	// Renders only region, which must lie inside the image. GetPixels() then
+	// holds just that region, rows of (right - left) pixels. The pixel buffer
+	// only grows to the largest region rendered, so streaming an image
+	// through small regions never allocates the whole image.
+	//
+	// With a mask, whose rows start at the region's top left, only the
+	// selected part of each row is rendered; the rest of the buffer is left
+	// as it was, for PixelCopy::BlendRows to pass over.
+	bool Render(const Tile& region, const MaskLayout* mask = 0);
+
+	// Stops the render in flight, from any thread: each worker finishes the
+	// tile it is on and skips the rest.
+	inline void Cancel() { m_Cancelled = true; }
+
+	// The input image kernels sample, handed to span kernels in Span::source.
+	inline void SetSource(const TileCache* source) { m_Source = source; }
+
+	inline void SetProgressCallback(const ProgressFunc& progress) { m_Progress = progress; }
+
+	// Number of tiles Render(region) splits region into.
+	static int CountTiles(const Tile& region);
+
+	// depth is 8, 16 or 32 bits per sample. At 8 and 16 bits each span is
+	// quantized as soon as it is rendered (to 0-255 and 0-32768, the host's
+	// ranges), optionally with ordered dithering, so no float image is kept.
+	void SetOutputDepth(int depth, bool dither = false);
+
+	// Limits Render() to bounds, e.g. a selection's bounding rect, while the
+	// kernel keeps seeing image coordinates and the whole image's size.
+	inline void SetBounds(const Tile& bounds) { m_Bounds = bounds; }
+	inline const Tile& GetBounds() const { return m_Bounds; }
+
+	// Changes the image size the kernel sees, e.g. to render a scaled copy.
+	// Regions passed to Render must lie inside the new size. Resets the
+	// bounds to the whole image.
+	void SetImageSize(int width, int height);
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+
+	void SetLayout(Layout layout);
+	inline Layout GetLayout() const { return m_Layout; }
+
+	inline void SetTileOrder(TileOrder order) { m_TileOrder = order; }
+	inline TileOrder GetTileOrder() const { return m_TileOrder; }
+
+	// Adaptive anti-aliasing for packet kernels, which take subpixel
+	// positions. Each tile is sampled once per pixel first; only pixels
+	// differing from a neighbour by more than threshold in some channel are
+	// resampled, on a jittered grid x grid of positions and averaged, so
+	// flat areas cost little more than one sample. grid 1 turns it off.
+	void SetSupersampling(int grid, float threshold = DefaultSupersampleThreshold);
+	inline int GetSupersampling() const { return m_SupersampleGrid; }
+
+	// Kernel evaluations the last render made while supersampling.
+	inline long long GetSampleCount() const { return m_SampleCount; }
+
+	// Gathers Statistics while rendering, from each row while it is still in
+	// cache. Every worker keeps its own counts and each tile its own sums,
+	// merged in the tiles' positions in the image, so the results are the
+	// same for any worker count and tile order.
+	inline void SetCollectStatistics(bool collect) { m_CollectStatistics = collect; }
+	inline bool GetCollectStatistics() const { return m_CollectStatistics; }
+
+	// Of the last render that completed with statistics on.
+	inline const Statistics& GetStatistics() const { return m_Statistics; }
+
+	// Output and Statistics never depend on which worker renders a tile or
+	// in what order. Deterministic renders also pin the floating-point mode
+	// each tile runs in to round-to-nearest with denormals kept, instead of
+	// whatever the workers inherited from the host (flush-to-zero, say), so
+	// the same inputs give bit-identical pixels on any run. The workers'
+	// own mode is put back after each tile.
+	inline void SetDeterministic(bool deterministic) { m_Deterministic = deterministic; }
+	inline bool GetDeterministic() const { return m_Deterministic; }
+
+	// Samples of GetOutputDepth() bits in the layout GetPixelLayout()
+	// describes; GetPixels() is only meaningful at 32 bits.
+	inline void* GetPixelData() { return m_Pixels; }
+	PixelLayout GetPixelLayout() const;
+	inline float* GetPixels() { return reinterpret_cast<float*>(m_Pixels); }
+	inline const Tile& GetRegion() const { return m_Region; }
+	inline int GetOutputDepth() const { return m_Depth; }
+	inline int GetThreadCount() const { return m_WorkerPool.GetWorkerCount(); }
+
+	// The pool Render() runs on, free for other work between renders.
+	inline WorkerPool& GetWorkerPool() { return m_WorkerPool; }
 
 private:
 
+	Renderer(const Renderer&);
+	Renderer& operator =(const Renderer&);
+
+	// Everything but the kernel, which each public constructor then sets.
+	Renderer(int width, int height, int bytesPerPixel, int threadCount);
+
+	// floats in a supersampled tile's first pass: four channels over the
+	// tile and a one pixel apron
+	static const size_t SampleApronFloats = (TileSize + 2) * (TileSize + 2) * 4;
+
+	void ClearKernel();
+	void Reserve(size_t pixelCount);
+	void BuildTiles(const Tile& region);
+	void RenderTile(const Tile& tile, int workerIndex);
+	const float* SupersampleTile(const Tile& tile, int workerIndex);
+	int ResamplePixel(int x, int y, float* output) const;
+	void RenderSpan(const Span& span);
+	void AccumulateRow(const Span& span, Statistics& statistics, double* sums) const;
+	void MergeStatistics(const Tile& region);
+	void StoreGraphRow(const Span& span, const float* values);
+	void QuantizeRow(const float* source, const float* offsets, unsigned char* output, int count) const;
+	void UpdateOutputTables();
+	void RenderSpanPerPixel(const Span& span);
+	void RenderSpanPerPacket(const Span& span);
+
 	KernelFunc m_KernelFunc;
+	SpanKernelFunc m_SpanKernelFunc;
+	PacketKernelFunc m_PacketKernelFunc;
+	SourceKernelFunc m_SourceKernelFunc;
+	const TileCache* m_Source;
+	const PassGraph* m_Graph;
+	std::vector<std::unique_ptr<PassGraphContext> > m_GraphContexts;
+	const ShaderProgram* m_Program;
 	int m_Width;
 	int m_Height;
 	int m_BytesPerPixel;
-	int m_JobsCompleted;
-	float *m_Pixels;
+	int m_Depth;
+	bool m_Dither;
+	Layout m_Layout;
+	TileOrder m_TileOrder;
+	int m_SupersampleGrid;
+	float m_SupersampleThreshold;
+	std::vector<std::vector<float> > m_SampleTiles;
+	std::atomic<long long> m_SampleCount;
+	bool m_CollectStatistics;
+	bool m_Deterministic;
+	Statistics m_Statistics;
+	std::vector<Statistics> m_WorkerStatistics;
+	std::vector<double> m_TileSums;
+	unsigned char *m_Pixels;
+	size_t m_Capacity;
+	size_t m_PlaneBytes;
+	std::vector<float> m_SpanScratch;
+	std::vector<float> m_QuantizeOffsets;
+	Tile m_Bounds;
+	Tile m_Region;
+	const MaskLayout* m_Mask;
+	std::vector<Tile> m_Tiles;
+	ProgressFunc m_Progress;
+	std::atomic<int> m_TilesDone;
+	std::atomic<bool> m_Cancelled;
+	WorkerPool m_WorkerPool;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,177 @@
+#include "tilecache.h"
+#include "time/profiler.h"
+#include <math.h>
+
+namespace
+{
+	// Converts rows of a fetched rect at the host depth to float samples.
+	template <class T>
+	void ConvertTile(const PixelLayout& pixels, int x0, int y0, int width, int height, int channels,
+		float scale, float* output, int outputStride)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			const unsigned char* row = static_cast<const unsigned char*>(pixels.data) + (y0 + y) * pixels.rowBytes + x0 * pixels.columnBytes;
+			float* samples = output + (size_t)y * outputStride * channels;
+			for (int x = 0; x < width; ++x)
+			{
+				for (int c = 0; c < channels; ++c)
+					samples[c] = *reinterpret_cast<const T*>(row + c * pixels.planeBytes) * scale;
+				row += pixels.columnBytes;
+				samples += channels;
+			}
+		}
+	}
+}
+
+const int TileCache::TileSize;
+
+TileCache::TileCache(const FetchFunc& fetch, int width, int height, int channels, int depth, int capacity)
+	: m_Fetch(fetch)
+	, m_Width(width)
+	, m_Height(height)
+	, m_Channels(channels)
+	, m_Depth(depth)
+	, m_Columns((width + TileSize - 1) / TileSize)
+	, m_Rows((height + TileSize - 1) / TileSize)
+	, m_Capacity(std::max(capacity, 1))
+	, m_Slots((size_t)m_Columns * m_Rows, -1)
+	, m_Stamp(0)
+	, m_FetchCount(0)
+{
+}
+
+bool TileCache::Prepare(const Renderer::Tile& rect)
+{
+	int left = std::max(rect.left, 0);
+	int top = std::max(rect.top, 0);
+	int right = std::min(rect.right, m_Width);
+	int bottom = std::min(rect.bottom, m_Height);
+	if (left >= right || top >= bottom)
+		return true;
+
+	PROFILE_ZONE("PrepareInput");
+
+	// tiles stamped now are in use and never evicted by this call
+	++m_Stamp;
+	int firstColumn = left / TileSize;
+	int lastColumn = (right - 1) / TileSize;
+	for (int row = top / TileSize; row <= (bottom - 1) / TileSize; ++row)
+	{
+		for (int column = firstColumn; column <= lastColumn; ++column)
+		{
+			int slot = m_Slots[row * m_Columns + column];
+			if (slot >= 0)
+				m_SlotStamps[slot] = m_Stamp;
+		}
+
+		for (int column = firstColumn; column <= lastColumn; )
+		{
+			if (m_Slots[row * m_Columns + column] >= 0)
+			{
+				++column;
+				continue;
+			}
+
+			int end = column;
+			while (end + 1 <= lastColumn && m_Slots[row * m_Columns + end + 1] < 0)
+				++end;
+			if (!FetchRun(row, column, end))
+				return false;
+			column = end + 1;
+		}
+	}
+	return true;
+}
+
+int TileCache::AllocateSlot()
+{
+	int slotCount = (int)m_SlotTiles.size();
+
+	// slots a failed fetch gave back hold no tile and go first
+	for (int slot = 0; slot < slotCount; ++slot)
+		if (m_SlotTiles[slot] < 0)
+			return slot;
+
+	int oldest = -1;
+	if (slotCount >= m_Capacity)
+	{
+		for (int slot = 0; slot < slotCount; ++slot)
+			if (m_SlotStamps[slot] != m_Stamp && (oldest < 0 || m_SlotStamps[slot] < m_SlotStamps[oldest]))
+				oldest = slot;
+	}
+
+	if (oldest >= 0)
+	{
+		m_Slots[m_SlotTiles[oldest]] = -1;
+		return oldest;
+	}
+
+	// below capacity, or everything resident is needed right now
+	m_SlotTiles.push_back(-1);
+	m_SlotStamps.push_back(0);
+	m_Samples.resize(m_SlotTiles.size() * TileSize * TileSize * m_Channels);
+	return slotCount;
+}
+
+// Fetches tiles [firstColumn, lastColumn] of row in one request.
+bool TileCache::FetchRun(int row, int firstColumn, int lastColumn)
+{
+	for (int column = firstColumn; column <= lastColumn; ++column)
+	{
+		int tile = row * m_Columns + column;
+		int slot = AllocateSlot();
+		m_SlotTiles[slot] = tile;
+		m_SlotStamps[slot] = m_Stamp;
+		m_Slots[tile] = slot;
+	}
+
+	Renderer::Tile rect;
+	rect.left = firstColumn * TileSize;
+	rect.top = row * TileSize;
+	rect.right = std::min((lastColumn + 1) * TileSize, m_Width);
+	rect.bottom = std::min((row + 1) * TileSize, m_Height);
+
+	PixelLayout pixels;
+	++m_FetchCount;
+	if (!m_Fetch(rect, pixels))
+	{
+		for (int column = firstColumn; column <= lastColumn; ++column)
+		{
+			int& slot = m_Slots[row * m_Columns + column];
+			m_SlotTiles[slot] = -1;
+			slot = -1;
+		}
+		return false;
+	}
+
+	int height = rect.bottom - rect.top;
+	for (int column = firstColumn; column <= lastColumn; ++column)
+	{
+		int x0 = (column - firstColumn) * TileSize;
+		int width = std::min(TileSize, rect.right - rect.left - x0);
+		float* output = &m_Samples[(size_t)m_Slots[row * m_Columns + column] * TileSize * TileSize * m_Channels];
+
+		if (m_Depth == 8)
+			ConvertTile<unsigned char>(pixels, x0, 0, width, height, m_Channels, 1.0f / 255.0f, output, TileSize);
+		else if (m_Depth == 16)
+			ConvertTile<unsigned short>(pixels, x0, 0, width, height, m_Channels, 1.0f / 32768.0f, output, TileSize);
+		else
+			ConvertTile<float>(pixels, x0, 0, width, height, m_Channels, 1.0f, output, TileSize);
+	}
+	return true;
+}
+
+Color TileCache::SampleBilinear(float u, float v) const
+{
+	float x = u * m_Width - 0.5f;
+	float y = v * m_Height - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float tx = x - x0;
+	float ty = y - y0;
+
+	Color top = Color::Lerp(Sample((int)x0, (int)y0), Sample((int)x0 + 1, (int)y0), tx);
+	Color bottom = Color::Lerp(Sample((int)x0, (int)y0 + 1), Sample((int)x0 + 1, (int)y0 + 1), tx);
+	return Color::Lerp(top, bottom, ty);
+}
@@ -0,0 +1,88 @@
+#ifndef __TILECACHE__
+#define __TILECACHE__
+#include "renderer.h"
+#include "color/color.h"
+#include <functional>
+#include <vector>
+
+// Read access to the host's input image for kernels, held as a grid of
+// TileSize squares of float samples in [0, 1]. Only the tiles Prepare() has
+// been asked for are resident; the least recently prepared ones are evicted
+// once capacity tiles are held.
+//
+// Prepare() fetches from the host and must run on the host's thread between
+// renders. The Sample functions only read and are safe from any worker.
+class TileCache
+{
+public:
+
+	// Asks the host for the samples of rect and describes where they are,
+	// valid until the next fetch. Returns false on failure.
+	typedef std::function<bool(const Renderer::Tile& rect, PixelLayout& pixels)> FetchFunc;
+
+	static const int TileSize = Renderer::TileSize;
+
+	// width and height are the size of the host image and depth its bits
+	// per sample: 8, 16 or 32.
+	TileCache(const FetchFunc& fetch, int width, int height, int channels, int depth, int capacity);
+
+	// Makes every tile overlapping rect (clipped to the image) resident.
+	// Missing tiles next to each other in a row are fetched in one request.
+	// Returns false if a fetch failed.
+	bool Prepare(const Renderer::Tile& rect);
+
+	// Pixel (x, y), clamped to the image edge. Channels past the host's are
+	// 0; pixels outside the prepared tiles read as 0.
+	inline Color Sample(int x, int y) const
+	{
+		float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		x = std::min(std::max(x, 0), m_Width - 1);
+		y = std::min(std::max(y, 0), m_Height - 1);
+
+		int slot = m_Slots[(y / TileSize) * m_Columns + x / TileSize];
+		if (slot >= 0)
+		{
+			const float* pixel = &m_Samples[((size_t)slot * TileSize * TileSize + (y % TileSize) * TileSize + x % TileSize) * m_Channels];
+			for (int c = 0; c < std::min(m_Channels, 4); ++c)
+				values[c] = pixel[c];
+		}
+		return Color(values[0], values[1], values[2], values[3]);
+	}
+
+	// Bilinear filtered sample at normalized image coordinates: (0, 0) is
+	// the top left corner of the image and (1, 1) the bottom right.
+	Color SampleBilinear(float u, float v) const;
+
+	inline int GetWidth() const { return m_Width; }
+	inline int GetHeight() const { return m_Height; }
+	inline int GetChannels() const { return m_Channels; }
+	inline int GetFetchCount() const { return m_FetchCount; }
+
+private:
+
+	TileCache(const TileCache&);
+	TileCache& operator =(const TileCache&);
+
+	int AllocateSlot();
+	bool FetchRun(int row, int firstColumn, int lastColumn);
+
+	FetchFunc m_Fetch;
+	int m_Width;
+	int m_Height;
+	int m_Channels;
+	int m_Depth;
+	int m_Columns;
+	int m_Rows;
+	int m_Capacity;
+
+	// tile index (row * columns + column) to slot, or -1
+	std::vector<int> m_Slots;
+	// per slot: the tile it holds, or -1, and when it was last prepared
+	std::vector<int> m_SlotTiles;
+	std::vector<unsigned int> m_SlotStamps;
+	std::vector<float> m_Samples;
+	unsigned int m_Stamp;
+	int m_FetchCount;
+};
+
+#endif
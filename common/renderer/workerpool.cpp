@@ -0,0 +1,197 @@
+#include "workerpool.h"
+#include <stdio.h>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#elif defined(__APPLE__)
+	#include <sys/sysctl.h>
+#else
+	#include <unistd.h>
+#endif
+
+namespace
+{
+	size_t QueryCacheSize()
+	{
+#if defined(_WIN32)
+		DWORD bytes = 0;
+		GetLogicalProcessorInformation(NULL, &bytes);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(bytes / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (!info.empty() && GetLogicalProcessorInformation(&info[0], &bytes))
+		{
+			for (size_t i = 0; i < info.size(); ++i)
+				if (info[i].Relationship == RelationCache && info[i].Cache.Level == 2)
+					return info[i].Cache.Size;
+		}
+#elif defined(__APPLE__)
+		size_t size = 0;
+		size_t length = sizeof(size);
+		if (sysctlbyname("hw.l2cachesize", &size, &length, NULL, 0) == 0 && size > 0)
+			return size;
+#else
+	#if defined(_SC_LEVEL2_CACHE_SIZE)
+		long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		if (size > 0)
+			return (size_t)size;
+	#endif
+		// e.g. "1024K"
+		FILE* file = fopen("/sys/devices/system/cpu/cpu0/cache/index2/size", "r");
+		if (file != NULL)
+		{
+			unsigned long value = 0;
+			char unit = 0;
+			int fields = fscanf(file, "%lu%c", &value, &unit);
+			fclose(file);
+			if (fields >= 1 && value > 0)
+				return (size_t)value * (unit == 'K' ? 1024 : unit == 'M' ? 1024 * 1024 : 1);
+		}
+#endif
+		return 256 * 1024;
+	}
+}
+
+WorkerPool::WorkerPool(int workerCount)
+	: m_Task(0)
+	, m_TasksRemaining(0)
+	, m_Generation(0)
+	, m_Shutdown(false)
+{
+	if (workerCount <= 0)
+		workerCount = DefaultWorkerCount();
+
+	for (int i = 0; i < workerCount; ++i)
+		m_Queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+
+	for (int i = 0; i < workerCount; ++i)
+		m_Workers.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Shutdown = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (size_t i = 0; i < m_Workers.size(); ++i)
+		m_Workers[i].join();
+}
+
+int WorkerPool::DefaultWorkerCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? (int)count : 1;
+}
+
+size_t WorkerPool::CacheSize()
+{
+	static const size_t size = QueryCacheSize();
+	return size;
+}
+
+void WorkerPool::Run(int taskCount, const TaskFunc& task)
+{
+	Run(taskCount, task, PollFunc(), 0);
+}
+
+void WorkerPool::Run(int taskCount, const TaskFunc& task, const PollFunc& poll, int pollIntervalMs)
+{
+	if (taskCount <= 0)
+		return;
+
+	m_Task = &task;
+	m_TasksRemaining = taskCount;
+
+	// hand each worker a contiguous block so neighbouring tasks start out on
+	// the same thread; stealing evens things out when some blocks run long
+	int workerCount = GetWorkerCount();
+	for (int worker = 0; worker < workerCount; ++worker)
+	{
+		int first = (int)((long long)taskCount * worker / workerCount);
+		int last = (int)((long long)taskCount * (worker + 1) / workerCount);
+
+		WorkQueue& queue = *m_Queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (int i = first; i < last; ++i)
+			queue.tasks.push_back(i);
+	}
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	++m_Generation;
+	m_WorkAvailable.notify_all();
+	if (!poll)
+	{
+		m_WorkDone.wait(lock, [this] { return m_TasksRemaining == 0; });
+	}
+	else
+	{
+		std::chrono::milliseconds interval(pollIntervalMs);
+		while (!m_WorkDone.wait_for(lock, interval, [this] { return m_TasksRemaining == 0; }))
+		{
+			lock.unlock();
+			poll();
+			lock.lock();
+		}
+	}
+	m_Task = 0;
+}
+
+void WorkerPool::WorkerLoop(int workerIndex)
+{
+	unsigned int seenGeneration = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkAvailable.wait(lock, [&] { return m_Shutdown || m_Generation != seenGeneration; });
+			if (m_Shutdown)
+				return;
+			seenGeneration = m_Generation;
+		}
+
+		int taskIndex;
+		while (PopTask(workerIndex, taskIndex) || StealTask(workerIndex, taskIndex))
+		{
+			(*m_Task)(taskIndex, workerIndex);
+
+			if (--m_TasksRemaining == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_WorkDone.notify_all();
+			}
+		}
+	}
+}
+
+bool WorkerPool::PopTask(int workerIndex, int& taskIndex)
+{
+	WorkQueue& queue = *m_Queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+
+	taskIndex = queue.tasks.front();
+	queue.tasks.pop_front();
+	return true;
+}
+
+bool WorkerPool::StealTask(int workerIndex, int& taskIndex)
+{
+	int workerCount = GetWorkerCount();
+	for (int offset = 1; offset < workerCount; ++offset)
+	{
+		WorkQueue& victim = *m_Queues[(workerIndex + offset) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty())
+			continue;
+
+		taskIndex = victim.tasks.back();
+		victim.tasks.pop_back();
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,71 @@
+#ifndef __WORKERPOOL__
+#define __WORKERPOOL__
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads. Each call to Run() hands out task indices
+// through per-worker deques; a worker drains its own deque from the front and,
+// once empty, steals from the back of the other workers' deques.
+class WorkerPool
+{
+public:
+
+	typedef std::function<void(int taskIndex, int workerIndex)> TaskFunc;
+	typedef std::function<void()> PollFunc;
+
+	// workerCount <= 0 uses std::thread::hardware_concurrency().
+	explicit WorkerPool(int workerCount = 0);
+	~WorkerPool();
+
+	// Runs task(i, worker) for every i in [0, taskCount) and blocks until all
+	// of them have completed. Not reentrant.
+	void Run(int taskCount, const TaskFunc& task);
+
+	// Same, but while waiting calls poll on the calling thread every
+	// pollIntervalMs, e.g. to talk to a host that must not be called from
+	// the workers.
+	void Run(int taskCount, const TaskFunc& task, const PollFunc& poll, int pollIntervalMs);
+
+	inline int GetWorkerCount() const { return (int)m_Queues.size(); }
+
+	static int DefaultWorkerCount();
+
+	// Bytes of the per-core (L2) cache a worker runs in, as the OS reports
+	// it; 256 KB when it does not.
+	static size_t CacheSize();
+
+private:
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<int> tasks;
+	};
+
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator =(const WorkerPool&);
+
+	void WorkerLoop(int workerIndex);
+	bool PopTask(int workerIndex, int& taskIndex);
+	bool StealTask(int workerIndex, int& taskIndex);
+
+	std::vector<std::thread> m_Workers;
+	std::vector<std::unique_ptr<WorkQueue> > m_Queues;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkAvailable;
+	std::condition_variable m_WorkDone;
+	const TaskFunc* m_Task;
+	std::atomic<int> m_TasksRemaining;
+	unsigned int m_Generation;
+	bool m_Shutdown;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "shadercache.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	// A cache file: the source's length and text, then ShaderProgram::Write.
+	typedef uint32_t SourceLength;
+}
+
+ShaderCache::ShaderCache()
+{
+}
+
+const ShaderProgram* ShaderCache::Get(const std::string& source, std::string& error)
+{
+	uint64_t hash = Hash(source);
+	std::map<uint64_t, Entry>::iterator found = m_Entries.find(hash);
+	if (found != m_Entries.end() && found->second.source == source)
+		return found->second.program.get();
+
+	std::unique_ptr<ShaderProgram> program(new ShaderProgram());
+	if (!ReadFile(hash, source, *program))
+	{
+		if (!program->Compile(source, error))
+			return 0;
+		WriteFile(hash, source, *program);
+	}
+
+	Entry& entry = m_Entries[hash];
+	entry.source = source;
+	entry.program = std::move(program);
+	return entry.program.get();
+}
+
+void ShaderCache::Clear()
+{
+	m_Entries.clear();
+}
+
+uint64_t ShaderCache::Hash(const std::string& source)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < source.size(); ++i)
+		hash = (hash ^ (unsigned char)source[i]) * 1099511628211ull;
+	return (hash ^ (uint64_t)ShaderProgram::BytecodeVersion) * 1099511628211ull;
+}
+
+std::string ShaderCache::GetPath(uint64_t hash) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.sfbc", (unsigned long long)hash);
+	char last = m_Directory[m_Directory.size() - 1];
+	return last == '/' || last == '\\' ? m_Directory + name : m_Directory + "/" + name;
+}
+
+bool ShaderCache::ReadFile(uint64_t hash, const std::string& source, ShaderProgram& program) const
+{
+	if (m_Directory.empty())
+		return false;
+
+	FILE* file = fopen(GetPath(hash).c_str(), "rb");
+	if (file == NULL)
+		return false;
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+	fclose(file);
+
+	SourceLength length;
+	if (data.size() < sizeof(length))
+		return false;
+	memcpy(&length, &data[0], sizeof(length));
+	size_t offset = sizeof(length) + length;
+	if (length != source.size() || data.size() < offset ||
+		source.compare(0, length, reinterpret_cast<const char*>(&data[sizeof(length)]), length) != 0)
+		return false;
+	return program.Read(&data[0] + offset, data.size() - offset);
+}
+
+// Writes next to the final name and renames, so a reader never sees half a
+// file. Failing to write only costs the next process a compile.
+void ShaderCache::WriteFile(uint64_t hash, const std::string& source, const ShaderProgram& program) const
+{
+	if (m_Directory.empty())
+		return;
+
+	std::vector<unsigned char> data;
+	program.Write(data);
+	SourceLength length = (SourceLength)source.size();
+
+	std::string path = GetPath(hash);
+	std::string temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == NULL)
+		return;
+	bool written = fwrite(&length, sizeof(length), 1, file) == 1 &&
+		fwrite(source.data(), 1, source.size(), file) == source.size() &&
+		fwrite(&data[0], 1, data.size(), file) == data.size();
+	if (fclose(file) != 0 || !written || rename(temporary.c_str(), path.c_str()) != 0)
+		remove(temporary.c_str());
+}
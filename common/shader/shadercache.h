@@ -0,0 +1,52 @@
+#ifndef __SHADERCACHE__
+#define __SHADERCACHE__
+#include "shaderprogram.h"
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+
+// Compiled ShaderPrograms keyed by a hash of their source. Programs are kept
+// for the life of the cache and, given a directory, written there so the
+// next process running the same shader reads the bytecode instead of
+// compiling it. Files are named by the hash and hold the source they were
+// compiled from, so a collision or a stale file is just a miss.
+//
+// Not thread safe: meant for the host's thread.
+class ShaderCache
+{
+public:
+
+	ShaderCache();
+
+	// Where compiled programs persist; empty, the default, keeps them in
+	// memory only. The directory must exist.
+	inline void SetDirectory(const std::string& directory) { m_Directory = directory; }
+	inline const std::string& GetDirectory() const { return m_Directory; }
+
+	// The program compiled from source, owned by the cache, or null with
+	// the compiler's error.
+	const ShaderProgram* Get(const std::string& source, std::string& error);
+
+	void Clear();
+
+	// FNV-1a over source and ShaderProgram::BytecodeVersion.
+	static uint64_t Hash(const std::string& source);
+
+private:
+
+	struct Entry
+	{
+		std::string source;
+		std::unique_ptr<ShaderProgram> program;
+	};
+
+	std::string GetPath(uint64_t hash) const;
+	bool ReadFile(uint64_t hash, const std::string& source, ShaderProgram& program) const;
+	void WriteFile(uint64_t hash, const std::string& source, const ShaderProgram& program) const;
+
+	std::map<uint64_t, Entry> m_Entries;
+	std::string m_Directory;
+};
+
+#endif
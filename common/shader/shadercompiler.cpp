@@ -0,0 +1,588 @@
+#include "shaderprogram.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+namespace
+{
+	enum TokenType
+	{
+		TokenEnd,
+		TokenNumber,
+		TokenName,
+		TokenSymbol
+	};
+
+	struct Token
+	{
+		TokenType type;
+		std::string text;
+		float value;
+		int line;
+	};
+
+	// Operands while compiling: fixed registers as they are, constants and
+	// locals tagged until the final register layout is known.
+	const int ConstantTag = 0x4000;
+	const int LocalTag = 0x8000;
+	const int TagMask = 0xC000;
+	const int TagRange = 0x4000;		// indices per tag
+
+	struct FixedName
+	{
+		const char* name;
+		int reg;
+		bool writable;
+	};
+
+	const FixedName s_FixedNames[] =
+	{
+		{ "x", ShaderProgram::RegisterX, false },
+		{ "y", ShaderProgram::RegisterY, false },
+		{ "width", ShaderProgram::RegisterWidth, false },
+		{ "height", ShaderProgram::RegisterHeight, false },
+		{ "uv.x", ShaderProgram::RegisterU, false },
+		{ "uv.y", ShaderProgram::RegisterV, false },
+		{ "src.r", ShaderProgram::RegisterSourceR, false },
+		{ "src.g", ShaderProgram::RegisterSourceG, false },
+		{ "src.b", ShaderProgram::RegisterSourceB, false },
+		{ "src.a", ShaderProgram::RegisterSourceA, false },
+		{ "out.r", ShaderProgram::RegisterOutR, true },
+		{ "out.g", ShaderProgram::RegisterOutG, true },
+		{ "out.b", ShaderProgram::RegisterOutB, true },
+		{ "out.a", ShaderProgram::RegisterOutA, true },
+	};
+}
+
+// Recursive descent parser that emits bytecode as it goes. Every expression
+// result lands in a fresh temporary; temporaries are recycled per statement.
+class ShaderCompiler
+{
+public:
+
+	ShaderCompiler(const std::string& source, ShaderProgram& program)
+		: m_Source(source)
+		, m_Position(0)
+		, m_Line(1)
+		, m_Program(program)
+		, m_LocalCount(0)
+		, m_NextTemp(0)
+		, m_Failed(false)
+	{
+	}
+
+	bool Compile(std::string& error)
+	{
+		Next();
+		while (!m_Failed && m_Token.type != TokenEnd)
+			Statement();
+
+		if (m_Failed)
+		{
+			error = m_Error;
+			return false;
+		}
+
+		Relocate();
+		return true;
+	}
+
+private:
+
+	// Lexer ---------------------------------------------------------------
+
+	void Next()
+	{
+		// whitespace and // comments
+		for (;;)
+		{
+			while (m_Position < m_Source.size() && isspace((unsigned char)m_Source[m_Position]))
+			{
+				if (m_Source[m_Position] == '\n')
+					++m_Line;
+				++m_Position;
+			}
+			if (m_Source.compare(m_Position, 2, "//") != 0)
+				break;
+			while (m_Position < m_Source.size() && m_Source[m_Position] != '\n')
+				++m_Position;
+		}
+
+		m_Token.line = m_Line;
+		m_Token.text.clear();
+		m_Token.value = 0.0f;
+		if (m_Position >= m_Source.size())
+		{
+			m_Token.type = TokenEnd;
+			return;
+		}
+
+		const char* start = m_Source.c_str() + m_Position;
+		char c = *start;
+		if (isdigit((unsigned char)c) || (c == '.' && isdigit((unsigned char)start[1])))
+		{
+			char* end;
+			m_Token.type = TokenNumber;
+			m_Token.value = (float)strtod(start, &end);
+			m_Token.text.assign(start, (size_t)(end - start));
+			m_Position += end - start;
+			return;
+		}
+
+		if (isalpha((unsigned char)c) || c == '_')
+		{
+			// a name, with an optional .component
+			size_t end = m_Position;
+			while (end < m_Source.size() && (isalnum((unsigned char)m_Source[end]) || m_Source[end] == '_'))
+				++end;
+			if (end + 1 < m_Source.size() && m_Source[end] == '.' && isalpha((unsigned char)m_Source[end + 1]))
+			{
+				++end;
+				while (end < m_Source.size() && isalnum((unsigned char)m_Source[end]))
+					++end;
+			}
+			m_Token.type = TokenName;
+			m_Token.text = m_Source.substr(m_Position, end - m_Position);
+			m_Position = end;
+			return;
+		}
+
+		static const char* symbols[] = { "<=", ">=", "==", "!=", "+", "-", "*", "/", "(", ")", ",", ";", "=", "<", ">", "?", ":" };
+		for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); ++i)
+		{
+			size_t length = strlen(symbols[i]);
+			if (m_Source.compare(m_Position, length, symbols[i]) == 0)
+			{
+				m_Token.type = TokenSymbol;
+				m_Token.text = symbols[i];
+				m_Position += length;
+				return;
+			}
+		}
+
+		Fail(std::string("unexpected character '") + c + "'");
+		m_Token.type = TokenEnd;
+	}
+
+	inline bool IsSymbol(const char* symbol) const
+	{
+		return m_Token.type == TokenSymbol && m_Token.text == symbol;
+	}
+
+	void Expect(const char* symbol)
+	{
+		if (!IsSymbol(symbol))
+			Fail(std::string("expected '") + symbol + "'");
+		else
+			Next();
+	}
+
+	void Fail(const std::string& message)
+	{
+		if (m_Failed)
+			return;
+
+		char line[32];
+		sprintf(line, "line %d: ", m_Token.line);
+		m_Error = line + message;
+		if (!m_Token.text.empty())
+			m_Error += " near '" + m_Token.text + "'";
+		m_Failed = true;
+	}
+
+	// Parser --------------------------------------------------------------
+
+	void Statement()
+	{
+		m_NextTemp = m_LocalCount;
+		int firstTemp = m_NextTemp;
+		size_t firstInstruction = m_Program.m_Code.size();
+
+		bool declaration = m_Token.type == TokenName && m_Token.text == "float";
+		if (declaration)
+			Next();
+		if (m_Token.type != TokenName)
+		{
+			Fail("expected a name");
+			return;
+		}
+
+		std::string name = m_Token.text;
+		Next();
+		Expect("=");
+		int value = Expression();
+		Expect(";");
+		if (m_Failed)
+			return;
+
+		int target = -1;
+		for (size_t i = 0; i < sizeof(s_FixedNames) / sizeof(s_FixedNames[0]); ++i)
+		{
+			if (name == s_FixedNames[i].name)
+			{
+				if (!s_FixedNames[i].writable || declaration)
+				{
+					Fail("cannot assign to " + name);
+					return;
+				}
+				target = s_FixedNames[i].reg;
+			}
+		}
+
+		if (target < 0)
+		{
+			std::map<std::string, int>::iterator variable = m_Variables.find(name);
+			if (declaration)
+			{
+				if (variable != m_Variables.end() || name.find('.') != std::string::npos)
+				{
+					Fail("cannot declare " + name);
+					return;
+				}
+				target = Tagged(LocalTag, m_LocalCount++, "variables");
+				m_Variables[name] = target;
+			}
+			else if (variable == m_Variables.end())
+			{
+				Fail("unknown name " + name);
+				return;
+			}
+			else
+			{
+				target = variable->second;
+			}
+		}
+
+		// write the last result straight into the target when it is the
+		// temporary the expression ended in
+		std::vector<ShaderProgram::Instruction>& code = m_Program.m_Code;
+		if (code.size() > firstInstruction && code.back().dst == value && (value & TagMask) == LocalTag && (value & ~TagMask) >= firstTemp)
+			code.back().dst = (unsigned short)target;
+		else
+			Emit(ShaderProgram::OpMove, target, value);
+	}
+
+	int Expression()
+	{
+		int condition = Comparison();
+		if (!IsSymbol("?"))
+			return condition;
+
+		Next();
+		int ifTrue = Expression();
+		Expect(":");
+		int ifFalse = Expression();
+		return Emit(ShaderProgram::OpSelect, Temp(), condition, ifTrue, ifFalse);
+	}
+
+	int Comparison()
+	{
+		int lhs = Additive();
+		if (m_Token.type != TokenSymbol)
+			return lhs;
+
+		std::string symbol = m_Token.text;
+		if (symbol != "<" && symbol != "<=" && symbol != ">" && symbol != ">=" && symbol != "==" && symbol != "!=")
+			return lhs;
+
+		Next();
+		int rhs = Additive();
+		if (symbol == "<")
+			return Binary(ShaderProgram::OpLess, lhs, rhs);
+		if (symbol == "<=")
+			return Binary(ShaderProgram::OpLessEqual, lhs, rhs);
+		if (symbol == ">")
+			return Binary(ShaderProgram::OpLess, rhs, lhs);
+		if (symbol == ">=")
+			return Binary(ShaderProgram::OpLessEqual, rhs, lhs);
+		if (symbol == "==")
+			return Binary(ShaderProgram::OpEqual, lhs, rhs);
+		return Binary(ShaderProgram::OpNotEqual, lhs, rhs);
+	}
+
+	int Additive()
+	{
+		int value = Term();
+		while (IsSymbol("+") || IsSymbol("-"))
+		{
+			bool add = m_Token.text == "+";
+			Next();
+			int rhs = Term();
+			value = Binary(add ? ShaderProgram::OpAdd : ShaderProgram::OpSub, value, rhs);
+		}
+		return value;
+	}
+
+	int Term()
+	{
+		int value = Unary();
+		while (IsSymbol("*") || IsSymbol("/"))
+		{
+			bool multiply = m_Token.text == "*";
+			Next();
+			int rhs = Unary();
+			value = Binary(multiply ? ShaderProgram::OpMul : ShaderProgram::OpDiv, value, rhs);
+		}
+		return value;
+	}
+
+	int Unary()
+	{
+		if (IsSymbol("-"))
+		{
+			Next();
+			return UnaryOp(ShaderProgram::OpNeg, Unary());
+		}
+		return Primary();
+	}
+
+	int Primary()
+	{
+		if (m_Token.type == TokenNumber)
+		{
+			int value = Constant(m_Token.value);
+			Next();
+			return value;
+		}
+
+		if (IsSymbol("("))
+		{
+			Next();
+			int value = Expression();
+			Expect(")");
+			return value;
+		}
+
+		if (m_Token.type != TokenName)
+		{
+			Fail("expected an expression");
+			return Constant(0.0f);
+		}
+
+		std::string name = m_Token.text;
+		Next();
+		if (IsSymbol("("))
+			return Call(name);
+
+		for (size_t i = 0; i < sizeof(s_FixedNames) / sizeof(s_FixedNames[0]); ++i)
+		{
+			if (name == s_FixedNames[i].name)
+			{
+				if (s_FixedNames[i].reg >= ShaderProgram::RegisterSourceR && s_FixedNames[i].reg <= ShaderProgram::RegisterSourceA)
+					m_Program.m_UsesSource = true;
+				return s_FixedNames[i].reg;
+			}
+		}
+
+		std::map<std::string, int>::iterator variable = m_Variables.find(name);
+		if (variable == m_Variables.end())
+		{
+			Fail("unknown name " + name);
+			return Constant(0.0f);
+		}
+		return variable->second;
+	}
+
+	int Call(const std::string& name)
+	{
+		Next();
+		std::vector<int> args;
+		if (!IsSymbol(")"))
+		{
+			args.push_back(Expression());
+			while (IsSymbol(","))
+			{
+				Next();
+				args.push_back(Expression());
+			}
+		}
+		Expect(")");
+		if (m_Failed)
+			return Constant(0.0f);
+
+		struct Function
+		{
+			const char* name;
+			size_t arity;
+			int op;
+		};
+		static const Function functions[] =
+		{
+			{ "sin", 1, ShaderProgram::OpSin },
+			{ "cos", 1, ShaderProgram::OpCos },
+			{ "exp", 1, ShaderProgram::OpExp },
+			{ "log", 1, ShaderProgram::OpLog },
+			{ "sqrt", 1, ShaderProgram::OpSqrt },
+			{ "abs", 1, ShaderProgram::OpAbs },
+			{ "floor", 1, ShaderProgram::OpFloor },
+			{ "pow", 2, ShaderProgram::OpPow },
+			{ "min", 2, ShaderProgram::OpMin },
+			{ "max", 2, ShaderProgram::OpMax },
+			{ "fract", 1, -1 },
+			{ "clamp", 3, -1 },
+			{ "mix", 3, -1 },
+			{ "step", 2, -1 },
+			{ "smoothstep", 3, -1 },
+		};
+
+		const Function* function = 0;
+		for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i)
+			if (name == functions[i].name)
+				function = &functions[i];
+		if (function == 0)
+		{
+			Fail("unknown function " + name);
+			return Constant(0.0f);
+		}
+		if (args.size() != function->arity)
+		{
+			char count[16];
+			sprintf(count, "%d", (int)function->arity);
+			Fail(name + " takes " + count + " arguments");
+			return Constant(0.0f);
+		}
+
+		if (function->op >= 0)
+			return function->arity == 1 ? UnaryOp(function->op, args[0]) : Binary(function->op, args[0], args[1]);
+
+		// the rest are built from the primitives
+		if (name == "fract")
+			return Binary(ShaderProgram::OpSub, args[0], UnaryOp(ShaderProgram::OpFloor, args[0]));
+		if (name == "clamp")
+			return Binary(ShaderProgram::OpMin, Binary(ShaderProgram::OpMax, args[0], args[1]), args[2]);
+		if (name == "mix")
+			return Binary(ShaderProgram::OpAdd, args[0], Binary(ShaderProgram::OpMul, Binary(ShaderProgram::OpSub, args[1], args[0]), args[2]));
+		if (name == "step")
+			return Binary(ShaderProgram::OpLessEqual, args[0], args[1]);
+
+		// smoothstep: t = clamp((x - e0) / (e1 - e0), 0, 1); t * t * (3 - 2 * t)
+		int t = Binary(ShaderProgram::OpDiv, Binary(ShaderProgram::OpSub, args[2], args[0]), Binary(ShaderProgram::OpSub, args[1], args[0]));
+		t = Binary(ShaderProgram::OpMin, Binary(ShaderProgram::OpMax, t, Constant(0.0f)), Constant(1.0f));
+		int shape = Binary(ShaderProgram::OpSub, Constant(3.0f), Binary(ShaderProgram::OpMul, Constant(2.0f), t));
+		return Binary(ShaderProgram::OpMul, Binary(ShaderProgram::OpMul, t, t), shape);
+	}
+
+	// Code generation -----------------------------------------------------
+
+	inline bool IsConstant(int operand) const { return (operand & TagMask) == ConstantTag; }
+	inline float ConstantValue(int operand) const { return m_Program.m_Constants[operand & ~TagMask]; }
+
+	int Constant(float value)
+	{
+		std::vector<float>& constants = m_Program.m_Constants;
+		for (size_t i = 0; i < constants.size(); ++i)
+			if (memcmp(&constants[i], &value, sizeof(value)) == 0)
+				return ConstantTag | (int)i;
+
+		constants.push_back(value);
+		return Tagged(ConstantTag, (int)(constants.size() - 1), "constants");
+	}
+
+	int Temp()
+	{
+		return Tagged(LocalTag, m_NextTemp++, "variables and temporaries");
+	}
+
+	// index under tag, or a failure once the tag has run out of them
+	int Tagged(int tag, int index, const char* what)
+	{
+		if (index < TagRange)
+			return tag | index;
+		Fail(std::string("too many ") + what);
+		return tag;
+	}
+
+	int UnaryOp(int op, int a)
+	{
+		if (IsConstant(a) && op == ShaderProgram::OpNeg)
+			return Constant(-ConstantValue(a));
+		return Emit(op, Temp(), a);
+	}
+
+	// Folds arithmetic on constants.
+	int Binary(int op, int a, int b)
+	{
+		if (IsConstant(a) && IsConstant(b))
+		{
+			float lhs = ConstantValue(a);
+			float rhs = ConstantValue(b);
+			switch (op)
+			{
+				case ShaderProgram::OpAdd: return Constant(lhs + rhs);
+				case ShaderProgram::OpSub: return Constant(lhs - rhs);
+				case ShaderProgram::OpMul: return Constant(lhs * rhs);
+				case ShaderProgram::OpDiv: return Constant(lhs / rhs);
+				case ShaderProgram::OpMin: return Constant(lhs < rhs ? lhs : rhs);
+				case ShaderProgram::OpMax: return Constant(lhs > rhs ? lhs : rhs);
+				default: break;
+			}
+		}
+		return Emit(op, Temp(), a, b);
+	}
+
+	int Emit(int op, int dst, int a, int b = 0, int c = 0)
+	{
+		ShaderProgram::Instruction instruction;
+		instruction.op = (unsigned short)op;
+		instruction.dst = (unsigned short)dst;
+		instruction.a = (unsigned short)a;
+		instruction.b = (unsigned short)b;
+		instruction.c = (unsigned short)c;
+		m_Program.m_Code.push_back(instruction);
+		return dst;
+	}
+
+	// Lays registers out as fixed, constants, locals.
+	void Relocate()
+	{
+		int constantBase = ShaderProgram::FixedRegisterCount;
+		int localBase = constantBase + (int)m_Program.m_Constants.size();
+		int localCount = 0;
+
+		std::vector<ShaderProgram::Instruction>& code = m_Program.m_Code;
+		for (size_t i = 0; i < code.size(); ++i)
+		{
+			unsigned short* operands[] = { &code[i].dst, &code[i].a, &code[i].b, &code[i].c };
+			for (int k = 0; k < 4; ++k)
+			{
+				int operand = *operands[k];
+				if ((operand & TagMask) == ConstantTag)
+					*operands[k] = (unsigned short)(constantBase + (operand & ~TagMask));
+				else if ((operand & TagMask) == LocalTag)
+				{
+					localCount = std::max(localCount, (operand & ~TagMask) + 1);
+					*operands[k] = (unsigned short)(localBase + (operand & ~TagMask));
+				}
+			}
+		}
+		m_Program.m_RegisterCount = localBase + localCount;
+	}
+
+	const std::string& m_Source;
+	size_t m_Position;
+	int m_Line;
+	Token m_Token;
+	ShaderProgram& m_Program;
+
+	std::map<std::string, int> m_Variables;
+	int m_LocalCount;
+	int m_NextTemp;
+
+	bool m_Failed;
+	std::string m_Error;
+};
+
+bool ShaderProgram::Compile(const std::string& source, std::string& error)
+{
+	Reset();
+
+	ShaderCompiler compiler(source, *this);
+	if (compiler.Compile(error))
+		return true;
+
+	Reset();
+	return false;
+}
@@ -0,0 +1,202 @@
+#include "shaderprogram.h"
+#include "renderer/tilecache.h"
+#include "math/fastmath.h"
+#include "color/colorx8.h"
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	const int ChunkPackets = ShaderProgram::ChunkWidth / Floatx8::Width;
+
+	// One span's registers: each register is ChunkPackets packets.
+	thread_local std::vector<Floatx8> t_Registers;
+
+	const char s_Magic[4] = { 'S', 'F', 'B', 'C' };
+
+	// Write's header, followed by the constants and the instructions.
+	struct Header
+	{
+		char magic[4];
+		int version;
+		int registerCount;
+		int usesSource;
+		int constantCount;
+		int instructionCount;
+	};
+}
+
+ShaderProgram::ShaderProgram()
+	: m_RegisterCount(FixedRegisterCount)
+	, m_UsesSource(false)
+{
+}
+
+void ShaderProgram::Reset()
+{
+	m_Code.clear();
+	m_Constants.clear();
+	m_RegisterCount = FixedRegisterCount;
+	m_UsesSource = false;
+}
+
+void ShaderProgram::Write(std::vector<unsigned char>& data) const
+{
+	Header header;
+	memcpy(header.magic, s_Magic, sizeof(s_Magic));
+	header.version = BytecodeVersion;
+	header.registerCount = m_RegisterCount;
+	header.usesSource = m_UsesSource ? 1 : 0;
+	header.constantCount = (int)m_Constants.size();
+	header.instructionCount = (int)m_Code.size();
+
+	size_t constantBytes = sizeof(float) * m_Constants.size();
+	size_t codeBytes = sizeof(Instruction) * m_Code.size();
+	data.resize(sizeof(header) + constantBytes + codeBytes);
+	memcpy(&data[0], &header, sizeof(header));
+	if (constantBytes > 0)
+		memcpy(&data[sizeof(header)], &m_Constants[0], constantBytes);
+	if (codeBytes > 0)
+		memcpy(&data[sizeof(header) + constantBytes], &m_Code[0], codeBytes);
+}
+
+bool ShaderProgram::Read(const unsigned char* data, size_t size)
+{
+	Reset();
+
+	Header header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, s_Magic, sizeof(s_Magic)) != 0 || header.version != BytecodeVersion ||
+		header.constantCount < 0 || header.instructionCount < 0 ||
+		header.registerCount < FixedRegisterCount + header.constantCount || header.registerCount > 0xFFFF ||
+		size != sizeof(header) + sizeof(float) * header.constantCount + sizeof(Instruction) * header.instructionCount)
+		return false;
+
+	m_Constants.resize(header.constantCount);
+	m_Code.resize(header.instructionCount);
+	data += sizeof(header);
+	if (header.constantCount > 0)
+		memcpy(&m_Constants[0], data, sizeof(float) * header.constantCount);
+	data += sizeof(float) * header.constantCount;
+	if (header.instructionCount > 0)
+		memcpy(&m_Code[0], data, sizeof(Instruction) * header.instructionCount);
+
+	// Run trusts every register index, so a damaged file must not load
+	for (size_t i = 0; i < m_Code.size(); ++i)
+	{
+		const Instruction& instruction = m_Code[i];
+		if (instruction.op >= OpCount || instruction.dst >= header.registerCount || instruction.a >= header.registerCount ||
+			instruction.b >= header.registerCount || instruction.c >= header.registerCount)
+		{
+			Reset();
+			return false;
+		}
+	}
+
+	m_RegisterCount = header.registerCount;
+	m_UsesSource = header.usesSource != 0;
+	return true;
+}
+
+void ShaderProgram::Run(const Renderer::Span& span) const
+{
+	std::vector<Floatx8>& registers = t_Registers;
+	if (registers.size() < (size_t)m_RegisterCount * ChunkPackets)
+		registers.resize((size_t)m_RegisterCount * ChunkPackets);
+	Floatx8* r = &registers[0];
+
+	for (size_t k = 0; k < m_Constants.size(); ++k)
+		std::fill(r + (FixedRegisterCount + k) * ChunkPackets, r + (FixedRegisterCount + k + 1) * ChunkPackets, Floatx8(m_Constants[k]));
+
+	Floatx8 width((float)span.width);
+	Floatx8 height((float)span.height);
+	Floatx8 y((float)span.y);
+	Floatx8 v = y / height;
+	float* output = span.output;
+
+	for (unsigned int x0 = span.x0; x0 < span.x1; x0 += ChunkWidth)
+	{
+		int count = (int)std::min(span.x1 - x0, (unsigned int)ChunkWidth);
+		int packets = (count + Floatx8::Width - 1) / Floatx8::Width;
+
+		for (int p = 0; p < packets; ++p)
+		{
+			Floatx8 x = Floatx8::Ramp((float)(x0 + p * Floatx8::Width));
+			r[RegisterX * ChunkPackets + p] = x;
+			r[RegisterY * ChunkPackets + p] = y;
+			r[RegisterWidth * ChunkPackets + p] = width;
+			r[RegisterHeight * ChunkPackets + p] = height;
+			r[RegisterU * ChunkPackets + p] = x / width;
+			r[RegisterV * ChunkPackets + p] = v;
+			r[RegisterOutR * ChunkPackets + p] = Floatx8(0.0f);
+			r[RegisterOutG * ChunkPackets + p] = Floatx8(0.0f);
+			r[RegisterOutB * ChunkPackets + p] = Floatx8(0.0f);
+			r[RegisterOutA * ChunkPackets + p] = Floatx8(1.0f);
+		}
+
+		if (m_UsesSource)
+		{
+			float lanes[4][ChunkWidth] = { { 0.0f } };
+			if (span.source != 0)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					Color color = span.source->Sample(x0 + i, span.y);
+					for (int c = 0; c < 4; ++c)
+						lanes[c][i] = color.GetValues()[c];
+				}
+			}
+			for (int c = 0; c < 4; ++c)
+				for (int p = 0; p < packets; ++p)
+					r[(RegisterSourceR + c) * ChunkPackets + p] = Floatx8::Load(&lanes[c][p * Floatx8::Width]);
+		}
+
+		for (size_t i = 0; i < m_Code.size(); ++i)
+		{
+			const Instruction& instruction = m_Code[i];
+			Floatx8* d = r + instruction.dst * ChunkPackets;
+			const Floatx8* a = r + instruction.a * ChunkPackets;
+			const Floatx8* b = r + instruction.b * ChunkPackets;
+			const Floatx8* c = r + instruction.c * ChunkPackets;
+
+			switch (instruction.op)
+			{
+				case OpMove: for (int p = 0; p < packets; ++p) d[p] = a[p]; break;
+				case OpAdd: for (int p = 0; p < packets; ++p) d[p] = a[p] + b[p]; break;
+				case OpSub: for (int p = 0; p < packets; ++p) d[p] = a[p] - b[p]; break;
+				case OpMul: for (int p = 0; p < packets; ++p) d[p] = a[p] * b[p]; break;
+				case OpDiv: for (int p = 0; p < packets; ++p) d[p] = a[p] / b[p]; break;
+				case OpNeg: for (int p = 0; p < packets; ++p) d[p] = -a[p]; break;
+				case OpMin: for (int p = 0; p < packets; ++p) d[p] = Min(a[p], b[p]); break;
+				case OpMax: for (int p = 0; p < packets; ++p) d[p] = Max(a[p], b[p]); break;
+				case OpAbs: for (int p = 0; p < packets; ++p) d[p] = Abs(a[p]); break;
+				case OpSqrt: for (int p = 0; p < packets; ++p) d[p] = Sqrt(a[p]); break;
+				case OpFloor: for (int p = 0; p < packets; ++p) d[p] = FastMath::detail::Floor(a[p]); break;
+				case OpSin: for (int p = 0; p < packets; ++p) d[p] = FastMath::Sin<FastMath::Precise>(a[p]); break;
+				case OpCos: for (int p = 0; p < packets; ++p) d[p] = FastMath::Cos<FastMath::Precise>(a[p]); break;
+				case OpExp: for (int p = 0; p < packets; ++p) d[p] = FastMath::Exp<FastMath::Precise>(a[p]); break;
+				case OpLog: for (int p = 0; p < packets; ++p) d[p] = FastMath::Log<FastMath::Precise>(a[p]); break;
+				case OpPow: for (int p = 0; p < packets; ++p) d[p] = FastMath::Pow<FastMath::Precise>(Abs(a[p]), b[p]); break;
+				case OpLess: for (int p = 0; p < packets; ++p) d[p] = Select(a[p] < b[p], Floatx8(1.0f), Floatx8(0.0f)); break;
+				case OpLessEqual: for (int p = 0; p < packets; ++p) d[p] = Select(a[p] <= b[p], Floatx8(1.0f), Floatx8(0.0f)); break;
+				case OpEqual: for (int p = 0; p < packets; ++p) d[p] = Select(a[p] == b[p], Floatx8(1.0f), Floatx8(0.0f)); break;
+				case OpNotEqual: for (int p = 0; p < packets; ++p) d[p] = Select(a[p] == b[p], Floatx8(0.0f), Floatx8(1.0f)); break;
+				case OpSelect: for (int p = 0; p < packets; ++p) d[p] = Select(a[p] == Floatx8(0.0f), c[p], b[p]); break;
+			}
+		}
+
+		for (int p = 0; p < packets; ++p)
+		{
+			Colorx8 color(r[RegisterOutR * ChunkPackets + p], r[RegisterOutG * ChunkPackets + p],
+				r[RegisterOutB * ChunkPackets + p], r[RegisterOutA * ChunkPackets + p]);
+			int storeCount = std::min(count - p * Floatx8::Width, (int)Floatx8::Width);
+			if (span.planeStride == 1)
+				color.Store(output, span.stride, span.channels, storeCount);
+			else
+				color.StorePlanar(output, span.planeStride, span.channels, storeCount);
+			output += span.stride * Floatx8::Width;
+		}
+	}
+}
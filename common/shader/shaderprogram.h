@@ -0,0 +1,122 @@
+#ifndef __SHADERPROGRAM__
+#define __SHADERPROGRAM__
+#include "renderer/renderer.h"
+#include <string>
+#include <vector>
+
+// A kernel written in a small GLSL-like language, compiled to bytecode for
+// a register machine whose registers each hold a chunk of pixels, so every
+// instruction is dispatched once per ChunkWidth pixels and runs as Floatx8
+// packets.
+//
+// A shader is a list of statements assigning float expressions:
+//
+//	// comments run to the end of the line
+//	float t = pow(abs(1.0 / (uv.x * 300.0 + sin(uv.y * 5.0) * 50.0)), 0.75);
+//	out.r = t * 2.0;
+//	out.g = t * 4.0;
+//
+// Inputs: x, y (pixel), width, height (image), uv.x, uv.y (x / width and
+// y / height), src.r, src.g, src.b, src.a (the input image at the pixel).
+// Outputs: out.r, out.g, out.b, out.a, starting as 0, 0, 0, 1.
+// Operators: + - * / unary -, < <= > >= == != (1 or 0) and c ? a : b.
+// Functions: sin cos exp log pow sqrt abs floor fract min max clamp mix
+// step smoothstep. pow(x, y) is |x|^y.
+class ShaderProgram
+{
+public:
+
+	static const int ChunkWidth = 64;
+
+	// Bumped whenever the opcodes, register layout or Write format change.
+	static const int BytecodeVersion = 1;
+
+	ShaderProgram();
+
+	// Replaces the program with source. On failure returns false, leaves
+	// the program empty and describes the first error with its line.
+	bool Compile(const std::string& source, std::string& error);
+
+	// Evaluates the program over span, storing like a span kernel.
+	void Run(const Renderer::Span& span) const;
+
+	// Flattens the compiled program to bytes and back, for ShaderCache.
+	// Read returns false, leaving the program empty, unless data is a whole
+	// program written by a build with the same bytecode version.
+	void Write(std::vector<unsigned char>& data) const;
+	bool Read(const unsigned char* data, size_t size);
+
+	// Whether the program reads src.*, so the renderer needs a source.
+	inline bool UsesSource() const { return m_UsesSource; }
+	inline int GetInstructionCount() const { return (int)m_Code.size(); }
+	inline int GetRegisterCount() const { return m_RegisterCount; }
+
+	// Registers every program starts with, in this order, then the
+	// constants.
+	enum Register
+	{
+		RegisterX,
+		RegisterY,
+		RegisterWidth,
+		RegisterHeight,
+		RegisterU,
+		RegisterV,
+		RegisterSourceR,
+		RegisterSourceG,
+		RegisterSourceB,
+		RegisterSourceA,
+		RegisterOutR,
+		RegisterOutG,
+		RegisterOutB,
+		RegisterOutA,
+		FixedRegisterCount
+	};
+
+	enum Opcode
+	{
+		OpMove,
+		OpAdd,
+		OpSub,
+		OpMul,
+		OpDiv,
+		OpNeg,
+		OpMin,
+		OpMax,
+		OpAbs,
+		OpSqrt,
+		OpFloor,
+		OpSin,
+		OpCos,
+		OpExp,
+		OpLog,
+		OpPow,
+		OpLess,
+		OpLessEqual,
+		OpEqual,
+		OpNotEqual,
+		OpSelect,		// a != 0 ? b : c
+		OpCount
+	};
+
+	struct Instruction
+	{
+		unsigned short op;
+		unsigned short dst;
+		unsigned short a;
+		unsigned short b;
+		unsigned short c;
+	};
+
+private:
+
+	friend class ShaderCompiler;
+
+	void Reset();
+
+	std::vector<Instruction> m_Code;
+	std::vector<float> m_Constants;
+	int m_RegisterCount;
+	bool m_UsesSource;
+};
+
+#endif
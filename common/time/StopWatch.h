@@ -1,32 +1,52 @@
-#include <windows.h>
+#ifndef __STOPWATCH__
+#define __STOPWATCH__
+#include <chrono>
 
+// High-resolution timer on std::chrono::steady_clock (QueryPerformanceCounter
+// on Windows, clock_gettime(CLOCK_MONOTONIC) elsewhere). Times are kept in
+// integer nanoseconds and only converted on the way out.
 class StopWatch
 {
 public:
+	typedef std::chrono::steady_clock Clock;
+
 	StopWatch()
+		: beginCounts(Clock::now())
+		, endCounts(beginCounts)
 	{
-		QueryPerformanceFrequency(&countsPerSecond);
-		invCountsPerSecond = 1.0f / countsPerSecond.QuadPart;
 	}
 
 	inline void Start()
 	{
-		QueryPerformanceCounter(&beginCounts);
+		beginCounts = Clock::now();
+	}
+
+	// Returns the milliseconds since Start().
+	inline double Stop()
+	{
+		endCounts = Clock::now();
+		return ElapsedNanoseconds() * 1e-6;
+	}
+
+	inline long long ElapsedNanoseconds() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(endCounts - beginCounts).count();
 	}
 
-	inline float Stop()
+	inline double ElapsedSeconds() const
 	{
-		QueryPerformanceCounter(&endCounts);
-		float delta = float(endCounts.QuadPart - beginCounts.QuadPart);
-		float elapsedTimeInSeconds = delta * invCountsPerSecond;
-		float elapsedTimeInMS = elapsedTimeInSeconds * 1000.0f;
+		return ElapsedNanoseconds() * 1e-9;
+	}
 
-		return elapsedTimeInMS;
+	// Nanoseconds since an arbitrary fixed point; for timestamps.
+	static inline long long Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
 	}
 
 private:
-	LARGE_INTEGER countsPerSecond;
-	float invCountsPerSecond;
-	LARGE_INTEGER beginCounts;
-	LARGE_INTEGER endCounts;
+	Clock::time_point beginCounts;
+	Clock::time_point endCounts;
 };
+
+#endif
@@ -0,0 +1,185 @@
+#include "profiler.h"
+#include "StopWatch.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	struct ZoneEvent
+	{
+		const char* name;
+		long long beginNs;
+		long long endNs;
+	};
+
+	struct ThreadBuffer
+	{
+		int threadIndex;
+		std::vector<ZoneEvent> events;
+	};
+
+	std::atomic<bool> s_Enabled(false);
+	std::mutex s_BuffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer> > s_Buffers;
+	thread_local ThreadBuffer* t_Buffer = NULL;
+
+	ThreadBuffer* GetThreadBuffer()
+	{
+		if (t_Buffer == NULL)
+		{
+			std::lock_guard<std::mutex> lock(s_BuffersMutex);
+			s_Buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+			t_Buffer = s_Buffers.back().get();
+			t_Buffer->threadIndex = (int)s_Buffers.size() - 1;
+			t_Buffer->events.reserve(4096);
+		}
+		return t_Buffer;
+	}
+
+	void WriteJsonString(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				fputc('\\', file);
+			fputc(*c, file);
+		}
+		fputc('"', file);
+	}
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+	s_Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::IsEnabled()
+{
+	return s_Enabled.load(std::memory_order_relaxed);
+}
+
+// Only call between renders: buffers are cleared without their threads
+// knowing.
+void Profiler::Reset()
+{
+	std::lock_guard<std::mutex> lock(s_BuffersMutex);
+	for (size_t i = 0; i < s_Buffers.size(); ++i)
+		s_Buffers[i]->events.clear();
+}
+
+void Profiler::Record(const char* name, long long beginNs, long long endNs)
+{
+	ZoneEvent event = { name, beginNs, endNs };
+	GetThreadBuffer()->events.push_back(event);
+}
+
+void Profiler::GetStats(std::vector<ZoneStats>& stats)
+{
+	stats.clear();
+
+	std::lock_guard<std::mutex> lock(s_BuffersMutex);
+	for (size_t b = 0; b < s_Buffers.size(); ++b)
+	{
+		const ThreadBuffer& buffer = *s_Buffers[b];
+		std::map<std::string, size_t> indices;
+		for (size_t e = 0; e < buffer.events.size(); ++e)
+		{
+			const ZoneEvent& event = buffer.events[e];
+			std::map<std::string, size_t>::iterator found = indices.find(event.name);
+			if (found == indices.end())
+			{
+				ZoneStats zone = { event.name, buffer.threadIndex, 0, 0.0, 0.0 };
+				found = indices.insert(std::make_pair(zone.name, stats.size())).first;
+				stats.push_back(zone);
+			}
+
+			ZoneStats& zone = stats[found->second];
+			double ms = (event.endNs - event.beginNs) * 1e-6;
+			++zone.count;
+			zone.totalMs += ms;
+			zone.maxMs = std::max(zone.maxMs, ms);
+		}
+	}
+}
+
+void Profiler::PrintStats(FILE* file)
+{
+	std::vector<ZoneStats> stats;
+	GetStats(stats);
+
+	fprintf(file, "%-24s %6s %10s %12s %10s %10s\n", "zone", "thread", "count", "total ms", "mean ms", "max ms");
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		const ZoneStats& zone = stats[i];
+		fprintf(file, "%-24s %6d %10lld %12.3f %10.4f %10.4f\n", zone.name.c_str(), zone.threadIndex,
+			zone.count, zone.totalMs, zone.totalMs / zone.count, zone.maxMs);
+	}
+}
+
+// Complete ("X") events in microseconds, one tid per recording thread, with
+// timestamps relative to the earliest event.
+bool Profiler::WriteChromeTrace(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+		return false;
+
+	std::lock_guard<std::mutex> lock(s_BuffersMutex);
+
+	long long origin = 0;
+	bool haveOrigin = false;
+	for (size_t b = 0; b < s_Buffers.size(); ++b)
+	{
+		const std::vector<ZoneEvent>& events = s_Buffers[b]->events;
+		for (size_t e = 0; e < events.size(); ++e)
+		{
+			if (!haveOrigin || events[e].beginNs < origin)
+				origin = events[e].beginNs;
+			haveOrigin = true;
+		}
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t b = 0; b < s_Buffers.size(); ++b)
+	{
+		const ThreadBuffer& buffer = *s_Buffers[b];
+
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+			first ? "" : ",\n", buffer.threadIndex, buffer.threadIndex);
+		first = false;
+
+		for (size_t e = 0; e < buffer.events.size(); ++e)
+		{
+			const ZoneEvent& event = buffer.events[e];
+			fprintf(file, ",\n{\"name\":");
+			WriteJsonString(file, event.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer.threadIndex, (event.beginNs - origin) * 1e-3, (event.endNs - event.beginNs) * 1e-3);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+ProfileZone::ProfileZone(const char* name)
+	: m_Name(NULL)
+	, m_Begin(0)
+{
+	if (Profiler::IsEnabled())
+	{
+		m_Name = name;
+		m_Begin = StopWatch::Now();
+	}
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (m_Name != NULL)
+		Profiler::Record(m_Name, m_Begin, StopWatch::Now());
+}
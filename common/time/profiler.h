@@ -0,0 +1,60 @@
+#ifndef __PROFILER__
+#define __PROFILER__
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Scoped instrumentation zones. While enabled, every PROFILE_ZONE records a
+// begin/end timestamp into a buffer owned by the calling thread, so recording
+// takes no locks. Buffers outlive their threads and can be summarised per
+// thread or written out as a Chrome trace (chrome://tracing, Perfetto).
+// Disabled zones cost one relaxed atomic load.
+class Profiler
+{
+public:
+
+	// Total time spent in one zone name on one thread.
+	struct ZoneStats
+	{
+		std::string name;
+		int threadIndex;
+		long long count;
+		double totalMs;
+		double maxMs;
+	};
+
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+
+	// Drops every recorded zone.
+	static void Reset();
+
+	// name must outlive the profiler; string literals are expected.
+	static void Record(const char* name, long long beginNs, long long endNs);
+
+	static void GetStats(std::vector<ZoneStats>& stats);
+	static void PrintStats(FILE* file);
+	static bool WriteChromeTrace(const char* path);
+};
+
+class ProfileZone
+{
+public:
+
+	explicit ProfileZone(const char* name);
+	~ProfileZone();
+
+private:
+
+	ProfileZone(const ProfileZone&);
+	ProfileZone& operator =(const ProfileZone&);
+
+	const char* m_Name;
+	long long m_Begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#endif
@@ -0,0 +1,194 @@
+// Measures FastMath's Precise and Fast tiers against double precision libm
+// and fails when a function strays past the bound fastmath.h documents for
+// its tier. Inputs are drawn from a fixed seed, so runs repeat exactly;
+// every sample goes through both the float and the Floatx8 versions.
+//
+//	fastmath_accuracy [--samples N]
+//
+// Errors are in ulps of the correctly rounded result, except where a
+// function's contract is absolute (Sin and Cos) or relative (Fast).
+//-------------------------------------------------------------------------------
+#include "math/fastmath.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+	enum Metric
+	{
+		Ulps,
+		Absolute,
+		Relative
+	};
+
+	const char* s_MetricNames[] = { "ulp", "abs", "rel" };
+
+	// Deterministic uniform draws in [0, 1).
+	class Random
+	{
+	public:
+		Random() : m_State(0x9E3779B97F4A7C15ull) {}
+
+		double Next()
+		{
+			m_State = m_State * 6364136223846793005ull + 1442695040888963407ull;
+			return (double)(m_State >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		double Uniform(double lo, double hi) { return lo + (hi - lo) * Next(); }
+		double LogUniform(double lo, double hi) { return exp(Uniform(log(lo), log(hi))); }
+
+	private:
+		unsigned long long m_State;
+	};
+
+	double Error(Metric metric, float value, double reference)
+	{
+		double difference = fabs((double)value - reference);
+		if (metric == Absolute)
+			return difference;
+		if (metric == Relative)
+			return difference / fabs(reference);
+
+		float rounded = (float)reference;
+		float magnitude = fabsf(rounded) < FLT_MIN ? FLT_MIN : fabsf(rounded);
+		return difference / (double)(nextafterf(magnitude, INFINITY) - magnitude);
+	}
+
+	typedef void(*InputFunc)(Random& random, float& a, float& b);
+	typedef float(*ScalarFunc)(float a, float b);
+	typedef Floatx8(*PacketFunc)(const Floatx8& a, const Floatx8& b);
+	typedef double(*ReferenceFunc)(double a, double b);
+
+	struct Check
+	{
+		const char* name;
+		const char* domain;
+		Metric metric;
+		double bound;
+		InputFunc input;
+		ScalarFunc scalar;
+		PacketFunc packet;
+		ReferenceFunc reference;
+	};
+
+	// Inputs.
+	void ExpInput(Random& random, float& a, float&) { a = (float)random.Uniform(-87.0, 88.0); }
+	void LogInput(Random& random, float& a, float&) { a = (float)random.LogUniform(FLT_MIN, FLT_MAX); }
+	void TrigInput(Random& random, float& a, float&) { a = (float)random.Uniform(-8192.0, 8192.0); }
+	void Atan2Input(Random& random, float& a, float& b) { a = (float)random.Uniform(-100.0, 100.0); b = (float)random.Uniform(-100.0, 100.0); }
+	void PowInput(Random& random, float& a, float& b) { a = (float)random.LogUniform(1e-6, 1e6); b = (float)random.Uniform(-4.0, 4.0); }
+	void PowWideInput(Random& random, float& a, float& b) { a = (float)random.LogUniform(1e-3, 1e3); b = (float)random.Uniform(-12.0, 12.0); }
+	void PowKernelInput(Random& random, float& a, float& b) { a = (float)random.LogUniform(1e-6, 1.0); b = 0.75f; }
+
+	// References.
+	double ExpReference(double a, double) { return exp(a); }
+	double LogReference(double a, double) { return log(a); }
+	double SinReference(double a, double) { return sin(a); }
+	double CosReference(double a, double) { return cos(a); }
+	double Atan2Reference(double a, double b) { return atan2(a, b); }
+	double PowReference(double a, double b) { return pow(a, b); }
+
+	// One scalar and one packet adapter per function and tier.
+	#define FASTMATH_UNARY(name, tier) \
+		float name##tier(float a, float) { return FastMath::name<FastMath::tier>(a); } \
+		Floatx8 name##tier##x8(const Floatx8& a, const Floatx8&) { return FastMath::name<FastMath::tier>(a); }
+	#define FASTMATH_BINARY(name, tier) \
+		float name##tier(float a, float b) { return FastMath::name<FastMath::tier>(a, b); } \
+		Floatx8 name##tier##x8(const Floatx8& a, const Floatx8& b) { return FastMath::name<FastMath::tier>(a, b); }
+
+	FASTMATH_UNARY(Exp, Precise) FASTMATH_UNARY(Exp, Fast)
+	FASTMATH_UNARY(Log, Precise) FASTMATH_UNARY(Log, Fast)
+	FASTMATH_UNARY(Sin, Precise) FASTMATH_UNARY(Sin, Fast)
+	FASTMATH_UNARY(Cos, Precise) FASTMATH_UNARY(Cos, Fast)
+	FASTMATH_BINARY(Atan2, Precise) FASTMATH_BINARY(Atan2, Fast)
+	FASTMATH_BINARY(Pow, Precise) FASTMATH_BINARY(Pow, Fast)
+
+	#define FASTMATH_CHECK(name, tier, domain, metric, bound, input, reference) \
+		{ #name "<" #tier ">", domain, metric, bound, input, name##tier, name##tier##x8, reference }
+
+	// The bounds fastmath.h promises.
+	const Check s_Checks[] =
+	{
+		FASTMATH_CHECK(Exp, Precise, "[-87, 88]", Ulps, 1.5, ExpInput, ExpReference),
+		FASTMATH_CHECK(Log, Precise, "normal x", Ulps, 1.0, LogInput, LogReference),
+		FASTMATH_CHECK(Sin, Precise, "|x| < 8192", Absolute, 1.2e-7, TrigInput, SinReference),
+		FASTMATH_CHECK(Cos, Precise, "|x| < 8192", Absolute, 1.2e-7, TrigInput, CosReference),
+		FASTMATH_CHECK(Atan2, Precise, "|x|, |y| < 100", Ulps, 3.0, Atan2Input, Atan2Reference),
+		FASTMATH_CHECK(Pow, Precise, "x^0.75, x in [1e-6, 1]", Ulps, 2.5, PowKernelInput, PowReference),
+		FASTMATH_CHECK(Pow, Precise, "x in [1e-6, 1e6], |y| < 4", Ulps, 2.5, PowInput, PowReference),
+		FASTMATH_CHECK(Pow, Precise, "x in [1e-3, 1e3], |y| < 12", Ulps, 2.5, PowWideInput, PowReference),
+		FASTMATH_CHECK(Exp, Fast, "[-87, 88]", Relative, 1e-4, ExpInput, ExpReference),
+		FASTMATH_CHECK(Log, Fast, "normal x", Absolute, 1e-4, LogInput, LogReference),
+		FASTMATH_CHECK(Sin, Fast, "|x| < 8192", Absolute, 1e-4, TrigInput, SinReference),
+		FASTMATH_CHECK(Cos, Fast, "|x| < 8192", Absolute, 1e-4, TrigInput, CosReference),
+		FASTMATH_CHECK(Atan2, Fast, "|x|, |y| < 100", Absolute, 1e-4, Atan2Input, Atan2Reference),
+		FASTMATH_CHECK(Pow, Fast, "x^0.75, x in [1e-6, 1]", Relative, 1e-4, PowKernelInput, PowReference),
+	};
+}
+
+int main(int argc, char** argv)
+{
+	long samples = 2000000;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+		{
+			samples = atol(argv[++i]);
+			continue;
+		}
+		fprintf(stderr, "usage: %s [--samples N]\n", argv[0]);
+		return 2;
+	}
+
+	int failures = 0;
+	printf("%-16s %-28s %12s %12s\n", "function", "domain", "worst", "bound");
+	for (size_t c = 0; c < sizeof(s_Checks) / sizeof(s_Checks[0]); ++c)
+	{
+		const Check& check = s_Checks[c];
+		Random random;
+		double worst = 0.0;
+		float worstA = 0.0f;
+		float worstB = 0.0f;
+		for (long s = 0; s < samples; s += Floatx8::Width)
+		{
+			FLOATX8_ALIGN(32) float a[Floatx8::Width];
+			FLOATX8_ALIGN(32) float b[Floatx8::Width];
+			for (int i = 0; i < Floatx8::Width; ++i)
+			{
+				b[i] = 0.0f;
+				check.input(random, a[i], b[i]);
+			}
+
+			FLOATX8_ALIGN(32) float packet[Floatx8::Width];
+			check.packet(Floatx8::Load(a), Floatx8::Load(b)).Store(packet);
+			for (int i = 0; i < Floatx8::Width; ++i)
+			{
+				double reference = check.reference(a[i], b[i]);
+				double error = fmax(Error(check.metric, check.scalar(a[i], b[i]), reference),
+					Error(check.metric, packet[i], reference));
+				if (!(error <= worst))
+				{
+					worst = error;
+					worstA = a[i];
+					worstB = b[i];
+				}
+			}
+		}
+
+		bool passed = worst <= check.bound;
+		printf("%-16s %-28s %8.3g %s %8.3g %s\n", check.name, check.domain,
+			worst, s_MetricNames[check.metric], check.bound, s_MetricNames[check.metric]);
+		if (!passed)
+		{
+			printf("  FAILED at (%.9g, %.9g)\n", worstA, worstB);
+			++failures;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// Golden-image tests for the renderer's code paths. Renders the sample
+// pattern through each kernel signature in deterministic mode and diffs it
+// against the reference stored for that kernel in golden/. Every
+// combination of output depth, layout, dithering, worker count and tile
+// order is checked two ways:
+//
+//	against the reference, within the path's tolerance: ulps of the float
+//	    samples at 32 bits, quantization steps at 8 and 16 bits, where the
+//	    reference is quantized the same way first. The tolerances absorb
+//	    libm and SIMD differences between machines; on the machine that
+//	    wrote the references every path matches exactly
+//	against the kernel's first render, exactly: deterministic mode promises
+//	    the same bits for any worker count and tile order
+//
+//	golden_images [--references directory] [--update]
+//
+// --update rewrites the references from 32-bit single-threaded renders.
+// The plug-in itself is covered by shaderfilter_cli --reference, which
+// needs the Photoshop SDK; its 32-bit output is the packet reference.
+//-------------------------------------------------------------------------------
+#include "renderer/renderer.h"
+#include "kernels/samplekernels.h"
+#include "color/quantize.h"
+#include "host/imagefile.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Crosses tile edges and leaves a packet tail on every row.
+	const int ImageWidth = 100;
+	const int ImageHeight = 66;
+	const int Planes = 3;
+
+	struct KernelEntry
+	{
+		const char* name;
+		Renderer* (*create)(int threads);
+		long long ulps;			// tolerance at 32 bits
+	};
+
+	Renderer* CreatePixel(int threads) { return new Renderer(kernel, ImageWidth, ImageHeight, Planes, threads); }
+	Renderer* CreateSpan(int threads) { return new Renderer(kernelSpan, ImageWidth, ImageHeight, Planes, threads); }
+	Renderer* CreatePacket(int threads) { return new Renderer(kernelPacket<FastMath::Precise>, ImageWidth, ImageHeight, Planes, threads); }
+	Renderer* CreatePacketFast(int threads) { return new Renderer(kernelPacket<FastMath::Fast>, ImageWidth, ImageHeight, Planes, threads); }
+
+	// pixel and span call double precision libm, which may differ in the
+	// last bit between C libraries. The packet kernels' FastMath rounds
+	// differently with FMA and AVX2 than with SSE2, and the pattern divides
+	// by a difference that nearly cancels: SSE2 and AVX2 builds were 5 and
+	// 8 ulps apart, so the tolerances leave about double that.
+	const KernelEntry s_Kernels[] =
+	{
+		{ "pixel", CreatePixel, 2 },
+		{ "span", CreateSpan, 2 },
+		{ "packet", CreatePacket, 10 },
+		{ "packet-fast", CreatePacketFast, 16 },
+	};
+
+	// Quantized paths may land one step over where a float sample sits on
+	// a rounding boundary.
+	const long long QuantizedSteps = 1;
+
+	struct Variant
+	{
+		int depth;
+		bool dither;
+		Renderer::Layout layout;
+	};
+
+	const Variant s_Variants[] =
+	{
+		{ 32, false, Renderer::Interleaved },
+		{ 32, false, Renderer::Planar },
+		{ 16, false, Renderer::Interleaved },
+		{ 16, false, Renderer::Planar },
+		{ 8, false, Renderer::Interleaved },
+		{ 8, false, Renderer::Planar },
+		{ 8, true, Renderer::Interleaved },
+	};
+
+	const int s_ThreadCounts[] = { 1, 2, 4 };
+	const Renderer::TileOrder s_Orders[] = { Renderer::TileOrderRows, Renderer::TileOrderHilbert };
+
+	// Position of value on a line where neighbouring floats are one apart and
+	// -0 meets +0.
+	long long OrderedBits(float value)
+	{
+		int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits < 0 ? (long long)INT_MIN - bits : bits;
+	}
+
+	// Sample c of pixel (x, y) of the last render, as stored: a float at 32
+	// bits, the integer sample otherwise.
+	double ReadSample(Renderer& renderer, int x, int y, int c)
+	{
+		PixelLayout layout = renderer.GetPixelLayout();
+		const unsigned char* sample = static_cast<const unsigned char*>(layout.data) +
+			y * layout.rowBytes + x * layout.columnBytes + c * layout.planeBytes;
+		switch (renderer.GetOutputDepth())
+		{
+			case 8:
+				return *sample;
+			case 16:
+			{
+				unsigned short value;
+				memcpy(&value, sample, sizeof(value));
+				return value;
+			}
+			default:
+			{
+				float value;
+				memcpy(&value, sample, sizeof(value));
+				return value;
+			}
+		}
+	}
+
+	// The reference sample as the variant stores it.
+	double ExpectedSample(const std::vector<float>& reference, const Variant& variant, int x, int y, int c)
+	{
+		float value = reference[((size_t)y * ImageWidth + x) * Planes + c];
+		if (variant.depth == 32)
+			return value;
+
+		float offset = variant.dither ? Quantize::DitherOffset(x, y) : 0.5f;
+		if (variant.depth == 16)
+		{
+			unsigned short sample;
+			Quantize::Store(&value, &offset, Quantize::MaxValue16, &sample, 1);
+			return sample;
+		}
+		unsigned char sample;
+		Quantize::Store(&value, &offset, Quantize::MaxValue8, &sample, 1);
+		return sample;
+	}
+
+	// How far apart two samples are: ulps at 32 bits, steps otherwise.
+	long long Distance(double value, double expected, int depth)
+	{
+		if (depth != 32)
+			return llabs((long long)value - (long long)expected);
+		if (value != value || expected != expected)
+			return value != value && expected != expected ? 0 : LLONG_MAX;
+		return llabs(OrderedBits((float)value) - OrderedBits((float)expected));
+	}
+
+	std::string Describe(const KernelEntry& entry, const Variant& variant, int threads, Renderer::TileOrder order)
+	{
+		char text[128];
+		snprintf(text, sizeof(text), "%s %d-bit%s %s, %d thread%s, %s", entry.name, variant.depth,
+			variant.dither ? " dithered" : "", variant.layout == Renderer::Planar ? "planar" : "interleaved",
+			threads, threads == 1 ? "" : "s", order == Renderer::TileOrderRows ? "rows" : "hilbert");
+		return text;
+	}
+
+	void Render(Renderer& renderer, const Variant& variant, Renderer::TileOrder order)
+	{
+		renderer.SetDeterministic(true);
+		renderer.SetOutputDepth(variant.depth, variant.dither);
+		renderer.SetLayout(variant.layout);
+		renderer.SetTileOrder(order);
+		renderer.Render();
+	}
+
+	bool Update(const std::string& directory)
+	{
+		for (size_t k = 0; k < sizeof(s_Kernels) / sizeof(s_Kernels[0]); ++k)
+		{
+			std::unique_ptr<Renderer> renderer(s_Kernels[k].create(1));
+			Render(*renderer, s_Variants[0], Renderer::TileOrderRows);
+
+			std::string path = directory + "/" + s_Kernels[k].name + ".pfm";
+			if (!ImageFile::WritePFM(path.c_str(), renderer->GetPixels(), ImageWidth, ImageHeight, Planes))
+			{
+				fprintf(stderr, "could not write %s\n", path.c_str());
+				return false;
+			}
+			printf("wrote %s\n", path.c_str());
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "golden";
+	bool update = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--update") == 0)
+			update = true;
+		else if (strcmp(argv[i], "--references") == 0 && i + 1 < argc)
+			directory = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [--references directory] [--update]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (update)
+		return Update(directory) ? 0 : 1;
+
+	int failures = 0;
+	for (size_t k = 0; k < sizeof(s_Kernels) / sizeof(s_Kernels[0]); ++k)
+	{
+		const KernelEntry& entry = s_Kernels[k];
+		std::string path = directory + "/" + entry.name + ".pfm";
+		std::vector<float> reference;
+		int width, height, channels;
+		if (!ImageFile::ReadPFM(path.c_str(), reference, width, height, channels) ||
+			width != ImageWidth || height != ImageHeight || channels != Planes)
+		{
+			fprintf(stderr, "%s is missing or not %dx%d with %d channels\n", path.c_str(), ImageWidth, ImageHeight, Planes);
+			++failures;
+			continue;
+		}
+
+		for (size_t v = 0; v < sizeof(s_Variants) / sizeof(s_Variants[0]); ++v)
+		{
+			const Variant& variant = s_Variants[v];
+			long long tolerance = variant.depth == 32 ? entry.ulps : QuantizedSteps;
+			std::vector<double> first;
+
+			for (size_t t = 0; t < sizeof(s_ThreadCounts) / sizeof(s_ThreadCounts[0]); ++t)
+			{
+				std::unique_ptr<Renderer> renderer(entry.create(s_ThreadCounts[t]));
+				for (size_t o = 0; o < sizeof(s_Orders) / sizeof(s_Orders[0]); ++o)
+				{
+					Render(*renderer, variant, s_Orders[o]);
+
+					long long worst = 0;
+					bool identical = true;
+					size_t index = 0;
+					bool keep = first.empty();
+					for (int y = 0; y < ImageHeight; ++y)
+					{
+						for (int x = 0; x < ImageWidth; ++x)
+						{
+							for (int c = 0; c < Planes; ++c, ++index)
+							{
+								double value = ReadSample(*renderer, x, y, c);
+								worst = std::max(worst, Distance(value, ExpectedSample(reference, variant, x, y, c), variant.depth));
+								if (keep)
+									first.push_back(value);
+								else if (Distance(value, first[index], variant.depth) != 0)
+									identical = false;
+							}
+						}
+					}
+
+					std::string name = Describe(entry, variant, s_ThreadCounts[t], s_Orders[o]);
+					bool passed = worst <= tolerance && identical;
+					printf("%-52s %6lld %-5s of %lld%s\n", name.c_str(), worst, variant.depth == 32 ? "ulps" : "steps",
+						tolerance, identical ? "" : ", differs from the first render");
+					if (!passed)
+						++failures;
+				}
+			}
+		}
+	}
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+// Checks that PassGraph::Evaluate gives every pass the region its readers
+// need. Each graph is built twice, once with its point passes fused and
+// once with each of them as a stencil pass of radius 0, which never fuses,
+// and both are evaluated a tile at a time and compared, exactly, against
+// the graph run pass by pass over the whole source image.
+//
+//	passgraph_regions
+//
+// Clamping at the source image's edges is the only clamping the whole
+// image run does, so any halo cut short or image sized too small shows up
+// as a difference or, under a sanitizer, an overflow.
+//-------------------------------------------------------------------------------
+#include "renderer/passgraph.h"
+#include "renderer/tilecache.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	const int Channels = PassGraph::Channels;
+
+	// Point passes, and the same as stencil passes of radius 0.
+	void Scale(const PassGraph::Row& row, const float* const* inputs, float* output)
+	{
+		for (int i = 0; i < row.count * Channels; ++i)
+			output[i] = inputs[0][i] * 0.5f + 0.25f;
+	}
+
+	void Mix(const PassGraph::Row& row, const float* const* inputs, float* output)
+	{
+		for (int i = 0; i < row.count * Channels; ++i)
+			output[i] = inputs[0][i] * 0.75f + inputs[1][i] * 0.25f;
+	}
+
+	void Source(const PassGraph::Row& row, const float* const*, float* output)
+	{
+		for (int i = 0; i < row.count; ++i)
+			memcpy(output + i * Channels, row.source->Sample(row.x0 + i, row.y).GetValues(), sizeof(float) * Channels);
+	}
+
+	template <PassGraph::PointFunc point, int inputCount>
+	void AsStencil(const PassGraph::Row& row, const PassGraph::View* inputs, float* output)
+	{
+		const float* rows[inputCount];
+		for (int i = 0; i < inputCount; ++i)
+			rows[i] = inputs[i].At(row.x0, row.y);
+		point(row, rows, output);
+	}
+
+	// The mean of the (2 radius + 1)^2 pixels around each pixel.
+	template <int radius>
+	void Box(const PassGraph::Row& row, const PassGraph::View* inputs, float* output)
+	{
+		const float norm = 1.0f / ((2 * radius + 1) * (2 * radius + 1));
+		for (int i = 0; i < row.count; ++i)
+		{
+			float sum[Channels] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int dy = -radius; dy <= radius; ++dy)
+				for (int dx = -radius; dx <= radius; ++dx)
+				{
+					const float* tap = inputs[0].At(row.x0 + i + dx, row.y + dy);
+					for (int c = 0; c < Channels; ++c)
+						sum[c] += tap[c];
+				}
+			for (int c = 0; c < Channels; ++c)
+				output[i * Channels + c] = sum[c] * norm;
+		}
+	}
+
+	struct PassEntry
+	{
+		PassGraph::PointFunc point;		// 0 for stencil passes
+		PassGraph::StencilFunc stencil;	// the stencil pass, or the point pass as one
+		int radius;
+		int inputs[2];					// -1 where unused
+	};
+
+	const int MaxPasses = 8;
+
+	struct GraphEntry
+	{
+		const char* name;
+		int passCount;
+		PassEntry passes[MaxPasses];
+	};
+
+	const GraphEntry s_Graphs[] =
+	{
+		// passes 2 and 3 fuse, and 3 is needed 3 pixels past the tile for
+		// pass 4, so pass 2 runs there too and reads that far into pass 1
+		{ "point passes fused with a wider one", 6,
+		{
+			{ Source, 0, 0, { -1, -1 } },
+			{ 0, Box<1>, 1, { 0, -1 } },
+			{ Scale, AsStencil<Scale, 1>, 0, { 1, -1 } },
+			{ Scale, AsStencil<Scale, 1>, 0, { 0, -1 } },
+			{ 0, Box<3>, 3, { 3, -1 } },
+			{ Mix, AsStencil<Mix, 2>, 0, { 2, 4 } },
+		} },
+		// the bloom's shape: the source is read again at the end
+		{ "stencil chain with the source read twice", 5,
+		{
+			{ Source, 0, 0, { -1, -1 } },
+			{ Scale, AsStencil<Scale, 1>, 0, { 0, -1 } },
+			{ 0, Box<2>, 2, { 1, -1 } },
+			{ 0, Box<4>, 4, { 2, -1 } },
+			{ Mix, AsStencil<Mix, 2>, 0, { 0, 3 } },
+		} },
+	};
+
+	// Where the renderer's image and the source image overlap and what is
+	// rendered of them: as in the plug-in, the image ends at the rendered
+	// rect's bottom right.
+	struct Setup
+	{
+		const char* name;
+		int sourceWidth;
+		int sourceHeight;
+		Renderer::Tile bounds;
+	};
+
+	const Setup s_Setups[] =
+	{
+		{ "whole image", 150, 100, { 0, 0, 150, 100 } },
+		// the halos past the rendered rect's right and bottom read the rest
+		// of the document
+		{ "sub-document", 200, 150, { 30, 20, 150, 100 } },
+	};
+
+	int AddPass(PassGraph& graph, const PassEntry& entry, bool fused)
+	{
+		if (entry.point == Source)
+			return graph.AddSource();
+		if (entry.point != 0 && fused)
+		{
+			if (entry.inputs[1] < 0)
+				return graph.AddPoint(entry.point, { entry.inputs[0] });
+			return graph.AddPoint(entry.point, { entry.inputs[0], entry.inputs[1] });
+		}
+		if (entry.inputs[1] < 0)
+			return graph.AddStencil(entry.stencil, entry.radius, { entry.inputs[0] });
+		return graph.AddStencil(entry.stencil, entry.radius, { entry.inputs[0], entry.inputs[1] });
+	}
+
+	// Every pass over the whole source image; returns the last.
+	std::vector<float> EvaluateWhole(const GraphEntry& entry, const Setup& setup, const TileCache& source)
+	{
+		int width = setup.sourceWidth;
+		int height = setup.sourceHeight;
+		std::vector<std::vector<float> > images(entry.passCount, std::vector<float>((size_t)width * height * Channels));
+
+		PassGraph::Row row;
+		row.x0 = 0;
+		row.count = width;
+		row.width = setup.bounds.right;
+		row.height = setup.bounds.bottom;
+		row.source = &source;
+		for (int p = 0; p < entry.passCount; ++p)
+		{
+			const PassEntry& pass = entry.passes[p];
+			for (int y = 0; y < height; ++y)
+			{
+				row.y = y;
+				float* output = &images[p][(size_t)y * width * Channels];
+				if (pass.point != 0)
+				{
+					const float* inputs[2] = { 0, 0 };
+					for (int i = 0; i < 2; ++i)
+						if (pass.inputs[i] >= 0)
+							inputs[i] = &images[pass.inputs[i]][(size_t)y * width * Channels];
+					pass.point(row, inputs, output);
+				}
+				else
+				{
+					PassGraph::View views[2];
+					for (int i = 0; i < 2; ++i)
+					{
+						views[i].data = pass.inputs[i] >= 0 ? &images[pass.inputs[i]][0] : 0;
+						views[i].rect.left = 0;
+						views[i].rect.top = 0;
+						views[i].rect.right = width;
+						views[i].rect.bottom = height;
+					}
+					pass.stencil(row, views, output);
+				}
+			}
+		}
+		return images[entry.passCount - 1];
+	}
+
+	// Evaluates the graph a renderer tile at a time over the setup's bounds
+	// and returns how many samples differ from the whole image run.
+	int Compare(const PassGraph& graph, const Setup& setup, const TileCache& source, const std::vector<float>& whole)
+	{
+		PassGraphContext context;
+		int differences = 0;
+		for (int top = setup.bounds.top; top < setup.bounds.bottom; top += Renderer::TileSize)
+		{
+			for (int left = setup.bounds.left; left < setup.bounds.right; left += Renderer::TileSize)
+			{
+				Renderer::Tile tile;
+				tile.left = left;
+				tile.top = top;
+				tile.right = std::min(left + Renderer::TileSize, setup.bounds.right);
+				tile.bottom = std::min(top + Renderer::TileSize, setup.bounds.bottom);
+
+				const float* output = graph.Evaluate(tile, setup.bounds.right, setup.bounds.bottom, &source, context);
+				int tileWidth = tile.right - tile.left;
+				for (int y = tile.top; y < tile.bottom; ++y)
+					for (int x = tile.left; x < tile.right; ++x)
+						for (int c = 0; c < Channels; ++c)
+							if (output[((size_t)(y - tile.top) * tileWidth + (x - tile.left)) * Channels + c] !=
+								whole[((size_t)y * setup.sourceWidth + x) * Channels + c])
+								++differences;
+			}
+		}
+		return differences;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	for (size_t s = 0; s < sizeof(s_Setups) / sizeof(s_Setups[0]); ++s)
+	{
+		const Setup& setup = s_Setups[s];
+		std::vector<float> image((size_t)setup.sourceWidth * setup.sourceHeight * Channels);
+		for (size_t i = 0; i < image.size(); ++i)
+			image[i] = (float)((i * 2654435761u) % 1021) / 1020.0f;
+
+		TileCache source([&](const Renderer::Tile& rect, PixelLayout& pixels)
+		{
+			pixels.data = &image[((size_t)rect.top * setup.sourceWidth + rect.left) * Channels];
+			pixels.rowBytes = setup.sourceWidth * Channels * sizeof(float);
+			pixels.columnBytes = Channels * sizeof(float);
+			pixels.planeBytes = sizeof(float);
+			return true;
+		}, setup.sourceWidth, setup.sourceHeight, Channels, 32, 1 << 10);
+		Renderer::Tile all = { 0, 0, setup.sourceWidth, setup.sourceHeight };
+		source.Prepare(all);
+
+		for (size_t g = 0; g < sizeof(s_Graphs) / sizeof(s_Graphs[0]); ++g)
+		{
+			const GraphEntry& entry = s_Graphs[g];
+			std::vector<float> whole = EvaluateWhole(entry, setup, source);
+			for (int fused = 1; fused >= 0; --fused)
+			{
+				PassGraph graph;
+				for (int p = 0; p < entry.passCount; ++p)
+					AddPass(graph, entry.passes[p], fused != 0);
+				graph.Compile();
+
+				int differences = Compare(graph, setup, source, whole);
+				printf("%-42s %-12s %-8s %6d samples differ\n", entry.name, setup.name, fused ? "fused" : "unfused",
+					differences);
+				if (differences != 0)
+					++failures;
+			}
+		}
+	}
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
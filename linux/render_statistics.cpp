@@ -0,0 +1,171 @@
+// Checks the Statistics the renderer gathers while rendering. Every kernel
+// is rendered at each worker count and tile order with statistics on, and
+// each time the statistics are compared two ways:
+//
+//	against the first render, exactly: counts, extremes, histograms and the
+//	    bits of the means must not depend on who rendered which tile when
+//	against a brute-force pass over the finished 32-bit pixels in row
+//	    order: counts, extremes and histograms exactly, means to within
+//	    the rounding of summing in another order
+//
+//	render_statistics
+//-------------------------------------------------------------------------------
+#include "renderer/renderer.h"
+#include "kernels/samplekernels.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+	// Crosses tile edges, so every order visits the tiles differently.
+	const int ImageWidth = 300;
+	const int ImageHeight = 200;
+	const int Planes = 3;
+
+	// Sums over the pixels in another order agree to about this.
+	const double MeanTolerance = 1e-12;
+
+	struct KernelEntry
+	{
+		const char* name;
+		Renderer* (*create)(int threads);
+	};
+
+	Renderer* CreatePixel(int threads) { return new Renderer(kernel, ImageWidth, ImageHeight, Planes, threads); }
+	Renderer* CreatePacket(int threads) { return new Renderer(kernelPacket<FastMath::Precise>, ImageWidth, ImageHeight, Planes, threads); }
+
+	const KernelEntry s_Kernels[] =
+	{
+		{ "pixel", CreatePixel },
+		{ "packet", CreatePacket },
+	};
+
+	const int s_ThreadCounts[] = { 1, 2, 4 };
+
+	struct OrderEntry
+	{
+		const char* name;
+		Renderer::TileOrder order;
+	};
+
+	const OrderEntry s_Orders[] =
+	{
+		{ "rows", Renderer::TileOrderRows },
+		{ "tiled", Renderer::TileOrderTiled },
+		{ "morton", Renderer::TileOrderMorton },
+		{ "hilbert", Renderer::TileOrderHilbert },
+	};
+
+	// The statistics of the pixels of a 32-bit render, one pixel at a time
+	// in row order, binned as the renderer bins them.
+	Renderer::Statistics BruteForce(Renderer& renderer)
+	{
+		Renderer::Statistics statistics;
+		memset(&statistics, 0, sizeof(statistics));
+		for (int c = 0; c < Renderer::Statistics::Channels; ++c)
+		{
+			statistics.minimum[c] = FLT_MAX;
+			statistics.maximum[c] = -FLT_MAX;
+		}
+
+		PixelLayout layout = renderer.GetPixelLayout();
+		double sums[Renderer::Statistics::Channels] = { 0.0, 0.0, 0.0, 0.0 };
+		for (int y = 0; y < ImageHeight; ++y)
+		{
+			for (int x = 0; x < ImageWidth; ++x)
+			{
+				for (int c = 0; c < Planes; ++c)
+				{
+					float value;
+					memcpy(&value, static_cast<const unsigned char*>(layout.data) +
+						y * layout.rowBytes + x * layout.columnBytes + c * layout.planeBytes, sizeof(value));
+					statistics.minimum[c] = std::min(statistics.minimum[c], value);
+					statistics.maximum[c] = std::max(statistics.maximum[c], value);
+					sums[c] += value;
+					int bin = value > 0.0f ? (int)std::min(value * Renderer::Statistics::Bins, (float)(Renderer::Statistics::Bins - 1)) : 0;
+					++statistics.histogram[c][bin];
+				}
+			}
+		}
+
+		statistics.pixelCount = (long long)ImageWidth * ImageHeight;
+		for (int c = 0; c < Planes; ++c)
+			statistics.mean[c] = sums[c] / statistics.pixelCount;
+		return statistics;
+	}
+
+	// Whether two sets of statistics agree, means to within tolerance
+	// relative to their size; what differs goes to problem.
+	bool Matches(const Renderer::Statistics& statistics, const Renderer::Statistics& expected, double tolerance, const char*& problem)
+	{
+		problem = "";
+		if (statistics.pixelCount != expected.pixelCount)
+			problem = "pixel count";
+		for (int c = 0; c < Planes; ++c)
+		{
+			if (memcmp(&statistics.minimum[c], &expected.minimum[c], sizeof(float)) != 0 ||
+				memcmp(&statistics.maximum[c], &expected.maximum[c], sizeof(float)) != 0)
+				problem = "minimum or maximum";
+			if (memcmp(statistics.histogram[c], expected.histogram[c], sizeof(statistics.histogram[c])) != 0)
+				problem = "histogram";
+			double difference = fabs(statistics.mean[c] - expected.mean[c]);
+			if (tolerance == 0.0 ? memcmp(&statistics.mean[c], &expected.mean[c], sizeof(double)) != 0 :
+				!(difference <= tolerance * std::max(fabs(expected.mean[c]), 1.0)))
+				problem = "mean";
+		}
+		return *problem == '\0';
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	for (size_t k = 0; k < sizeof(s_Kernels) / sizeof(s_Kernels[0]); ++k)
+	{
+		const KernelEntry& entry = s_Kernels[k];
+		Renderer::Statistics first;
+		bool haveFirst = false;
+
+		for (size_t t = 0; t < sizeof(s_ThreadCounts) / sizeof(s_ThreadCounts[0]); ++t)
+		{
+			std::unique_ptr<Renderer> renderer(entry.create(s_ThreadCounts[t]));
+			renderer->SetDeterministic(true);
+			renderer->SetCollectStatistics(true);
+			for (size_t o = 0; o < sizeof(s_Orders) / sizeof(s_Orders[0]); ++o)
+			{
+				renderer->SetTileOrder(s_Orders[o].order);
+				renderer->Render();
+				const Renderer::Statistics& statistics = renderer->GetStatistics();
+				if (!haveFirst)
+				{
+					first = statistics;
+					haveFirst = true;
+				}
+
+				const char* againstFirst;
+				const char* againstBruteForce;
+				bool same = Matches(statistics, first, 0.0, againstFirst);
+				bool correct = Matches(statistics, BruteForce(*renderer), MeanTolerance, againstBruteForce);
+				std::string problems;
+				if (!same)
+					problems += std::string(", the ") + againstFirst + " differs from the first render";
+				if (!correct)
+					problems += std::string(", the ") + againstBruteForce + " differs from brute force";
+				printf("%-7s %d thread%s, %-8s %s%s\n", entry.name, s_ThreadCounts[t], s_ThreadCounts[t] == 1 ? " " : "s",
+					s_Orders[o].name, problems.empty() ? "ok" : "FAILED", problems.c_str());
+				if (!same || !correct)
+					++failures;
+			}
+		}
+	}
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Checks ShaderProgram's compiler and ShaderCache: shaders that compile
+// must render what their source says, shaders that do not must fail with
+// the error and line expected, and the cache must hand back a program that
+// renders the same whether it was compiled, kept in memory or read back
+// from its directory.
+//
+//	shader_compiler
+//
+// Sources too big to write out are generated: enough distinct constants,
+// variables or temporaries in one expression to run out of operand indices.
+//-------------------------------------------------------------------------------
+#include "shader/shadercache.h"
+#include "shader/shaderprogram.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+	const int SpanWidth = 16;
+	const int Channels = 4;
+
+	// Enough of anything to pass the compiler's 0x4000 operand indices.
+	const int Overflow = 0x4000 + 16;
+
+	std::string ManyConstants()
+	{
+		std::string source;
+		char line[64];
+		for (int i = 0; i < Overflow; ++i)
+		{
+			snprintf(line, sizeof(line), "out.r = out.r + x * %d.0;\n", i);
+			source += line;
+		}
+		return source;
+	}
+
+	std::string ManyVariables()
+	{
+		std::string source;
+		char line[64];
+		for (int i = 0; i < Overflow; ++i)
+		{
+			snprintf(line, sizeof(line), "float v%d = x;\n", i);
+			source += line;
+		}
+		return source;
+	}
+
+	std::string ManyTemporaries()
+	{
+		std::string source = "out.r = x * y";
+		for (int i = 0; i < Overflow; ++i)
+			source += " + x * y";
+		return source + ";\n";
+	}
+
+	struct Expected
+	{
+		float r, g, b, a;
+	};
+
+	// A shader that compiles, and what it gives at pixel x of row y.
+	struct ShaderEntry
+	{
+		const char* name;
+		const char* source;
+		Expected (*expected)(int x, int y);
+	};
+
+	Expected Gradient(int x, int y)
+	{
+		Expected expected = { (float)x / SpanWidth, 1.0f, x > 3 ? 1.0f : 0.0f, 1.0f - (float)y / SpanWidth };
+		return expected;
+	}
+
+	Expected Defaults(int, int)
+	{
+		Expected expected = { 0.0f, 0.0f, 0.0f, 1.0f };
+		return expected;
+	}
+
+	const ShaderEntry s_Shaders[] =
+	{
+		{ "simple shader",
+			"// a gradient\n"
+			"float half = 0.5 * 2.0;\n"
+			"out.r = uv.x;\n"
+			"out.g = half;\n"
+			"out.b = x > 3.0 ? 1.0 : 0.0;\n"
+			"out.a = 1.0 - y / width;\n",
+			Gradient },
+		{ "empty shader", "// nothing\n", Defaults },
+	};
+
+	// A shader that must not compile, and what its error says.
+	struct ErrorEntry
+	{
+		const char* name;
+		std::string (*source)();
+		const char* error;
+	};
+
+	std::string SyntaxError() { return "out.r = x;\nout.g = (y + ;\n"; }
+	std::string UnknownName() { return "out.r = z;\n"; }
+	std::string InputAssigned() { return "uv.x = 1.0;\n"; }
+	std::string WrongArguments() { return "out.r = pow(x);\n"; }
+
+	const ErrorEntry s_Errors[] =
+	{
+		{ "syntax error", SyntaxError, "line 2: expected an expression" },
+		{ "unknown name", UnknownName, "line 1: unknown name z" },
+		{ "assignment to an input", InputAssigned, "cannot assign to uv.x" },
+		{ "wrong argument count", WrongArguments, "line 1: pow takes 2 arguments" },
+		{ "too many constants", ManyConstants, "line 16385: too many constants" },
+		{ "too many variables", ManyVariables, "too many variables near" },
+		{ "too many temporaries", ManyTemporaries, "line 1: too many variables and temporaries" },
+	};
+
+	// How many of row y's pixels the program gets wrong.
+	int Verify(const ShaderProgram& program, const ShaderEntry& entry, int y)
+	{
+		float pixels[SpanWidth * Channels];
+		Renderer::Span span;
+		span.y = y;
+		span.x0 = 0;
+		span.x1 = SpanWidth;
+		span.width = SpanWidth;
+		span.height = SpanWidth;
+		span.output = pixels;
+		span.stride = Channels;
+		span.planeStride = 1;
+		span.channels = Channels;
+		span.source = 0;
+		program.Run(span);
+
+		int wrong = 0;
+		for (int x = 0; x < SpanWidth; ++x)
+		{
+			Expected expected = entry.expected(x, y);
+			const float* pixel = pixels + x * Channels;
+			if (fabsf(pixel[0] - expected.r) > 1e-6f || fabsf(pixel[1] - expected.g) > 1e-6f ||
+				fabsf(pixel[2] - expected.b) > 1e-6f || fabsf(pixel[3] - expected.a) > 1e-6f)
+				++wrong;
+		}
+		return wrong;
+	}
+
+	bool Report(const char* name, const char* how, bool passed, const std::string& detail)
+	{
+		printf("%-28s %-22s %s%s%s\n", name, how, passed ? "ok" : "FAILED", detail.empty() ? "" : ": ", detail.c_str());
+		return passed;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+
+	for (size_t s = 0; s < sizeof(s_Shaders) / sizeof(s_Shaders[0]); ++s)
+	{
+		const ShaderEntry& entry = s_Shaders[s];
+		ShaderProgram program;
+		std::string error;
+		bool compiled = program.Compile(entry.source, error);
+		int wrong = compiled ? Verify(program, entry, 0) + Verify(program, entry, 5) : 0;
+		if (!Report(entry.name, "compiled", compiled && wrong == 0, compiled ? "" : error))
+			++failures;
+	}
+
+	for (size_t e = 0; e < sizeof(s_Errors) / sizeof(s_Errors[0]); ++e)
+	{
+		const ErrorEntry& entry = s_Errors[e];
+		ShaderProgram program;
+		std::string error;
+		bool compiled = program.Compile(entry.source(), error);
+		bool passed = !compiled && error.find(entry.error) != std::string::npos &&
+			program.GetInstructionCount() == 0;
+		if (!Report(entry.name, "rejected", passed, compiled ? "compiled" : error))
+			++failures;
+	}
+
+	// the cache in memory, then a second cache reading what the first wrote
+	char directory[] = "/tmp/shader_compiler.XXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+
+	const ShaderEntry& entry = s_Shaders[0];
+	std::string error;
+	ShaderCache first;
+	first.SetDirectory(directory);
+	const ShaderProgram* compiled = first.Get(entry.source, error);
+	const ShaderProgram* kept = first.Get(entry.source, error);
+	if (!Report(entry.name, "cached in memory", compiled != 0 && kept == compiled && Verify(*kept, entry, 5) == 0, error))
+		++failures;
+
+	char path[64];
+	snprintf(path, sizeof(path), "%s/%016llx.sfbc", directory, (unsigned long long)ShaderCache::Hash(entry.source));
+	FILE* file = fopen(path, "rb");
+	if (!Report(entry.name, "written to disk", file != NULL, ""))
+		++failures;
+	if (file != NULL)
+		fclose(file);
+
+	ShaderCache second;
+	second.SetDirectory(directory);
+	const ShaderProgram* read = second.Get(entry.source, error);
+	bool same = compiled != 0 && read != 0 && read->GetInstructionCount() == compiled->GetInstructionCount() &&
+		read->GetRegisterCount() == compiled->GetRegisterCount() && Verify(*read, entry, 5) == 0;
+	if (!Report(entry.name, "read back from disk", same, error))
+		++failures;
+
+	const ShaderProgram* broken = second.Get(SyntaxError(), error);
+	if (!Report(s_Errors[0].name, "rejected by the cache", broken == 0 && error.find(s_Errors[0].error) != std::string::npos, error))
+		++failures;
+
+	remove(path);
+	rmdir(directory);
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,530 @@
+// Renderer throughput benchmark. Renders the sample kernels over a grid of
+// image sizes, worker counts and output depths and reports per-phase times
+// and megapixels per second, optionally as JSON for regression tracking.
+//
+//	shaderfilter_bench [--sizes 256,1024,4096] [--threads 1,2,4,...]
+//	                   [--kernels pixel,span,packet,packet-fast,shader]
+//	                   [--depths 8,16,32] [--dither] [--planar] [--planes N] [--repeat N]
+//	                   [--json file|-] [--trace file.json]
+//	                   [--huge-pages off|transparent|explicit]
+//	                   [--order rows|tiled|morton|hilbert|auto] [--supersample N] [--statistics]
+//
+// Phases:
+//	setup   Renderer construction: worker start-up
+//	render  Renderer::Render, including the first-use buffer allocation and,
+//	        below 32 bits, quantization to the output depth. Buffers come
+//	        from the BufferArena pool, so only a size's first run pays
+//	        for page faults
+//	copy    the banded copy into a host-layout buffer that
+//	        CopyRenderedImageToPhotoshop performs
+//
+// --trace records profiler zones for every run into one Chrome trace; zone
+// overhead is included in the reported times.
+//
+// The softfocus kernel (not run by default) samples a synthetic source image
+// held whole in a TileCache, so --order shows how the tile order treats the
+// caches. Where the kernel's perf counters are readable (Linux, with
+// perf_event_paranoid permitting), render's cache misses are reported too.
+//
+// --supersample N turns on adaptive supersampling with N x N samples at
+// edges; it applies to the packet kernels, and spp reports the kernel
+// evaluations it made per pixel. --statistics gathers Renderer::Statistics
+// during every render, so its cost shows in render.
+//-------------------------------------------------------------------------------
+#include "renderer/renderer.h"
+#include "renderer/bufferarena.h"
+#include "renderer/pixelcopy.h"
+#include "renderer/tilecache.h"
+#include "kernels/samplekernels.h"
+#include "shader/shaderprogram.h"
+#include "time/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct KernelEntry
+	{
+		const char* name;
+		Renderer* (*create)(int width, int height, int planes, int threads);
+	};
+
+	Renderer* CreatePixel(int width, int height, int planes, int threads)
+	{
+		return new Renderer(kernel, width, height, planes, threads);
+	}
+
+	Renderer* CreateSpan(int width, int height, int planes, int threads)
+	{
+		return new Renderer(kernelSpan, width, height, planes, threads);
+	}
+
+	Renderer* CreatePacket(int width, int height, int planes, int threads)
+	{
+		return new Renderer(kernelPacket<FastMath::Precise>, width, height, planes, threads);
+	}
+
+	Renderer* CreatePacketFast(int width, int height, int planes, int threads)
+	{
+		return new Renderer(kernelPacket<FastMath::Fast>, width, height, planes, threads);
+	}
+
+	// The sample kernel in the shader language, to compare the bytecode
+	// interpreter with the compiled packet kernel.
+	const char* s_PatternShader =
+		"float u = (uv.x * 2.0 - 1.0) * (width / height);\n"
+		"float v = uv.y * 2.0 - 1.0;\n"
+		"float t = clamp(pow(1.0 / (u * 300.0 + sin(v * 5.0) * 50.0), 0.75), 0.0, 1.0);\n"
+		"out.r = min(t * 2.0, 1.0);\n"
+		"out.g = min(t * 4.0, 1.0);\n"
+		"out.b = min(t * 8.0, 1.0);\n";
+
+	Renderer* CreateShader(int width, int height, int planes, int threads)
+	{
+		static ShaderProgram program;
+		if (program.GetInstructionCount() == 0)
+		{
+			std::string error;
+			if (!program.Compile(s_PatternShader, error))
+				fprintf(stderr, "shader: %s\n", error.c_str());
+		}
+		return new Renderer(program, width, height, planes, threads);
+	}
+
+	// The synthetic source the sampling kernels read, rebuilt when the
+	// image changes.
+	std::vector<unsigned char> s_SourceImage;
+	std::unique_ptr<TileCache> s_Source;
+
+	TileCache* GetSource(int width, int height, int planes)
+	{
+		if (s_Source && s_Source->GetWidth() == width && s_Source->GetHeight() == height && s_Source->GetChannels() == planes)
+			return s_Source.get();
+
+		s_Source.reset();
+		s_SourceImage.resize((size_t)width * height * planes);
+		for (size_t i = 0; i < s_SourceImage.size(); ++i)
+			s_SourceImage[i] = (unsigned char)((i * 2654435761u) >> 24);
+
+		TileCache::FetchFunc fetch = [width, planes](const Renderer::Tile& rect, PixelLayout& pixels)
+		{
+			pixels.data = &s_SourceImage[((size_t)rect.top * width + rect.left) * planes];
+			pixels.rowBytes = (ptrdiff_t)width * planes;
+			pixels.columnBytes = planes;
+			pixels.planeBytes = 1;
+			return true;
+		};
+		Renderer::Tile image = { 0, 0, width, height };
+		s_Source.reset(new TileCache(fetch, width, height, planes, 8, Renderer::CountTiles(image)));
+		s_Source->Prepare(image);
+		return s_Source.get();
+	}
+
+	Renderer* CreateSoftFocus(int width, int height, int planes, int threads)
+	{
+		Renderer* renderer = new Renderer(kernelSoftFocus, width, height, planes, threads);
+		renderer->SetSource(GetSource(width, height, planes));
+		return renderer;
+	}
+
+	// Cache misses of this process and of the threads it starts while the
+	// counter is open, so open it before the renderer's workers start.
+	class CacheMissCounter
+	{
+	public:
+
+		CacheMissCounter()
+			: m_File(-1)
+		{
+#if defined(__linux__)
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			m_File = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+		}
+
+		~CacheMissCounter()
+		{
+#if defined(__linux__)
+			if (m_File >= 0)
+				close(m_File);
+#endif
+		}
+
+		void Start()
+		{
+#if defined(__linux__)
+			if (m_File >= 0)
+				ioctl(m_File, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+		}
+
+		// Misses counted so far, or -1 when unavailable.
+		long long Stop()
+		{
+			long long count = -1;
+#if defined(__linux__)
+			if (m_File >= 0)
+			{
+				ioctl(m_File, PERF_EVENT_IOC_DISABLE, 0);
+				if (read(m_File, &count, sizeof(count)) != sizeof(count))
+					count = -1;
+			}
+#endif
+			return count;
+		}
+
+	private:
+
+		CacheMissCounter(const CacheMissCounter&);
+		CacheMissCounter& operator =(const CacheMissCounter&);
+
+		int m_File;
+	};
+
+	const KernelEntry s_Kernels[] =
+	{
+		{ "pixel", CreatePixel },
+		{ "span", CreateSpan },
+		{ "packet", CreatePacket },
+		{ "packet-fast", CreatePacketFast },
+		{ "shader", CreateShader },
+		{ "softfocus", CreateSoftFocus },
+	};
+
+	struct OrderEntry
+	{
+		const char* name;
+		Renderer::TileOrder order;
+	};
+
+	const OrderEntry s_Orders[] =
+	{
+		{ "rows", Renderer::TileOrderRows },
+		{ "tiled", Renderer::TileOrderTiled },
+		{ "morton", Renderer::TileOrderMorton },
+		{ "hilbert", Renderer::TileOrderHilbert },
+		{ "auto", Renderer::TileOrderAuto },
+	};
+
+	struct Result
+	{
+		std::string kernel;
+		std::string order;
+		int width;
+		int height;
+		int planes;
+		int threads;
+		int depth;
+		double setupMs;
+		double renderMs;
+		double copyMs;
+		long long cacheMisses;
+		double samplesPerPixel;
+	};
+
+	inline double ElapsedMs(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		for (const char* p = text; *p; )
+		{
+			values.push_back(atoi(p));
+			const char* comma = strchr(p, ',');
+			if (comma == NULL)
+				break;
+			p = comma + 1;
+		}
+		return values;
+	}
+
+	std::vector<std::string> ParseNames(const char* text)
+	{
+		std::vector<std::string> names;
+		std::string list(text);
+		size_t start = 0;
+		while (start <= list.size())
+		{
+			size_t comma = list.find(',', start);
+			if (comma == std::string::npos)
+				comma = list.size();
+			names.push_back(list.substr(start, comma - start));
+			start = comma + 1;
+		}
+		return names;
+	}
+
+	// Same work as CopyRenderedImageToPhotoshop: bands of rows copied in
+	// parallel into an interleaved buffer laid out like Photoshop's outData
+	// for an all-planes request.
+	void CopyOut(Renderer& renderer, int width, int height, int planes, int depth, std::vector<unsigned char>& output)
+	{
+		const int bandHeight = 32;
+		int bytesPerSample = depth / 8;
+		output.resize((size_t)width * height * planes * bytesPerSample);
+
+		PixelLayout destination;
+		destination.data = &output[0];
+		destination.planeBytes = bytesPerSample;
+		destination.columnBytes = planes * bytesPerSample;
+		destination.rowBytes = width * destination.columnBytes;
+
+		PixelLayout source = renderer.GetPixelLayout();
+		renderer.GetWorkerPool().Run((height + bandHeight - 1) / bandHeight, [&](int band, int)
+		{
+			int top = band * bandHeight;
+			PixelCopy::CopyRows(source, destination, width, planes, bytesPerSample, top, std::min(top + bandHeight, height));
+		});
+	}
+
+	void WriteJson(FILE* file, const std::vector<Result>& results, int repeat)
+	{
+		fprintf(file, "{\n  \"hardware_threads\": %u,\n  \"repeat\": %d,\n  \"results\": [\n",
+			std::thread::hardware_concurrency(), repeat);
+
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			double megapixels = r.width * (double)r.height * 1e-6;
+			fprintf(file,
+				"    { \"kernel\": \"%s\", \"order\": \"%s\", \"width\": %d, \"height\": %d, \"planes\": %d, \"threads\": %d, \"depth\": %d, "
+				"\"setup_ms\": %.3f, \"render_ms\": %.3f, \"copy_ms\": %.3f, \"total_ms\": %.3f, "
+				"\"render_mpixels_per_sec\": %.3f, \"total_mpixels_per_sec\": %.3f, \"samples_per_pixel\": %.3f, ",
+				r.kernel.c_str(), r.order.c_str(), r.width, r.height, r.planes, r.threads, r.depth,
+				r.setupMs, r.renderMs, r.copyMs, r.setupMs + r.renderMs + r.copyMs,
+				megapixels / (r.renderMs * 1e-3), megapixels / ((r.setupMs + r.renderMs + r.copyMs) * 1e-3), r.samplesPerPixel);
+			if (r.cacheMisses >= 0)
+				fprintf(file, "\"render_cache_misses\": %lld }%s\n", r.cacheMisses, i + 1 < results.size() ? "," : "");
+			else
+				fprintf(file, "\"render_cache_misses\": null }%s\n", i + 1 < results.size() ? "," : "");
+		}
+
+		fprintf(file, "  ]\n}\n");
+	}
+
+	const OrderEntry* FindOrder(const char* name)
+	{
+		for (size_t i = 0; i < sizeof(s_Orders) / sizeof(s_Orders[0]); ++i)
+			if (strcmp(name, s_Orders[i].name) == 0)
+				return &s_Orders[i];
+		return NULL;
+	}
+
+	void PrintUsage(const char* program)
+	{
+		fprintf(stderr,
+			"usage: %s [--sizes 256,1024,4096] [--threads 1,2,4] [--kernels pixel,span,packet,packet-fast,shader]\n"
+			"          [--depths 8,16,32] [--dither] [--planar] [--planes N] [--repeat N] [--json file|-] [--trace file.json]\n"
+			"          [--huge-pages off|transparent|explicit] [--order rows|tiled|morton|hilbert|auto] [--supersample N] [--statistics]\n", program);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> sizes = ParseList("256,1024,4096");
+	std::vector<int> depths = ParseList("8,16,32");
+	std::vector<std::string> kernels = ParseNames("pixel,span,packet,packet-fast,shader");
+	std::vector<int> threads;
+	for (int count = 1; count < WorkerPool::DefaultWorkerCount(); count *= 2)
+		threads.push_back(count);
+	threads.push_back(WorkerPool::DefaultWorkerCount());
+
+	int planes = 4;
+	int repeat = 3;
+	const char* jsonPath = NULL;
+	const char* tracePath = NULL;
+	bool dither = false;
+	bool planar = false;
+	const OrderEntry* order = FindOrder("auto");
+	int supersample = 1;
+	bool statistics = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		if (strcmp(option, "--dither") == 0)
+		{
+			dither = true;
+			continue;
+		}
+		if (strcmp(option, "--planar") == 0)
+		{
+			planar = true;
+			continue;
+		}
+		if (strcmp(option, "--statistics") == 0)
+		{
+			statistics = true;
+			continue;
+		}
+
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL)
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+
+		if (strcmp(option, "--sizes") == 0)
+			sizes = ParseList(value);
+		else if (strcmp(option, "--threads") == 0)
+			threads = ParseList(value);
+		else if (strcmp(option, "--kernels") == 0)
+			kernels = ParseNames(value);
+		else if (strcmp(option, "--depths") == 0)
+			depths = ParseList(value);
+		else if (strcmp(option, "--planes") == 0)
+			planes = atoi(value);
+		else if (strcmp(option, "--repeat") == 0)
+			repeat = std::max(atoi(value), 1);
+		else if (strcmp(option, "--json") == 0)
+			jsonPath = value;
+		else if (strcmp(option, "--trace") == 0)
+			tracePath = value;
+		else if (strcmp(option, "--supersample") == 0)
+			supersample = std::max(atoi(value), 1);
+		else if (strcmp(option, "--order") == 0 && FindOrder(value) != NULL)
+			order = FindOrder(value);
+		else if (strcmp(option, "--huge-pages") == 0 && strcmp(value, "off") == 0)
+			BufferArena::SetHugePages(BufferArena::HugePagesOff);
+		else if (strcmp(option, "--huge-pages") == 0 && strcmp(value, "transparent") == 0)
+			BufferArena::SetHugePages(BufferArena::HugePagesTransparent);
+		else if (strcmp(option, "--huge-pages") == 0 && strcmp(value, "explicit") == 0)
+			BufferArena::SetHugePages(BufferArena::HugePagesExplicit);
+		else
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+		++i;
+	}
+
+	std::vector<Result> results;
+	std::vector<unsigned char> output;
+	Profiler::SetEnabled(tracePath != NULL);
+
+	fprintf(stderr, "%-12s %-8s %7s %7s %4s %8s %10s %10s %10s %12s %14s %6s\n",
+		"kernel", "order", "size", "threads", "bits", "setup ms", "render ms", "copy ms", "total ms", "render MP/s", "cache misses", "spp");
+
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		const KernelEntry* entry = NULL;
+		for (size_t e = 0; e < sizeof(s_Kernels) / sizeof(s_Kernels[0]); ++e)
+			if (kernels[k] == s_Kernels[e].name)
+				entry = &s_Kernels[e];
+		if (entry == NULL)
+		{
+			fprintf(stderr, "unknown kernel %s\n", kernels[k].c_str());
+			return 2;
+		}
+
+		for (size_t s = 0; s < sizes.size(); ++s)
+		{
+			for (size_t t = 0; t < threads.size(); ++t)
+			{
+				for (size_t d = 0; d < depths.size(); ++d)
+				{
+					// best of repeat runs for each phase
+					Result result;
+					result.kernel = entry->name;
+					result.order = order->name;
+					result.width = result.height = sizes[s];
+					result.planes = planes;
+					result.threads = threads[t];
+					result.depth = depths[d];
+					result.setupMs = result.renderMs = result.copyMs = 1e300;
+					result.cacheMisses = -1;
+					result.samplesPerPixel = 1.0;
+
+					for (int r = 0; r < repeat; ++r)
+					{
+						CacheMissCounter misses;
+						Clock::time_point start = Clock::now();
+						std::unique_ptr<Renderer> renderer(entry->create(sizes[s], sizes[s], planes, threads[t]));
+						renderer->SetOutputDepth(depths[d], dither);
+						renderer->SetLayout(planar ? Renderer::Planar : Renderer::Interleaved);
+						renderer->SetTileOrder(order->order);
+						renderer->SetSupersampling(supersample);
+						renderer->SetCollectStatistics(statistics);
+						result.setupMs = std::min(result.setupMs, ElapsedMs(start));
+
+						start = Clock::now();
+						misses.Start();
+						renderer->Render();
+						long long missCount = misses.Stop();
+						result.renderMs = std::min(result.renderMs, ElapsedMs(start));
+						if (missCount >= 0)
+							result.cacheMisses = result.cacheMisses < 0 ? missCount : std::min(result.cacheMisses, missCount);
+						if (renderer->GetSampleCount() > 0)
+							result.samplesPerPixel = renderer->GetSampleCount() / (sizes[s] * (double)sizes[s]);
+
+						PROFILE_ZONE("CopyOut");
+						start = Clock::now();
+						CopyOut(*renderer, sizes[s], sizes[s], planes, depths[d], output);
+						result.copyMs = std::min(result.copyMs, ElapsedMs(start));
+					}
+
+					results.push_back(result);
+					char missText[32] = "-";
+					if (result.cacheMisses >= 0)
+						snprintf(missText, sizeof(missText), "%lld", result.cacheMisses);
+					fprintf(stderr, "%-12s %-8s %7d %7d %4d %8.2f %10.2f %10.2f %10.2f %12.1f %14s %6.2f\n",
+						result.kernel.c_str(), result.order.c_str(), result.width, result.threads, result.depth,
+						result.setupMs, result.renderMs, result.copyMs,
+						result.setupMs + result.renderMs + result.copyMs,
+						result.width * (double)result.height * 1e-6 / (result.renderMs * 1e-3), missText, result.samplesPerPixel);
+				}
+			}
+		}
+	}
+
+	Profiler::SetEnabled(false);
+	if (tracePath != NULL && !Profiler::WriteChromeTrace(tracePath))
+	{
+		fprintf(stderr, "could not write %s\n", tracePath);
+		return 1;
+	}
+
+	if (jsonPath != NULL)
+	{
+		FILE* file = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+		if (file == NULL)
+		{
+			fprintf(stderr, "could not write %s\n", jsonPath);
+			return 1;
+		}
+		WriteJson(file, results, repeat);
+		if (file != stdout)
+			fclose(file);
+	}
+
+	return 0;
+}
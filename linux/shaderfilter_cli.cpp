@@ -0,0 +1,223 @@
+// Runs the filter outside Photoshop through HeadlessHost and writes the
+// result to disk.
+//
+//	shaderfilter_cli [--width N] [--height N] [--planes N] [--depth 8|16|32]
+//	                 [--output file.pfm|file.png|file.exr] [--trace file.json]
+//	                 [--threads N] [--deterministic] [--reference file.pfm [--ulps N]]
+//	                 [--seed N] [--mask]
+//
+// The document starts out as a pattern seeded by --seed (1 by default);
+// --mask selects a feathered ellipse from the same seed, so the selection
+// paths run too.
+//
+// --trace prints per-thread zone totals and writes a Chrome trace.
+//
+// --reference checks the result against a stored golden image, e.g. one an
+// earlier --output wrote, and fails if any sample PFM keeps is more than
+// --ulps representable floats away (0 by default). Run with --deterministic
+// the output must not depend on --threads, so one reference covers every
+// worker count; tolerances are per code path: 0 for a path compared to
+// itself, a few ulps between paths that round differently.
+//-------------------------------------------------------------------------------
+#include "ShaderFilter.h"
+#include "host/headlesshost.h"
+#include "host/imagefile.h"
+#include "time/profiler.h"
+#include "time/StopWatch.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+DLLExport MACPASCAL void PluginMain(const int16 selector,
+								    FilterRecordPtr filterRecord,
+								    intptr_t * data,
+								    int16 * result);
+
+static void PrintUsage(const char* program)
+{
+	fprintf(stderr,
+		"usage: %s [--width N] [--height N] [--planes N] [--depth 8|16|32]\n"
+		"          [--output file.pfm|file.png|file.exr] [--trace file.json]\n"
+		"          [--threads N] [--deterministic] [--reference file.pfm [--ulps N]]\n"
+		"          [--seed N] [--mask]\n", program);
+}
+
+// Position of value on a line where neighbouring floats are one apart and
+// -0 meets +0.
+static long long OrderedBits(float value)
+{
+	int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits < 0 ? (long long)INT_MIN - bits : bits;
+}
+
+// Diffs pixels against the reference's channels: the first three, or the
+// first alone, as WritePFM stored them. Returns false when the sizes differ
+// or a sample is more than ulps away.
+static bool CompareToReference(const char* path, const std::vector<float>& pixels, int width, int height, int planes, long long ulps)
+{
+	std::vector<float> reference;
+	int referenceWidth, referenceHeight, channels;
+	if (!ImageFile::ReadPFM(path, reference, referenceWidth, referenceHeight, channels))
+	{
+		fprintf(stderr, "could not read %s\n", path);
+		return false;
+	}
+	if (referenceWidth != width || referenceHeight != height || channels != (planes >= 3 ? 3 : 1))
+	{
+		fprintf(stderr, "%s is %dx%d with %d channels, the result %dx%d with %d planes\n",
+			path, referenceWidth, referenceHeight, channels, width, height, planes);
+		return false;
+	}
+
+	long long worst = 0;
+	size_t worstIndex = 0;
+	size_t differing = 0;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		float value = pixels[i / channels * planes + i % channels];
+		float expected = reference[i];
+		long long distance;
+		if (value != value || expected != expected)
+			distance = value != value && expected != expected ? 0 : LLONG_MAX;
+		else
+			distance = llabs(OrderedBits(value) - OrderedBits(expected));
+
+		if (distance != 0)
+			++differing;
+		if (distance > worst)
+		{
+			worst = distance;
+			worstIndex = i;
+		}
+	}
+
+	printf("%s: %zu of %zu samples differ, by at most %lld ulps\n", path, differing, reference.size(), worst);
+	if (worst <= ulps)
+		return true;
+
+	size_t pixel = worstIndex / channels;
+	fprintf(stderr, "over %lld ulps: pixel %zu,%zu channel %zu is %.9g, expected %.9g\n",
+		ulps, pixel % width, pixel / width, worstIndex % channels,
+		pixels[pixel * planes + worstIndex % channels], reference[worstIndex]);
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1920;
+	int height = 1080;
+	int planes = 3;
+	int depth = 32;
+	const char* output = "shaderfilter.pfm";
+	const char* tracePath = NULL;
+	const char* referencePath = NULL;
+	long long ulps = 0;
+	unsigned int seed = 1;
+	bool masked = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		if (strcmp(option, "--deterministic") == 0)
+		{
+			setenv("SHADERFILTER_DETERMINISTIC", "1", 1);
+			continue;
+		}
+		if (strcmp(option, "--mask") == 0)
+		{
+			masked = true;
+			continue;
+		}
+
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL)
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+
+		if (strcmp(option, "--width") == 0)
+			width = atoi(value);
+		else if (strcmp(option, "--height") == 0)
+			height = atoi(value);
+		else if (strcmp(option, "--planes") == 0)
+			planes = atoi(value);
+		else if (strcmp(option, "--depth") == 0)
+			depth = atoi(value);
+		else if (strcmp(option, "--output") == 0)
+			output = value;
+		else if (strcmp(option, "--trace") == 0)
+			tracePath = value;
+		else if (strcmp(option, "--threads") == 0)
+			setenv("SHADERFILTER_THREADS", value, 1);
+		else if (strcmp(option, "--reference") == 0)
+			referencePath = value;
+		else if (strcmp(option, "--ulps") == 0)
+			ulps = atoll(value);
+		else if (strcmp(option, "--seed") == 0)
+			seed = (unsigned int)strtoul(value, NULL, 10);
+		else
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+		++i;
+	}
+
+	if (width <= 0 || height <= 0 || planes < 1 || planes > 4 || (depth != 8 && depth != 16 && depth != 32))
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	HeadlessHost host(width, height, planes, depth);
+	host.FillPattern(seed);
+	if (masked)
+		host.SetMask(seed);
+
+	Profiler::SetEnabled(tracePath != NULL);
+
+	StopWatch stopWatch;
+	stopWatch.Start();
+	int16 result = host.Run(PluginMain);
+	stopWatch.Stop();
+	double seconds = stopWatch.ElapsedSeconds();
+
+	Profiler::SetEnabled(false);
+
+	if (result != noErr)
+	{
+		fprintf(stderr, "filter failed with result %d\n", result);
+		return 1;
+	}
+
+	printf("%dx%d, %d planes, %d-bit: %.3f s (%.2f Mpixel/s)\n",
+		width, height, planes, depth, seconds, width * (double)height / seconds * 1e-6);
+
+	if (tracePath != NULL)
+	{
+		Profiler::PrintStats(stdout);
+		if (!Profiler::WriteChromeTrace(tracePath))
+		{
+			fprintf(stderr, "could not write %s\n", tracePath);
+			return 1;
+		}
+	}
+
+	std::vector<float> pixels;
+	host.CopyToFloat(pixels);
+	if (!ImageFile::Write(output, &pixels[0], width, height, planes))
+	{
+		fprintf(stderr, "could not write %s\n", output);
+		return 1;
+	}
+
+	if (referencePath != NULL && !CompareToReference(referencePath, pixels, width, height, planes, ulps))
+		return 1;
+
+	return 0;
+}
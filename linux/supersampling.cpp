@@ -0,0 +1,126 @@
+// Checks adaptive supersampling against kernels whose right answer is
+// known. Each is rendered once per pixel and then supersampled on a 4 x 4
+// grid, and the two renders are compared:
+//
+//	flat: nothing to refine, so supersampling changes no pixel and costs
+//	    no more than the first pass, apron included
+//	edge: a vertical edge a quarter of the way into pixel column 50 gives
+//	    that column exactly 0.25 coverage; only the columns on either side
+//	    of the edge are resampled and every other pixel stays as it was
+//
+//	supersampling
+//-------------------------------------------------------------------------------
+#include "renderer/renderer.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	const int ImageWidth = 100;
+	const int ImageHeight = 66;
+	const int Planes = 3;
+	const int Grid = 4;
+
+	// The edge sits on a boundary between grid cells, so every jittered
+	// sample falls clearly on one side of it.
+	const float EdgeX = 50.25f;
+	const int EdgeColumn = 50;
+	const float EdgeCoverage = 0.25f;
+
+	void kernelFlat(const Floatx8&, const Floatx8&, const unsigned int&, const unsigned int&, Colorx8& outputColor)
+	{
+		outputColor.SetValues(Floatx8(0.25f), Floatx8(0.5f), Floatx8(0.75f), Floatx8(1.0f));
+	}
+
+	// 0 left of EdgeX, 1 from it on; pixel x covers [x - 0.5, x + 0.5).
+	void kernelEdge(const Floatx8& x, const Floatx8&, const unsigned int&, const unsigned int&, Colorx8& outputColor)
+	{
+		outputColor.SetValues(Select(x < Floatx8(EdgeX), Floatx8(0.0f), Floatx8(1.0f)));
+	}
+
+	// What a supersampled pixel should be, given its single-sample value.
+	float ExpectFlat(int, float single) { return single; }
+	float ExpectEdge(int x, float single) { return x == EdgeColumn ? EdgeCoverage : single; }
+
+	struct KernelEntry
+	{
+		const char* name;
+		Renderer::PacketKernelFunc kernel;
+		float (*expected)(int x, float single);
+		int resampledColumns;			// columns whose pixels get the grid
+	};
+
+	const KernelEntry s_Kernels[] =
+	{
+		{ "flat", kernelFlat, ExpectFlat, 0 },
+		{ "edge", kernelEdge, ExpectEdge, 2 },
+	};
+
+	float ReadSample(Renderer& renderer, int x, int y, int c)
+	{
+		PixelLayout layout = renderer.GetPixelLayout();
+		float value;
+		memcpy(&value, static_cast<const unsigned char*>(layout.data) +
+			y * layout.rowBytes + x * layout.columnBytes + c * layout.planeBytes, sizeof(value));
+		return value;
+	}
+
+	// Kernel evaluations of the once-per-pixel pass: every tile plus its
+	// one pixel apron, clipped to the image.
+	long long FirstPassSamples()
+	{
+		long long samples = 0;
+		for (int top = 0; top < ImageHeight; top += Renderer::TileSize)
+		{
+			for (int left = 0; left < ImageWidth; left += Renderer::TileSize)
+			{
+				int right = std::min(left + Renderer::TileSize, ImageWidth);
+				int bottom = std::min(top + Renderer::TileSize, ImageHeight);
+				samples += (long long)(std::min(right + 1, ImageWidth) - std::max(left - 1, 0)) *
+					(std::min(bottom + 1, ImageHeight) - std::max(top - 1, 0));
+			}
+		}
+		return samples;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	for (size_t k = 0; k < sizeof(s_Kernels) / sizeof(s_Kernels[0]); ++k)
+	{
+		const KernelEntry& entry = s_Kernels[k];
+		Renderer renderer(entry.kernel, ImageWidth, ImageHeight, Planes);
+		renderer.Render();
+		std::vector<float> single;
+		for (int y = 0; y < ImageHeight; ++y)
+			for (int x = 0; x < ImageWidth; ++x)
+				for (int c = 0; c < Planes; ++c)
+					single.push_back(ReadSample(renderer, x, y, c));
+
+		renderer.SetSupersampling(Grid);
+		renderer.Render();
+
+		int wrong = 0;
+		size_t index = 0;
+		for (int y = 0; y < ImageHeight; ++y)
+			for (int x = 0; x < ImageWidth; ++x)
+				for (int c = 0; c < Planes; ++c, ++index)
+					if (ReadSample(renderer, x, y, c) != entry.expected(x, single[index]))
+						++wrong;
+
+		long long expectedSamples = FirstPassSamples() + (long long)entry.resampledColumns * ImageHeight * Grid * Grid;
+		bool passed = wrong == 0 && renderer.GetSampleCount() == expectedSamples;
+		printf("%-5s %6d samples wrong, %lld kernel evaluations of %lld expected%s\n", entry.name, wrong,
+			renderer.GetSampleCount(), expectedSamples, passed ? "" : ": FAILED");
+		if (!passed)
+			++failures;
+	}
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
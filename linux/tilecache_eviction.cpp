@@ -0,0 +1,99 @@
+// Checks that TileCache keeps serving the right samples as tiles are
+// fetched, evicted and refetched, including after a fetch the host fails:
+// the slots such a fetch gave back must be reused without touching the
+// tile they no longer hold.
+//
+//	tilecache_eviction
+//
+// The image is a row of tiles whose samples encode their own position, and
+// the cache holds two of them.
+//-------------------------------------------------------------------------------
+#include "renderer/tilecache.h"
+
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+	const int Columns = 4;
+	const int ImageWidth = Columns * TileCache::TileSize;
+	const int ImageHeight = TileCache::TileSize;
+	const int Capacity = 2;
+
+	struct Step
+	{
+		const char* name;
+		int firstColumn;
+		int lastColumn;
+		bool fail;			// the host refuses the fetch
+	};
+
+	const Step s_Steps[] =
+	{
+		{ "fetch tile 0", 0, 0, false },
+		{ "failed fetch of tile 1", 1, 1, true },
+		{ "fetch tiles 1-2 after the failure", 1, 2, false },
+		{ "refetch tile 0", 0, 0, false },
+		{ "failed fetch of tiles 2-3", 2, 3, true },
+		{ "fetch tile 3 after the failure", 3, 3, false },
+		{ "fetch tiles 0-1", 0, 1, false },
+	};
+
+	float Expected(int x, int y)
+	{
+		return (float)(y * ImageWidth + x) / (ImageWidth * ImageHeight);
+	}
+
+	// Whether every pixel of the tiles [firstColumn, lastColumn] reads back
+	// as written.
+	bool Matches(const TileCache& cache, int firstColumn, int lastColumn)
+	{
+		for (int y = 0; y < ImageHeight; ++y)
+			for (int x = firstColumn * TileCache::TileSize; x < (lastColumn + 1) * TileCache::TileSize; ++x)
+				if (cache.Sample(x, y).GetValues()[0] != Expected(x, y))
+					return false;
+		return true;
+	}
+}
+
+int main()
+{
+	std::vector<float> image((size_t)ImageWidth * ImageHeight);
+	for (int y = 0; y < ImageHeight; ++y)
+		for (int x = 0; x < ImageWidth; ++x)
+			image[(size_t)y * ImageWidth + x] = Expected(x, y);
+
+	bool fail = false;
+	TileCache cache([&](const Renderer::Tile& rect, PixelLayout& pixels)
+	{
+		if (fail)
+			return false;
+		pixels.data = &image[(size_t)rect.top * ImageWidth + rect.left];
+		pixels.rowBytes = ImageWidth * sizeof(float);
+		pixels.columnBytes = sizeof(float);
+		pixels.planeBytes = sizeof(float);
+		return true;
+	}, ImageWidth, ImageHeight, 1, 32, Capacity);
+
+	int failures = 0;
+	for (size_t s = 0; s < sizeof(s_Steps) / sizeof(s_Steps[0]); ++s)
+	{
+		const Step& step = s_Steps[s];
+		Renderer::Tile rect;
+		rect.left = step.firstColumn * TileCache::TileSize;
+		rect.top = 0;
+		rect.right = (step.lastColumn + 1) * TileCache::TileSize;
+		rect.bottom = ImageHeight;
+
+		fail = step.fail;
+		bool prepared = cache.Prepare(rect);
+		bool passed = step.fail ? !prepared : prepared && Matches(cache, step.firstColumn, step.lastColumn);
+		printf("%-40s %s\n", step.name, passed ? "ok" : "FAILED");
+		if (!passed)
+			++failures;
+	}
+
+	if (failures != 0)
+		printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}